@@ -2,6 +2,10 @@
 
 #include <Dab/OpenGL/GLDab.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
 namespace dab
 {
 using namespace stick;
@@ -17,39 +21,243 @@ void destroyRenderDevice(RenderDevice * _device)
         static_cast<gl::GLRenderDevice *>(_device)->m_alloc->destroy(_device);
 }
 
-VertexLayout::VertexLayout(const VertexElementArray & _elements) : elements(_elements)
+static const UInt64 s_xxPrime1 = 11400714785074694791ULL;
+static const UInt64 s_xxPrime2 = 14029467366897019727ULL;
+static const UInt64 s_xxPrime3 = 1609587929392839161ULL;
+static const UInt64 s_xxPrime4 = 9650029242287828579ULL;
+static const UInt64 s_xxPrime5 = 2870177450012600261ULL;
+
+static UInt64 rotateLeft(UInt64 _value, UInt32 _bits)
+{
+    return (_value << _bits) | (_value >> (64 - _bits));
+}
+
+static UInt64 read64(const UInt8 * _ptr)
 {
-    finish();
+    UInt64 ret;
+    std::memcpy(&ret, _ptr, sizeof(ret));
+    return ret;
 }
 
-VertexLayout::VertexLayout(VertexElementArray && _elements) : elements(std::move(_elements))
+static UInt32 read32(const UInt8 * _ptr)
 {
-    finish();
+    UInt32 ret;
+    std::memcpy(&ret, _ptr, sizeof(ret));
+    return ret;
 }
 
-void VertexLayout::finish()
+static UInt64 xxRound(UInt64 _acc, UInt64 _input)
 {
+    _acc += _input * s_xxPrime2;
+    return rotateLeft(_acc, 31) * s_xxPrime1;
+}
+
+static UInt64 xxMergeRound(UInt64 _acc, UInt64 _value)
+{
+    _acc ^= xxRound(0, _value);
+    return _acc * s_xxPrime1 + s_xxPrime4;
+}
+
+UInt64 hashBytes(const void * _data, Size _byteCount, UInt64 _seed)
+{
+    const UInt8 * ptr = static_cast<const UInt8 *>(_data);
+    const UInt8 * end = ptr + _byteCount;
+    UInt64 ret;
+
+    if (_byteCount >= 32)
+    {
+        // four independent lanes, which keeps the multipliers of the cpu busy
+        UInt64 v1 = _seed + s_xxPrime1 + s_xxPrime2;
+        UInt64 v2 = _seed + s_xxPrime2;
+        UInt64 v3 = _seed;
+        UInt64 v4 = _seed - s_xxPrime1;
+        for (; ptr + 32 <= end; ptr += 32)
+        {
+            v1 = xxRound(v1, read64(ptr));
+            v2 = xxRound(v2, read64(ptr + 8));
+            v3 = xxRound(v3, read64(ptr + 16));
+            v4 = xxRound(v4, read64(ptr + 24));
+        }
+        ret = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        ret = xxMergeRound(ret, v1);
+        ret = xxMergeRound(ret, v2);
+        ret = xxMergeRound(ret, v3);
+        ret = xxMergeRound(ret, v4);
+    }
+    else
+        ret = _seed + s_xxPrime5;
+
+    ret += (UInt64)_byteCount;
+
+    for (; ptr + 8 <= end; ptr += 8)
+        ret = rotateLeft(ret ^ xxRound(0, read64(ptr)), 27) * s_xxPrime1 + s_xxPrime4;
+    if (ptr + 4 <= end)
+    {
+        ret = rotateLeft(ret ^ ((UInt64)read32(ptr) * s_xxPrime1), 23) * s_xxPrime2 + s_xxPrime3;
+        ptr += 4;
+    }
+    for (; ptr < end; ++ptr)
+        ret = rotateLeft(ret ^ (*ptr * s_xxPrime5), 11) * s_xxPrime1;
+
+    ret ^= ret >> 33;
+    ret *= s_xxPrime2;
+    ret ^= ret >> 29;
+    ret *= s_xxPrime3;
+    ret ^= ret >> 32;
+    return ret;
+}
+
+DataType narrowestIndexType(const UInt32 * _indices, Size _count)
+{
+    UInt32 maxIndex = 0;
+    for (Size i = 0; i < _count; ++i)
+    {
+        if (_indices[i] != s_primitiveRestartIndex)
+            maxIndex = std::max(maxIndex, _indices[i]);
+    }
+
+    if (maxIndex < 0xFF)
+        return DataType::UInt8;
+    if (maxIndex < 0xFFFF)
+        return DataType::UInt16;
+    return DataType::UInt32;
+}
+
+template <class T>
+static void narrowIndicesImpl(const UInt32 * _indices, Size _count, T * _dst)
+{
+    for (Size i = 0; i < _count; ++i)
+        _dst[i] = _indices[i] == s_primitiveRestartIndex ? (T)-1 : (T)_indices[i];
+}
+
+void narrowIndices(const UInt32 * _indices, Size _count, DataType _type, void * _dst)
+{
+    if (_type == DataType::UInt8)
+        narrowIndicesImpl(_indices, _count, static_cast<UInt8 *>(_dst));
+    else if (_type == DataType::UInt16)
+        narrowIndicesImpl(_indices, _count, static_cast<UInt16 *>(_dst));
+    else
+    {
+        STICK_ASSERT(_type == DataType::UInt32);
+        std::memcpy(_dst, _indices, _count * sizeof(UInt32));
+    }
+}
+
+VertexLayout::VertexLayout() : hash(0)
+{
+}
+
+VertexLayout::VertexLayout(const VertexElementArray & _elements,
+                           VertexPacking _packing,
+                           UInt32 _vertexCount,
+                           UInt32 _firstLocation) :
+    elements(_elements)
+{
+    finish(_packing, _vertexCount, _firstLocation);
+}
+
+VertexLayout::VertexLayout(VertexElementArray && _elements,
+                           VertexPacking _packing,
+                           UInt32 _vertexCount,
+                           UInt32 _firstLocation) :
+    elements(std::move(_elements))
+{
+    finish(_packing, _vertexCount, _firstLocation);
+}
+
+static UInt32 elementByteCount(const VertexElement & _el)
+{
+    // the packed types store all their components in one value
+    if (_el.dataType == DataType::Int2_10_10_10_Rev ||
+        _el.dataType == DataType::UInt2_10_10_10_Rev)
+        return s_dataTypeByteCount[static_cast<Size>(_el.dataType)];
+    return _el.elementCount * s_dataTypeByteCount[static_cast<Size>(_el.dataType)];
+}
+
+void VertexLayout::finish(VertexPacking _packing, UInt32 _vertexCount, UInt32 _firstLocation)
+{
+    STICK_ASSERT(_packing != VertexPacking::Planar || _vertexCount);
+
     auto it = elements.begin();
 
     UInt32 byteOffset = 0;
     UInt32 stride = 0;
-    UInt32 loc = 0;
+    UInt32 loc = _firstLocation;
 
-    for (; it != elements.end(); ++it)
+    if (_packing != VertexPacking::Explicit)
     {
-        auto s = (*it).elementCount * s_dataTypeByteCount[static_cast<Size>((*it).dataType)];
-        stride += s;
-        (*it).offset = byteOffset;
-        (*it).location = loc++;
-        byteOffset += s;
+        for (; it != elements.end(); ++it)
+        {
+            auto s = elementByteCount(*it);
+            stride += s;
+            (*it).offset = byteOffset;
+            (*it).location = loc++;
+            if (_packing == VertexPacking::Planar)
+            {
+                (*it).stride = s;
+                byteOffset += s * _vertexCount;
+            }
+            else
+                byteOffset += s;
+        }
+
+        if (_packing == VertexPacking::Interleaved)
+        {
+            for (it = elements.begin(); it != elements.end(); ++it)
+                (*it).stride = stride;
+        }
     }
 
+    // FNV-1a over all element fields
+    hash = 14695981039346656037ULL;
+    auto hashValue = [this](UInt32 _value) {
+        for (Size i = 0; i < 4; ++i)
+        {
+            hash ^= (_value >> (i * 8)) & 0xFF;
+            hash *= 1099511628211ULL;
+        }
+    };
+
     it = elements.begin();
     for (; it != elements.end(); ++it)
     {
-        (*it).stride = stride;
+        hashValue(static_cast<UInt32>((*it).dataType));
+        hashValue((*it).elementCount);
+        hashValue((*it).offset);
+        hashValue((*it).stride);
+        hashValue((*it).location);
+        hashValue((*it).divisor);
+        hashValue((UInt32)(*it).bNormalized | ((UInt32)(*it).bInteger << 1));
+    }
+}
+
+Size VertexLayout::byteCount(UInt32 _vertexCount) const
+{
+    if (!_vertexCount)
+        return 0;
+
+    Size ret = 0;
+    for (const auto & el : elements)
+    {
+        Size end = el.offset + (Size)el.stride * (_vertexCount - 1) + elementByteCount(el);
+        ret = std::max(ret, end);
+    }
+    return ret;
+}
+
+bool VertexLayout::isInterleaved() const
+{
+    if (!elements.count() || !elements[0].stride)
+        return false;
+
+    for (const auto & el : elements)
+    {
+        if (el.stride != elements[0].stride || (Size)el.offset + elementByteCount(el) > el.stride)
+            return false;
     }
+    return true;
 }
+
 PipelineSettings::PipelineSettings(Program * _prog) :
     program(_prog),
     viewport({ 0, 0, 0, 0 }),
@@ -59,7 +267,10 @@ PipelineSettings::PipelineSettings(Program * _prog) :
     depthFunction(CompareFunction::Less),
     colorWriteSettings({ true, true, true, true }),
     faceDirection(FaceDirection::CCW),
-    cullFace(FaceType::None)
+    cullFace(FaceType::None),
+    patchVertexCount(3),
+    primitiveRestart(false),
+    drawDataBlock(nullptr)
 {
 }
 
@@ -120,4 +331,196 @@ void BlendSettings::setBlendFunction(BlendFunction _srcFunc, BlendFunction _dest
     alphaDestBlendFunction = _destFunc;
 }
 
+ContentCacheStatistics::ContentCacheStatistics() :
+    bufferCount(0),
+    bufferRefCount(0),
+    textureCount(0),
+    textureRefCount(0),
+    byteCount(0),
+    savedByteCount(0)
+{
+}
+
+BufferPoolStatistics::BufferPoolStatistics() :
+    poolCount(0),
+    allocationCount(0),
+    freeRangeCount(0),
+    byteCount(0),
+    usedByteCount(0),
+    largestFreeRange(0)
+{
+}
+
+Float32 BufferPoolStatistics::fragmentation() const
+{
+    Size freeByteCount = byteCount - usedByteCount;
+    if (!freeByteCount)
+        return 0.0f;
+    return 1.0f - (Float32)largestFreeRange / (Float32)freeByteCount;
+}
+
+StripIndexBuilder::StripIndexBuilder(Allocator & _alloc) : m_indices(_alloc), m_stripCount(0)
+{
+}
+
+void StripIndexBuilder::beginStrip()
+{
+    if (m_stripCount++)
+        m_indices.append(s_primitiveRestartIndex);
+}
+
+void StripIndexBuilder::addStrip(const UInt32 * _indices, UInt32 _count, UInt32 _baseVertex)
+{
+    if (!_count)
+        return;
+
+    beginStrip();
+    for (UInt32 i = 0; i < _count; ++i)
+    {
+        STICK_ASSERT(_indices[i] + _baseVertex != s_primitiveRestartIndex);
+        m_indices.append(_indices[i] + _baseVertex);
+    }
+}
+
+void StripIndexBuilder::addStrip(UInt32 _firstVertex, UInt32 _count)
+{
+    if (!_count)
+        return;
+
+    beginStrip();
+    for (UInt32 i = 0; i < _count; ++i)
+        m_indices.append(_firstVertex + i);
+}
+
+void StripIndexBuilder::clear()
+{
+    m_indices.clear();
+    m_stripCount = 0;
+}
+
+void StripIndexBuilder::upload(IndexBuffer * _buffer) const
+{
+    _buffer->loadIndices(m_indices.ptr(), m_indices.count());
+}
+
+UInt32 StripIndexBuilder::stripCount() const
+{
+    return m_stripCount;
+}
+
+UInt32 StripIndexBuilder::indexCount() const
+{
+    return (UInt32)m_indices.count();
+}
+
+const UInt32 * StripIndexBuilder::indices() const
+{
+    return m_indices.ptr();
+}
+
+IndirectDrawBuilder::IndirectDrawBuilder(bool _bIndexed, Allocator & _alloc) :
+    m_bIndexed(_bIndexed),
+    m_data(_alloc)
+{
+}
+
+void IndirectDrawBuilder::addDraw(
+    UInt32 _offset, UInt32 _count, Int32 _baseVertex, UInt32 _instanceCount, UInt32 _baseInstance)
+{
+    if (m_bIndexed)
+    {
+        DrawElementsIndirectCommand cmd = {
+            _count, _instanceCount, _offset, _baseVertex, _baseInstance
+        };
+        const UInt32 * words = reinterpret_cast<const UInt32 *>(&cmd);
+        m_data.append(words, words + sizeof(cmd) / sizeof(UInt32));
+    }
+    else
+    {
+        STICK_ASSERT(_baseVertex == 0);
+        DrawArraysIndirectCommand cmd = { _count, _instanceCount, _offset, _baseInstance };
+        const UInt32 * words = reinterpret_cast<const UInt32 *>(&cmd);
+        m_data.append(words, words + sizeof(cmd) / sizeof(UInt32));
+    }
+}
+
+void IndirectDrawBuilder::clear()
+{
+    m_data.clear();
+}
+
+void IndirectDrawBuilder::upload(StorageBuffer * _buffer) const
+{
+    _buffer->loadDataRaw(m_data.ptr(), byteCount());
+}
+
+UInt32 IndirectDrawBuilder::drawCount() const
+{
+    return (UInt32)(byteCount() / stride());
+}
+
+UInt32 IndirectDrawBuilder::stride() const
+{
+    return m_bIndexed ? sizeof(DrawElementsIndirectCommand) : sizeof(DrawArraysIndirectCommand);
+}
+
+Size IndirectDrawBuilder::byteCount() const
+{
+    return m_data.count() * sizeof(UInt32);
+}
+
+const void * IndirectDrawBuilder::data() const
+{
+    return m_data.ptr();
+}
+
+Float32 projectedPixelsPerUnit(Float32 _distance,
+                               Float32 _fovY,
+                               UInt32 _viewportHeight,
+                               Float32 _scale)
+{
+    // the visible height at _distance is 2 * _distance * tan(_fovY / 2)
+    Float32 visibleHeight = 2.0f * std::max(_distance, 1e-6f) * std::tan(_fovY * 0.5f);
+    return (Float32)_viewportHeight * _scale / visibleHeight;
+}
+
+UInt32 selectLOD(const MeshLOD * _lods,
+                 UInt32 _count,
+                 Float32 _pixelsPerUnit,
+                 Float32 _maxPixelError)
+{
+    STICK_ASSERT(_count);
+    UInt32 ret = 0;
+    while (ret + 1 < _count && _lods[ret + 1].error * _pixelsPerUnit <= _maxPixelError)
+        ++ret;
+    return ret;
+}
+
+void RenderPass::drawMeshLOD(const Mesh * _mesh,
+                             const Pipeline * _pipeline,
+                             const MeshLOD * _lods,
+                             UInt32 _lodCount,
+                             Float32 _pixelsPerUnit,
+                             Float32 _maxPixelError,
+                             VertexDrawMode _drawMode)
+{
+    const MeshLOD & lod = _lods[selectLOD(_lods, _lodCount, _pixelsPerUnit, _maxPixelError)];
+    drawMesh(_mesh, _pipeline, lod.firstIndex, lod.indexCount, _drawMode);
+}
+
+void RenderPass::drawTransientGeometry(const TransientGeometry & _geometry,
+                                       const Pipeline * _pipeline,
+                                       VertexDrawMode _drawMode)
+{
+    if (_geometry.indices)
+        drawMesh(_geometry.mesh,
+                 _pipeline,
+                 _geometry.firstIndex,
+                 _geometry.indexCount,
+                 _geometry.baseVertex,
+                 _drawMode);
+    else
+        drawMesh(_geometry.mesh, _pipeline, _geometry.baseVertex, _geometry.vertexCount, _drawMode);
+}
+
 } // namespace dab
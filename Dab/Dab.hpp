@@ -13,7 +13,11 @@ using Float32 = stick::Float32;
 using Float64 = stick::Float64;
 using Size = stick::Size;
 using UInt8 = stick::UInt8;
+using Int8 = stick::Int8;
+using UInt16 = stick::UInt16;
+using Int16 = stick::Int16;
 using UInt32 = stick::UInt32;
+using UInt64 = stick::UInt64;
 using Int32 = stick::Int32;
 
 struct STICK_API Rect
@@ -31,6 +35,10 @@ enum class STICK_API DataType
     Int32,
     Float32,
     Float64,
+    Float16,
+    // four components packed into 32 bits, x in the lowest 10 bits and w in the highest 2
+    Int2_10_10_10_Rev,
+    UInt2_10_10_10_Rev,
     Count
 };
 
@@ -50,13 +58,49 @@ const UInt8 s_dataTypeByteCount[] = {
     // Float32
     4,
     // Float64
-    8
+    8,
+    // Float16
+    2,
+    // Int2_10_10_10_Rev (all four components)
+    4,
+    // UInt2_10_10_10_Rev (all four components)
+    4
 };
 
-// @NOTE: For future hints regarding buffer usage
+// The usage class (Static, Dynamic, Stream or Readback) tells the device how the data is
+// updated, it can be combined with BufferUsageSuballocate or BufferUsageDeduplicate for static
+// buffers.
 enum STICK_API BufferUsageFlags
 {
-    BufferUsageDefault = 0
+    // written once (or rarely) and drawn many times
+    BufferUsageStatic = 0,
+    BufferUsageDefault = BufferUsageStatic,
+    // Vertex and index buffers only. The data is stored in a range of a few big buffers owned by
+    // the device, so that meshes using them can be drawn without rebinding any buffers.
+    BufferUsageSuballocate = 1 << 0,
+    // Updated every few frames. Vertex and index buffers are internally multi-buffered, so that
+    // writes go to a copy the GPU is done with instead of stalling on pending draws.
+    BufferUsageDynamic = 1 << 1,
+    // rewritten every frame, multi-buffered like BufferUsageDynamic
+    BufferUsageStream = 1 << 2,
+    // written by the GPU and read back by the CPU
+    BufferUsageReadback = 1 << 3,
+    // Vertex and index buffers only. Buffers loaded with identical data share one GPU buffer. The
+    // content is looked up by its hash (see hashBytes) and compared against a CPU copy that the
+    // device keeps of every shared buffer's data. Writing to a shared buffer through updateRange,
+    // map or an UploadQueue gives it its own copy first. Writes by the GPU are not tracked and
+    // affect every buffer that shares the data.
+    BufferUsageDeduplicate = 1 << 4
+};
+
+enum STICK_API TextureUsageFlags
+{
+    TextureUsageDefault = 0,
+    // Textures loaded with identical pixels and parameters share one GPU texture, loading new
+    // pixels gives the texture its own again. Like BufferUsageDeduplicate, the device keeps a CPU
+    // copy of the pixels of every shared texture. Don't use it for textures the GPU writes to, i.e.
+    // through images or render buffers.
+    TextureUsageDeduplicate = 1 << 0
 };
 
 enum class STICK_API VertexDrawMode
@@ -68,6 +112,18 @@ enum class STICK_API VertexDrawMode
     Lines,
     LineStrip,
     LineLoop,
+    Patches, // requires a program with tessellation stages, see PipelineSettings::patchVertexCount
+    Count
+};
+
+enum class STICK_API ShaderStage
+{
+    Vertex,
+    Pixel,
+    Geometry,
+    TessellationControl,
+    TessellationEvaluation,
+    Compute,
     Count
 };
 
@@ -81,6 +137,44 @@ enum class STICK_API ProgramVariableType
     Matrix4f
 };
 
+enum class STICK_API ImageAccess
+{
+    Read,
+    Write,
+    ReadWrite,
+    Count
+};
+
+// used with RenderPass::memoryBarrier to make incoherent writes (i.e. from compute shaders or image
+// stores) visible to the specified consumers.
+enum STICK_API BarrierFlags
+{
+    BarrierVertexAttributes = 1,
+    BarrierIndices = 1 << 1,
+    BarrierUniforms = 1 << 2,
+    BarrierTextureFetch = 1 << 3,
+    BarrierImageAccess = 1 << 4,
+    BarrierIndirectCommands = 1 << 5,
+    BarrierBufferUpdate = 1 << 6,
+    BarrierTextureUpdate = 1 << 7,
+    BarrierFramebuffer = 1 << 8,
+    BarrierStorageBuffers = 1 << 9,
+    BarrierAll = 0xFFFFFFFF
+};
+
+// used with VertexBuffer::map and IndexBuffer::map, at least one of BufferMapRead and
+// BufferMapWrite has to be set
+enum STICK_API BufferMapFlags
+{
+    BufferMapRead = 1,
+    BufferMapWrite = 1 << 1,
+    // the previous contents of the range are discarded, can't be combined with BufferMapRead
+    BufferMapInvalidateRange = 1 << 2,
+    // don't wait for the GPU to finish reading the buffer, the caller has to make sure not to
+    // overwrite anything that is still in use
+    BufferMapUnsynchronized = 1 << 3
+};
+
 enum STICK_API BufferType
 {
     BufferDepth = 1,
@@ -282,19 +376,52 @@ struct STICK_API VertexElement
     UInt32 offset; // the offset to the first element
     UInt32 stride; // the offset between the elements
     UInt32 location;
+    UInt32 divisor; // 0 advances per vertex, N advances once every N instances
+    // Fixed point data is mapped to [0, 1] (unsigned) or [-1, 1] (signed) instead of being
+    // converted to float as is. Use this for i.e. UInt8 colors or Int2_10_10_10_Rev normals.
+    bool bNormalized;
+    // Integer data is passed to the shader as integers (ivec/uvec), i.e. for indices or flags.
+    bool bInteger;
 };
 
 using VertexElementArray = stick::DynamicArray<VertexElement>;
 
-struct STICK_API VertexLayout
+// how VertexLayout::finish arranges the elements of a layout within its buffer
+enum class STICK_API VertexPacking
 {
-    VertexLayout() = default;
-
-    VertexLayout(const VertexElementArray & _elements);
-
-    VertexLayout(VertexElementArray && _elements);
+    Interleaved, // all elements of a vertex follow each other, sharing one stride
+    Planar, // each element is tightly packed in its own block of vertexCount elements
+    Explicit // offsets, strides and locations are used as provided
+};
 
-    void finish();
+struct STICK_API VertexLayout
+{
+    VertexLayout();
+
+    VertexLayout(const VertexElementArray & _elements,
+                 VertexPacking _packing = VertexPacking::Interleaved,
+                 UInt32 _vertexCount = 0,
+                 UInt32 _firstLocation = 0);
+
+    VertexLayout(VertexElementArray && _elements,
+                 VertexPacking _packing = VertexPacking::Interleaved,
+                 UInt32 _vertexCount = 0,
+                 UInt32 _firstLocation = 0);
+
+    // Computes the offsets, strides and locations of the elements according to _packing and the
+    // hash. Planar packing needs the number of vertices in the buffer. Locations are assigned in
+    // order starting at _firstLocation, so that the layouts of a mesh with multiple vertex
+    // buffers (i.e. a separate stream for frequently updated attributes) don't overlap.
+    // Explicit packing only computes the hash.
+    void finish(VertexPacking _packing = VertexPacking::Interleaved,
+                UInt32 _vertexCount = 0,
+                UInt32 _firstLocation = 0);
+
+    // the number of bytes _vertexCount vertices of this layout occupy in their buffer
+    Size byteCount(UInt32 _vertexCount) const;
+    // true if all elements share one non-zero stride and fit within it, i.e. each vertex is one
+    // contiguous block. Equal strides alone don't suffice, planar elements of equal size have them.
+    bool isInterleaved() const;
 
     VertexLayout(const VertexLayout &) = default;
     VertexLayout(VertexLayout &&) = default;
@@ -302,15 +429,22 @@ struct STICK_API VertexLayout
     VertexLayout & operator=(VertexLayout &&) = default;
 
     VertexElementArray elements;
+    UInt64 hash; // hash of all elements, computed by finish()
 };
 
+class Shader;
 class Program;
 class Pipeline;
 class PipelineVariable;
 class PipelineTexture;
+class PipelineBuffer;
+class PipelineImage;
 class VertexBuffer;
 class IndexBuffer;
+class StorageBuffer;
 class Mesh;
+class VertexPool;
+class UploadQueue;
 class Texture;
 class Sampler;
 class RenderBuffer;
@@ -379,6 +513,20 @@ struct STICK_API PipelineSettings
     stick::Maybe<BlendSettings> blendSettings;
     FaceDirection faceDirection;
     FaceType cullFace;
+    UInt32 patchVertexCount; // number of vertices per patch for VertexDrawMode::Patches
+    // In indexed draws, the largest value of the index type (0xFF, 0xFFFF or 0xFFFFFFFF) ends the
+    // current strip, fan or loop and starts a new one, see StripIndexBuilder.
+    bool primitiveRestart;
+    // Optional name of a shader storage block that consists of a single unsized array of structs,
+    // i.e. buffer DrawData { PerDraw drawData[]; }. The members of the struct are set through
+    // Pipeline::variable like regular uniforms, but instead of binding a uniform buffer range per
+    // draw, each draw appends its values to one buffer per pass and passes the element index as
+    // its base instance. Shaders read their element with drawData[gl_BaseInstance + gl_InstanceID]
+    // (requires GLSL 4.60 or ARB_shader_draw_parameters). Draws with draw data are single instance
+    // draws. Consecutive draws that only differ in their draw data are folded into one instanced
+    // draw (see RenderStatistics). Per instance vertex attributes are offset by the base instance
+    // too, so they should not be combined with draw data.
+    const char * drawDataBlock;
 };
 
 struct STICK_API SamplerSettings
@@ -406,6 +554,42 @@ struct STICK_API RenderBufferSettings
     stick::DynamicArray<RenderTarget> renderTargets;
 };
 
+// counters accumulated by the render device until RenderDevice::resetStatistics is called
+struct STICK_API RenderStatistics
+{
+    UInt32 recordedDrawCount; // draws recorded in render passes
+    UInt32 foldedDrawCount;   // recorded draws that were folded into the instanced draw before them
+    UInt32 issuedDrawCount;   // draw calls issued to the GPU
+};
+
+struct STICK_API ContentCacheStatistics
+{
+    ContentCacheStatistics();
+
+    UInt32 bufferCount;    // distinct GPU buffers of all deduplicated buffers
+    UInt32 bufferRefCount; // deduplicated buffers that reference them
+    UInt32 textureCount;
+    UInt32 textureRefCount;
+    Size byteCount;      // memory of the distinct buffers and textures
+    Size savedByteCount; // memory that the duplicates would have used on their own
+};
+
+// memory usage of the buffer pools that hold the BufferUsageSuballocate buffers
+struct STICK_API BufferPoolStatistics
+{
+    BufferPoolStatistics();
+
+    // 0 if all free memory is in one range, approaching 1 the more it is scattered
+    Float32 fragmentation() const;
+
+    UInt32 poolCount;
+    UInt32 allocationCount;
+    UInt32 freeRangeCount;
+    Size byteCount; // capacity of all pools
+    Size usedByteCount;
+    Size largestFreeRange;
+};
+
 class STICK_API RenderDevice
 {
   public:
@@ -413,24 +597,54 @@ class STICK_API RenderDevice
     {
     }
 
-    virtual stick::Result<Program *> createProgram(const char * _vertexShader,
-                                                   const char * _pixelShader) = 0;
+    // the geometry and tessellation stages are optional
+    virtual stick::Result<Program *> createProgram(
+        const char * _vertexShader,
+        const char * _pixelShader,
+        const char * _geometryShader = nullptr,
+        const char * _tessControlShader = nullptr,
+        const char * _tessEvaluationShader = nullptr) = 0;
+    // Creates a program from separately compiled shader stages (see createShader). The stages are
+    // combined without relinking, so they can be mixed and matched freely and have to outlive all
+    // programs that were created from them.
+    virtual stick::Result<Program *> createProgram(Shader * const * _stages, Size _count) = 0;
+    virtual stick::Result<Program *> createComputeProgram(const char * _computeShader) = 0;
     virtual void destroyProgram(Program * _prog) = 0;
+    virtual stick::Result<Shader *> createShader(ShaderStage _stage, const char * _code) = 0;
+    virtual void destroyShader(Shader * _shader) = 0;
     virtual stick::Result<Pipeline *> createPipeline(const PipelineSettings & _settings) = 0;
     virtual void destroyPipeline(Pipeline * _pipe) = 0;
     virtual stick::Result<VertexBuffer *> createVertexBuffer(
         BufferUsageFlags _usage = BufferUsageDefault) = 0;
     virtual void destroyVertexBuffer(VertexBuffer * _buff) = 0;
+    // _indexType is DataType::UInt8, UInt16 or UInt32, see IndexBuffer::setIndexType
     virtual stick::Result<IndexBuffer *> createIndexBuffer(
-        BufferUsageFlags _usage = BufferUsageDefault) = 0;
+        BufferUsageFlags _usage = BufferUsageDefault, DataType _indexType = DataType::UInt32) = 0;
     virtual void destroyIndexBuffer(IndexBuffer * _buff) = 0;
+    virtual stick::Result<StorageBuffer *> createStorageBuffer(
+        BufferUsageFlags _usage = BufferUsageDefault) = 0;
+    virtual void destroyStorageBuffer(StorageBuffer * _buff) = 0;
+    // _layouts[i] describes the data in _vertexBuffers[i]. Attributes that are updated every frame
+    // can be kept in a buffer of their own, so updating them doesn't re-upload the others.
     virtual stick::Result<Mesh *> createMesh(VertexBuffer ** _vertexBuffers,
                                              const VertexLayout * _layouts,
                                              Size _count,
                                              IndexBuffer * _indexBuffer = nullptr) = 0;
     virtual void destroyMesh(Mesh * _mesh) = 0;
-
-    virtual stick::Result<Texture *> createTexture() = 0;
+    // Creates shared storage for the vertex and index data of meshes that use _layout, see
+    // VertexPool. Only interleaved layouts of 32 bit element types are supported.
+    virtual stick::Result<VertexPool *> createVertexPool(const VertexLayout & _layout,
+                                                         Size _vertexCapacity,
+                                                         Size _indexCapacity) = 0;
+    virtual void destroyVertexPool(VertexPool * _pool) = 0;
+    // _stagingByteCount is the size of the staging buffer, _bytesPerFrame the budget of
+    // UploadQueue::process
+    virtual stick::Result<UploadQueue *> createUploadQueue(Size _stagingByteCount,
+                                                           Size _bytesPerFrame) = 0;
+    virtual void destroyUploadQueue(UploadQueue * _queue) = 0;
+
+    virtual stick::Result<Texture *> createTexture(
+        TextureUsageFlags _usage = TextureUsageDefault) = 0;
     virtual void destroyTexture(Texture * _texture) = 0;
     virtual stick::Result<Sampler *> createSampler(
         const SamplerSettings & _settings = SamplerSettings()) = 0;
@@ -440,9 +654,32 @@ class STICK_API RenderDevice
         const RenderBufferSettings & _settings) = 0;
     virtual void destroyRenderBuffer(RenderBuffer * _renderBuffer, bool _bDestroyRenderTargets) = 0;
 
+    // Issues a cheap draw for each pipeline into a tiny internal render buffer so that the driver
+    // finishes compiling the program/state combination ahead of time (i.e. during a loading
+    // screen) rather than on the first frame that uses it. The internal render buffer matches the
+    // formats and sample count of _target, or the default framebuffer if _target is nullptr.
+    // If _outSeconds is provided, it receives the warm up time of each pipeline in seconds.
+    virtual stick::Error warmUp(Pipeline * const * _pipelines,
+                                Size _count,
+                                RenderBuffer * _target = nullptr,
+                                Float64 * _outSeconds = nullptr) = 0;
+
     virtual RenderPass * beginPass(const RenderPassSettings & _settings = RenderPassSettings()) = 0;
     virtual stick::Error endPass(RenderPass * _pass) = 0;
 
+    virtual const RenderStatistics & statistics() const = 0;
+    virtual void resetStatistics() = 0;
+
+    virtual BufferPoolStatistics bufferPoolStatistics() const = 0;
+    // Moves all BufferUsageSuballocate buffers to the front of their pools to get rid of
+    // fragmentation and releases pools that end up empty. Their byteOffset changes, so pipeline
+    // buffers and indirect draw commands that depend on it have to be updated. Must not be called
+    // while a pass is recorded.
+    virtual void compactBufferPools() = 0;
+
+    // how much GPU memory BufferUsageDeduplicate and TextureUsageDeduplicate save
+    virtual ContentCacheStatistics contentCacheStatistics() const = 0;
+
     virtual void readPixels(stick::Int32 _x,
                             stick::Int32 _y,
                             stick::Int32 _w,
@@ -460,6 +697,32 @@ STICK_API stick::Result<RenderDevice *> createRenderDevice(
     stick::Allocator & _alloc = stick::defaultAllocator());
 STICK_API void destroyRenderDevice(RenderDevice * _device);
 
+// 64 bit xxHash (XXH64) of _byteCount bytes, used to identify deduplicated content
+STICK_API UInt64 hashBytes(const void * _data, Size _byteCount, UInt64 _seed = 0);
+
+// separates strips in 32 bit index data, see PipelineSettings::primitiveRestart
+const UInt32 s_primitiveRestartIndex = 0xFFFFFFFF;
+
+// The smallest index type (DataType::UInt8, UInt16 or UInt32) that can hold all of _indices. The
+// largest value of each type is reserved for primitive restart, s_primitiveRestartIndex in
+// _indices maps to the largest value of the returned type.
+STICK_API DataType narrowestIndexType(const UInt32 * _indices, Size _count);
+// converts _count indices to _type, _dst needs room for _count indices of _type
+STICK_API void narrowIndices(const UInt32 * _indices, Size _count, DataType _type, void * _dst);
+
+class STICK_API Shader
+{
+  public:
+    virtual ~Shader()
+    {
+    }
+
+  protected:
+    Shader()
+    {
+    }
+};
+
 class STICK_API Program
 {
   public:
@@ -482,6 +745,10 @@ class STICK_API Pipeline
 
     virtual PipelineVariable * variable(const char * _name) = 0;
     virtual PipelineTexture * texture(const char * _name) = 0;
+    // shader storage block with the given name
+    virtual PipelineBuffer * buffer(const char * _name) = 0;
+    // image uniform (for image load/store) with the given name
+    virtual PipelineImage * image(const char * _name) = 0;
 
   protected:
     Pipeline()
@@ -526,6 +793,41 @@ class STICK_API PipelineTexture
     }
 };
 
+// binds a buffer (or a range of it if _byteCount is not 0) to a shader storage block
+class STICK_API PipelineBuffer
+{
+  public:
+    virtual ~PipelineBuffer()
+    {
+    }
+
+    virtual void set(const StorageBuffer * _buffer, Size _byteOffset = 0, Size _byteCount = 0) = 0;
+    virtual void set(const VertexBuffer * _buffer, Size _byteOffset = 0, Size _byteCount = 0) = 0;
+    virtual void set(const IndexBuffer * _buffer, Size _byteOffset = 0, Size _byteCount = 0) = 0;
+
+  protected:
+    PipelineBuffer()
+    {
+    }
+};
+
+class STICK_API PipelineImage
+{
+  public:
+    virtual ~PipelineImage()
+    {
+    }
+
+    virtual void set(const Texture * _tex,
+                     UInt32 _level = 0,
+                     ImageAccess _access = ImageAccess::ReadWrite) = 0;
+
+  protected:
+    PipelineImage()
+    {
+    }
+};
+
 class STICK_API VertexBuffer
 {
   public:
@@ -534,6 +836,16 @@ class STICK_API VertexBuffer
     }
 
     virtual void loadDataRaw(const void * _data, Size _byteCount) = 0;
+    // updates part of the data that was previously loaded without reallocating the buffer
+    virtual stick::Error updateRange(Size _byteOffset, const void * _data, Size _byteCount) = 0;
+    // _flags is a combination of BufferMapFlags. Only one range can be mapped at a time, which
+    // for suballocated buffers also applies to all the other buffers in the same arena.
+    virtual stick::Result<void *> map(Size _byteOffset, Size _byteCount, UInt32 _flags) = 0;
+    virtual stick::Error unmap() = 0;
+    // The offset of the data in the shared buffer if BufferUsageSuballocate is used, 0
+    // otherwise. Draws of meshes address it through base vertex and first index, which indirect
+    // draw commands have to take into account themselves.
+    virtual Size byteOffset() const = 0;
 
   protected:
     VertexBuffer()
@@ -549,6 +861,24 @@ class STICK_API IndexBuffer
     }
 
     virtual void loadDataRaw(const void * _data, Size _byteCount) = 0;
+    // Narrows _indices to the smallest index type that can hold them (see narrowestIndexType),
+    // makes it the index type of the buffer and loads them.
+    virtual void loadIndices(const UInt32 * _indices, Size _count) = 0;
+    // updates part of the data that was previously loaded without reallocating the buffer
+    virtual stick::Error updateRange(Size _byteOffset, const void * _data, Size _byteCount) = 0;
+    // _flags is a combination of BufferMapFlags. Only one range can be mapped at a time, which
+    // for suballocated buffers also applies to all the other buffers in the same arena.
+    virtual stick::Result<void *> map(Size _byteOffset, Size _byteCount, UInt32 _flags) = 0;
+    virtual stick::Error unmap() = 0;
+    // The offset of the data in the shared buffer if BufferUsageSuballocate is used, 0
+    // otherwise. Draws of meshes address it through base vertex and first index, which indirect
+    // draw commands have to take into account themselves.
+    virtual Size byteOffset() const = 0;
+
+    // The type of the indices in the buffer (DataType::UInt8, UInt16 or UInt32). Draw offsets and
+    // indirect firstIndex values are in indices of this type.
+    virtual DataType indexType() const = 0;
+    virtual void setIndexType(DataType _type) = 0;
 
   protected:
     IndexBuffer()
@@ -556,6 +886,22 @@ class STICK_API IndexBuffer
     }
 };
 
+// generic buffer that can be read and written by shaders through PipelineBuffer
+class STICK_API StorageBuffer
+{
+  public:
+    virtual ~StorageBuffer()
+    {
+    }
+
+    virtual void loadDataRaw(const void * _data, Size _byteCount) = 0;
+
+  protected:
+    StorageBuffer()
+    {
+    }
+};
+
 class STICK_API Mesh
 {
   public:
@@ -569,6 +915,90 @@ class STICK_API Mesh
     }
 };
 
+// Stores the vertices and indices of many meshes in shared storage buffers. Instead of reading
+// vertex attributes, shaders fetch them with the code returned by fetchShaderCode, i.e.:
+//
+// uint vertex = dabVertexIndex();
+// vec3 position = dabFetchAttribute0(vertex); // fetches the element at location 0
+//
+// As all meshes of a pool share the same storage, drawing them does not require any VAO or
+// buffer changes. The meshes of a pool are drawn like any other mesh, either directly or with
+// RenderPass::drawMeshIndirect using DrawArraysIndirectCommands that start at firstIndex.
+class STICK_API VertexPool
+{
+  public:
+    virtual ~VertexPool()
+    {
+    }
+
+    // _indices are relative to the first of _vertices. If _indices is nullptr, the vertices are
+    // drawn in order. The returned mesh is owned by the pool.
+    virtual stick::Result<Mesh *> allocateMesh(const void * _vertices,
+                                               UInt32 _vertexCount,
+                                               const UInt32 * _indices,
+                                               UInt32 _indexCount) = 0;
+    // destroys all meshes of the pool and makes its whole capacity available again
+    virtual void clear() = 0;
+    // the position of the mesh's first index in the pool
+    virtual UInt32 firstIndex(const Mesh * _mesh) const = 0;
+    // GLSL declaring the pool's storage blocks and fetch functions, to be placed after #version
+    virtual const char * fetchShaderCode() const = 0;
+
+  protected:
+    VertexPool()
+    {
+    }
+};
+
+using UploadID = UInt64;
+
+// returned by UploadQueue::enqueue if the staging buffer has no room for the upload yet
+const UploadID s_noStagingSpace = 0;
+
+// Uploads buffer data through a persistently mapped staging buffer so that big uploads (i.e. when
+// streaming in assets) don't stall the thread that submits them. enqueue can be called from any
+// thread. The copies into the destination buffers are issued on the render thread by process,
+// which limits the bytes copied per call to spread big uploads over multiple frames.
+class STICK_API UploadQueue
+{
+  public:
+    virtual ~UploadQueue()
+    {
+    }
+
+    // Copies _data to the staging buffer and queues its copy to _byteOffset of _buffer. The
+    // destination has to be a static buffer that is big enough already (i.e. allocated with
+    // loadDataRaw(nullptr, byteCount)) and outlives the upload. Returns s_noStagingSpace if the
+    // staging buffer is full, in which case the upload can be retried after the next process call.
+    // Errors are permanent, i.e. the upload is bigger than stagingByteCount or the usage of the
+    // destination doesn't allow uploads. Uploads of zero bytes are complete right away.
+    virtual stick::Result<UploadID> enqueue(VertexBuffer * _buffer,
+                                            Size _byteOffset,
+                                            const void * _data,
+                                            Size _byteCount) = 0;
+    virtual stick::Result<UploadID> enqueue(IndexBuffer * _buffer,
+                                            Size _byteOffset,
+                                            const void * _data,
+                                            Size _byteCount) = 0;
+    // Issues the copies of the staged uploads in order until the budget is used up (the first one
+    // is always issued) and releases the staging memory of completed ones. Call once per frame
+    // on the render thread.
+    virtual void process() = 0;
+    virtual void setBytesPerFrame(Size _byteCount) = 0;
+    // the size of the staging buffer, the biggest upload that can be enqueued at once
+    virtual Size stagingByteCount() const = 0;
+
+    // true once the GPU finished copying the upload, updated by process
+    virtual bool isComplete(UploadID _id) const = 0;
+    // true if none of the buffers of _mesh has pending uploads, i.e. it is ready to be drawn
+    virtual bool isResident(const Mesh * _mesh) const = 0;
+
+  protected:
+    UploadQueue()
+    {
+    }
+};
+
 class STICK_API Texture
 {
   public:
@@ -623,8 +1053,121 @@ class STICK_API RenderBuffer
     }
 };
 
+// memory layout of an indirect draw of an indexed mesh
+struct STICK_API DrawElementsIndirectCommand
+{
+    UInt32 indexCount;
+    UInt32 instanceCount;
+    UInt32 firstIndex;
+    Int32 baseVertex;
+    UInt32 baseInstance;
+};
+
+// memory layout of an indirect draw of a non-indexed mesh
+struct STICK_API DrawArraysIndirectCommand
+{
+    UInt32 vertexCount;
+    UInt32 instanceCount;
+    UInt32 firstVertex;
+    UInt32 baseInstance;
+};
+
+// Joins many strips, fans or line loops into one index buffer, separated by restart indices, so
+// that all of them can be drawn with a single draw of a pipeline with
+// PipelineSettings::primitiveRestart.
+class STICK_API StripIndexBuilder
+{
+  public:
+    StripIndexBuilder(stick::Allocator & _alloc = stick::defaultAllocator());
+
+    // appends the strip _indices, each offset by _baseVertex
+    void addStrip(const UInt32 * _indices, UInt32 _count, UInt32 _baseVertex = 0);
+    // appends a strip of the _count consecutive vertices starting at _firstVertex
+    void addStrip(UInt32 _firstVertex, UInt32 _count);
+    void clear();
+    // loads the indices with the smallest index type that fits them, see IndexBuffer::loadIndices
+    void upload(IndexBuffer * _buffer) const;
+
+    UInt32 stripCount() const;
+    UInt32 indexCount() const; // including the restart indices
+    const UInt32 * indices() const;
+
+  private:
+    void beginStrip();
+
+    stick::DynamicArray<UInt32> m_indices;
+    UInt32 m_stripCount;
+};
+
+// CPU helper to build the contents of an indirect buffer for RenderPass::drawMeshIndirect
+class STICK_API IndirectDrawBuilder
+{
+  public:
+    // _bIndexed decides if DrawElementsIndirectCommands or DrawArraysIndirectCommands are built
+    IndirectDrawBuilder(bool _bIndexed = true,
+                        stick::Allocator & _alloc = stick::defaultAllocator());
+
+    // _baseVertex has to be 0 for non-indexed draws
+    void addDraw(UInt32 _offset,
+                 UInt32 _count,
+                 Int32 _baseVertex = 0,
+                 UInt32 _instanceCount = 1,
+                 UInt32 _baseInstance = 0);
+    void clear();
+    void upload(StorageBuffer * _buffer) const;
+
+    UInt32 drawCount() const;
+    UInt32 stride() const;
+    Size byteCount() const;
+    const void * data() const;
+
+  private:
+    bool m_bIndexed;
+    stick::DynamicArray<UInt32> m_data;
+};
+
 using ExternalDrawFunction = std::function<stick::Error()>;
 
+// One level of detail of an indexed mesh, a range of its index buffer over the shared vertices.
+// See buildLODChain in MeshOptimizer.hpp.
+struct STICK_API MeshLOD
+{
+    UInt32 firstIndex;
+    UInt32 indexCount;
+    Float32 error; // the deviation from the full detail surface, in object space units
+};
+
+// The number of pixels that one object space unit covers at _distance from a perspective camera
+// with the vertical field of view _fovY (in radians) and a viewport of _viewportHeight pixels.
+// _scale is the largest scale factor of the object's transform.
+STICK_API Float32 projectedPixelsPerUnit(Float32 _distance,
+                                         Float32 _fovY,
+                                         UInt32 _viewportHeight,
+                                         Float32 _scale = 1.0f);
+
+// Returns the index of the coarsest of the _count _lods (ordered from fine to coarse) whose error
+// covers at most _maxPixelError pixels on screen.
+STICK_API UInt32 selectLOD(const MeshLOD * _lods,
+                           UInt32 _count,
+                           Float32 _pixelsPerUnit,
+                           Float32 _maxPixelError = 1.0f);
+
+// Vertices and indices allocated with RenderPass::allocateTransientGeometry, i.e. for UI or debug
+// geometry that is rebuilt every frame. The memory can be written until the pass ends and is
+// reused once the GPU finished the pass, so it is only valid for draws recorded into that pass.
+struct STICK_API TransientGeometry
+{
+    void * vertices;  // vertexCount vertices with the stride of the layout
+    UInt32 * indices; // nullptr if no indices were allocated
+    UInt32 vertexCount;
+    UInt32 indexCount;
+    // shared by all transient geometry with the same layout, the draw range is given by baseVertex
+    // and firstIndex (see RenderPass::drawTransientGeometry)
+    const Mesh * mesh;
+    UInt32 baseVertex;
+    UInt32 firstIndex;
+};
+
 class STICK_API RenderPass
 {
   public:
@@ -645,6 +1188,62 @@ class STICK_API RenderPass
                           UInt32 _baseVertex,
                           VertexDrawMode _drawMode) = 0;
 
+    // draws _instanceCount instances of the mesh. Attributes with a VertexElement::divisor other
+    // than 0 are fetched per instance, starting at _baseInstance.
+    virtual void drawMeshInstanced(const Mesh * _mesh,
+                                   const Pipeline * _pipeline,
+                                   UInt32 _vertexOffset,
+                                   UInt32 _vertexCount,
+                                   UInt32 _instanceCount,
+                                   UInt32 _baseInstance,
+                                   VertexDrawMode _drawMode) = 0;
+
+    virtual void drawMeshInstanced(const Mesh * _mesh,
+                                   const Pipeline * _pipeline,
+                                   UInt32 _vertexOffset,
+                                   UInt32 _vertexCount,
+                                   UInt32 _baseVertex,
+                                   UInt32 _instanceCount,
+                                   UInt32 _baseInstance,
+                                   VertexDrawMode _drawMode) = 0;
+
+    // Submits _drawCount draws of the mesh with a single call. The draw parameters are sourced from
+    // _indirectBuffer starting at _byteOffset, _stride bytes apart (0 for tightly packed). The
+    // buffer contains DrawElementsIndirectCommands for indexed meshes and
+    // DrawArraysIndirectCommands otherwise, see IndirectDrawBuilder.
+    virtual void drawMeshIndirect(const Mesh * _mesh,
+                                  const Pipeline * _pipeline,
+                                  const StorageBuffer * _indirectBuffer,
+                                  Size _byteOffset,
+                                  UInt32 _drawCount,
+                                  UInt32 _stride,
+                                  VertexDrawMode _drawMode) = 0;
+
+    // dispatches a pipeline that uses a compute program
+    virtual void dispatch(const Pipeline * _pipeline, UInt32 _x, UInt32 _y, UInt32 _z) = 0;
+    // _barriers is a combination of BarrierFlags
+    virtual void memoryBarrier(UInt32 _barriers) = 0;
+
+    // Allocates _vertexCount vertices of the (finished, interleaved) _layout and _indexCount 32
+    // bit indices from a persistently mapped ring buffer owned by the device.
+    virtual stick::Result<TransientGeometry> allocateTransientGeometry(const VertexLayout & _layout,
+                                                                      UInt32 _vertexCount,
+                                                                      UInt32 _indexCount = 0) = 0;
+    // draws all indices (or vertices if there are none) of _geometry
+    void drawTransientGeometry(const TransientGeometry & _geometry,
+                               const Pipeline * _pipeline,
+                               VertexDrawMode _drawMode);
+
+    // draws the level of detail of an indexed mesh that selectLOD picks for its projected size
+    // (see projectedPixelsPerUnit), so that far away meshes cost less vertex work
+    void drawMeshLOD(const Mesh * _mesh,
+                     const Pipeline * _pipeline,
+                     const MeshLOD * _lods,
+                     UInt32 _lodCount,
+                     Float32 _pixelsPerUnit,
+                     Float32 _maxPixelError,
+                     VertexDrawMode _drawMode);
+
     virtual void drawCustom(ExternalDrawFunction _fn) = 0;
     virtual void setViewport(Int32 _x, Int32 _y, UInt32 _w, UInt32 _h) = 0;
     virtual void setScissor(Int32 _x, Int32 _y, UInt32 _w, UInt32 _h) = 0;
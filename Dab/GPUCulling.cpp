@@ -0,0 +1,432 @@
+#include <Dab/GPUCulling.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace dab
+{
+using namespace stick;
+
+static const UInt32 s_groupSize = 64;
+static const UInt32 s_imageGroupSize = 8;
+
+// resets the instance count of all draw commands to zero
+static const char * s_resetShader =
+    "#version 430 core \n"
+    "layout(local_size_x = 64) in; \n"
+    "layout(std140) uniform ResetParams \n"
+    "{ \n"
+    "   int drawCount; \n"
+    "   int commandStride; \n"
+    "}; \n"
+    "layout(std430) buffer DrawCommands \n"
+    "{ \n"
+    "   uint drawWords[]; \n"
+    "}; \n"
+    "void main() \n"
+    "{ \n"
+    "   uint idx = gl_GlobalInvocationID.x; \n"
+    "   if (idx >= uint(drawCount)) \n"
+    "       return; \n"
+    "   drawWords[idx * uint(commandStride) + 1u] = 0u; \n"
+    "} \n";
+
+// tests each instance against the frustum and optionally the depth pyramid and appends the
+// survivors to the visible range of their draw command. The instance count is the second word and
+// the base instance the last word of both, indexed and non-indexed commands.
+static const char * s_cullShader =
+    "#version 430 core \n"
+    "layout(local_size_x = 64) in; \n"
+    "layout(std140) uniform CullParams \n"
+    "{ \n"
+    "   mat4 viewProjection; \n"
+    "   vec4 plane0; \n"
+    "   vec4 plane1; \n"
+    "   vec4 plane2; \n"
+    "   vec4 plane3; \n"
+    "   vec4 plane4; \n"
+    "   vec4 plane5; \n"
+    "   vec2 pyramidSize; \n"
+    "   int instanceCount; \n"
+    "   int commandStride; \n"
+    "   int occlusionCulling; \n"
+    "}; \n"
+    "struct Instance \n"
+    "{ \n"
+    "   vec4 sphere; \n"
+    "   uint drawIndex; \n"
+    "   uint transformIndex; \n"
+    "   uint padding0; \n"
+    "   uint padding1; \n"
+    "}; \n"
+    "layout(std430) readonly buffer Instances \n"
+    "{ \n"
+    "   Instance instances[]; \n"
+    "}; \n"
+    "layout(std430) readonly buffer Transforms \n"
+    "{ \n"
+    "   mat4 transforms[]; \n"
+    "}; \n"
+    "layout(std430) buffer DrawCommands \n"
+    "{ \n"
+    "   uint drawWords[]; \n"
+    "}; \n"
+    "layout(std430) writeonly buffer VisibleInstances \n"
+    "{ \n"
+    "   uint visibleInstances[]; \n"
+    "}; \n"
+    "uniform sampler2D depthPyramid; \n"
+    "bool isOccluded(vec3 _center, float _radius) \n"
+    "{ \n"
+    "   vec2 minUV = vec2(1.0); \n"
+    "   vec2 maxUV = vec2(0.0); \n"
+    "   float minDepth = 1.0; \n"
+    "   for (int i = 0; i < 8; ++i) \n"
+    "   { \n"
+    "       vec3 dir = vec3((i & 1) != 0 ? 1.0 : -1.0, \n"
+    "                       (i & 2) != 0 ? 1.0 : -1.0, \n"
+    "                       (i & 4) != 0 ? 1.0 : -1.0); \n"
+    "       vec4 clip = viewProjection * vec4(_center + dir * _radius, 1.0); \n"
+    "       // the bounds intersect the near plane, can't be tested \n"
+    "       if (clip.w <= 0.0) \n"
+    "           return false; \n"
+    "       vec3 ndc = clip.xyz / clip.w; \n"
+    "       minUV = min(minUV, ndc.xy * 0.5 + 0.5); \n"
+    "       maxUV = max(maxUV, ndc.xy * 0.5 + 0.5); \n"
+    "       minDepth = min(minDepth, ndc.z * 0.5 + 0.5); \n"
+    "   } \n"
+    "   minUV = clamp(minUV, 0.0, 1.0); \n"
+    "   maxUV = clamp(maxUV, 0.0, 1.0); \n"
+    "   vec2 extent = (maxUV - minUV) * pyramidSize; \n"
+    "   // pick the level at which the bounds touch at most 2x2 texels \n"
+    "   float level = ceil(log2(max(max(extent.x, extent.y), 1.0))); \n"
+    "   float d0 = textureLod(depthPyramid, minUV, level).r; \n"
+    "   float d1 = textureLod(depthPyramid, vec2(maxUV.x, minUV.y), level).r; \n"
+    "   float d2 = textureLod(depthPyramid, vec2(minUV.x, maxUV.y), level).r; \n"
+    "   float d3 = textureLod(depthPyramid, maxUV, level).r; \n"
+    "   return minDepth > max(max(d0, d1), max(d2, d3)); \n"
+    "} \n"
+    "void main() \n"
+    "{ \n"
+    "   uint idx = gl_GlobalInvocationID.x; \n"
+    "   if (idx >= uint(instanceCount)) \n"
+    "       return; \n"
+    "   Instance inst = instances[idx]; \n"
+    "   mat4 m = transforms[inst.transformIndex]; \n"
+    "   vec3 center = (m * vec4(inst.sphere.xyz, 1.0)).xyz; \n"
+    "   float scale = max(max(length(m[0].xyz), length(m[1].xyz)), length(m[2].xyz)); \n"
+    "   float radius = inst.sphere.w * scale; \n"
+    "   vec4 planes[6] = vec4[6](plane0, plane1, plane2, plane3, plane4, plane5); \n"
+    "   for (int i = 0; i < 6; ++i) \n"
+    "   { \n"
+    "       if (dot(planes[i].xyz, center) + planes[i].w < -radius) \n"
+    "           return; \n"
+    "   } \n"
+    "   if (occlusionCulling != 0 && isOccluded(center, radius)) \n"
+    "       return; \n"
+    "   uint cmd = inst.drawIndex * uint(commandStride); \n"
+    "   uint slot = atomicAdd(drawWords[cmd + 1u], 1u); \n"
+    "   visibleInstances[drawWords[cmd + uint(commandStride) - 1u] + slot] = idx; \n"
+    "} \n";
+
+// copies the depth target to the base level of the pyramid
+static const char * s_depthCopyShader =
+    "#version 430 core \n"
+    "layout(local_size_x = 8, local_size_y = 8) in; \n"
+    "uniform sampler2D depthTexture; \n"
+    "layout(r32f) writeonly uniform image2D pyramidLevel; \n"
+    "void main() \n"
+    "{ \n"
+    "   ivec2 pos = ivec2(gl_GlobalInvocationID.xy); \n"
+    "   if (any(greaterThanEqual(pos, imageSize(pyramidLevel)))) \n"
+    "       return; \n"
+    "   imageStore(pyramidLevel, pos, vec4(texelFetch(depthTexture, pos, 0).r)); \n"
+    "} \n";
+
+// builds a pyramid level from the max depth of the level above it
+static const char * s_depthReduceShader =
+    "#version 430 core \n"
+    "layout(local_size_x = 8, local_size_y = 8) in; \n"
+    "layout(r32f) readonly uniform image2D sourceLevel; \n"
+    "layout(r32f) writeonly uniform image2D pyramidLevel; \n"
+    "float load(ivec2 _pos, ivec2 _last) \n"
+    "{ \n"
+    "   return imageLoad(sourceLevel, min(_pos, _last)).r; \n"
+    "} \n"
+    "void main() \n"
+    "{ \n"
+    "   ivec2 pos = ivec2(gl_GlobalInvocationID.xy); \n"
+    "   ivec2 size = imageSize(pyramidLevel); \n"
+    "   if (any(greaterThanEqual(pos, size))) \n"
+    "       return; \n"
+    "   ivec2 srcSize = imageSize(sourceLevel); \n"
+    "   ivec2 last = srcSize - 1; \n"
+    "   ivec2 src = pos * 2; \n"
+    "   float d = max(max(load(src, last), load(src + ivec2(1, 0), last)), \n"
+    "                 max(load(src + ivec2(0, 1), last), load(src + ivec2(1, 1), last))); \n"
+    "   // fold the extra row/column of odd sized levels into the last texel \n"
+    "   bool bExtraX = (srcSize.x & 1) != 0 && pos.x == size.x - 1; \n"
+    "   bool bExtraY = (srcSize.y & 1) != 0 && pos.y == size.y - 1; \n"
+    "   if (bExtraX) \n"
+    "       d = max(d, max(load(src + ivec2(2, 0), last), load(src + ivec2(2, 1), last))); \n"
+    "   if (bExtraY) \n"
+    "       d = max(d, max(load(src + ivec2(0, 2), last), load(src + ivec2(1, 2), last))); \n"
+    "   if (bExtraX && bExtraY) \n"
+    "       d = max(d, load(src + ivec2(2, 2), last)); \n"
+    "   imageStore(pyramidLevel, pos, vec4(d)); \n"
+    "} \n";
+
+static UInt32 groupCount(UInt32 _count, UInt32 _groupSize)
+{
+    return (_count + _groupSize - 1) / _groupSize;
+}
+
+static Result<Pipeline *> createComputePipeline(RenderDevice * _device, Program * _program)
+{
+    PipelineSettings settings(_program);
+    return _device->createPipeline(settings);
+}
+
+GPUCullingInput::GPUCullingInput() :
+    instances(nullptr),
+    instanceCount(0),
+    transforms(nullptr),
+    drawCommands(nullptr),
+    drawCount(0),
+    bIndexed(true),
+    visibleInstances(nullptr),
+    viewProjection(nullptr),
+    bOcclusionCulling(false)
+{
+}
+
+GPUCulling::GPUCulling() :
+    m_device(nullptr),
+    m_resetProgram(nullptr),
+    m_cullProgram(nullptr),
+    m_depthCopyProgram(nullptr),
+    m_depthReduceProgram(nullptr),
+    m_resetPipeline(nullptr),
+    m_cullPipeline(nullptr),
+    m_depthCopyPipeline(nullptr),
+    m_depthSampler(nullptr),
+    m_pyramidSampler(nullptr),
+    m_depthPyramid(nullptr),
+    m_pyramidWidth(0),
+    m_pyramidHeight(0),
+    m_pyramidLevelCount(0)
+{
+}
+
+GPUCulling::~GPUCulling()
+{
+    deallocate();
+}
+
+Error GPUCulling::init(RenderDevice * _device)
+{
+    deallocate();
+    m_device = _device;
+
+    const char * sources[] = {
+        s_resetShader, s_cullShader, s_depthCopyShader, s_depthReduceShader
+    };
+    Program ** programs[] = {
+        &m_resetProgram, &m_cullProgram, &m_depthCopyProgram, &m_depthReduceProgram
+    };
+    for (Size i = 0; i < 4; ++i)
+    {
+        auto res = m_device->createComputeProgram(sources[i]);
+        if (!res)
+            return res.error();
+        *programs[i] = res.get();
+    }
+
+    Program * pipelinePrograms[] = { m_resetProgram, m_cullProgram, m_depthCopyProgram };
+    Pipeline ** pipelines[] = { &m_resetPipeline, &m_cullPipeline, &m_depthCopyPipeline };
+    for (Size i = 0; i < 3; ++i)
+    {
+        auto res = createComputePipeline(m_device, pipelinePrograms[i]);
+        if (!res)
+            return res.error();
+        *pipelines[i] = res.get();
+    }
+
+    SamplerSettings depthSamplerSettings;
+    depthSamplerSettings.filtering = TextureFiltering::Nearest;
+    auto sres = m_device->createSampler(depthSamplerSettings);
+    if (!sres)
+        return sres.error();
+    m_depthSampler = sres.get();
+
+    // the pyramid is sampled at explicit levels without filtering
+    SamplerSettings pyramidSamplerSettings;
+    pyramidSamplerSettings.filtering = TextureFiltering::Nearest;
+    pyramidSamplerSettings.mipMapping = true;
+    sres = m_device->createSampler(pyramidSamplerSettings);
+    if (!sres)
+        return sres.error();
+    m_pyramidSampler = sres.get();
+
+    auto tres = m_device->createTexture();
+    if (!tres)
+        return tres.error();
+    m_depthPyramid = tres.get();
+
+    return Error();
+}
+
+void GPUCulling::deallocate()
+{
+    if (!m_device)
+        return;
+
+    for (Pipeline * pipe : m_depthReducePipelines)
+        m_device->destroyPipeline(pipe);
+    m_depthReducePipelines.clear();
+
+    if (m_resetPipeline)
+        m_device->destroyPipeline(m_resetPipeline);
+    if (m_cullPipeline)
+        m_device->destroyPipeline(m_cullPipeline);
+    if (m_depthCopyPipeline)
+        m_device->destroyPipeline(m_depthCopyPipeline);
+    if (m_resetProgram)
+        m_device->destroyProgram(m_resetProgram);
+    if (m_cullProgram)
+        m_device->destroyProgram(m_cullProgram);
+    if (m_depthCopyProgram)
+        m_device->destroyProgram(m_depthCopyProgram);
+    if (m_depthReduceProgram)
+        m_device->destroyProgram(m_depthReduceProgram);
+    if (m_depthSampler)
+        m_device->destroySampler(m_depthSampler);
+    if (m_pyramidSampler)
+        m_device->destroySampler(m_pyramidSampler);
+    if (m_depthPyramid)
+        m_device->destroyTexture(m_depthPyramid);
+
+    m_resetPipeline = m_cullPipeline = m_depthCopyPipeline = nullptr;
+    m_resetProgram = m_cullProgram = m_depthCopyProgram = m_depthReduceProgram = nullptr;
+    m_depthSampler = m_pyramidSampler = nullptr;
+    m_depthPyramid = nullptr;
+    m_pyramidWidth = m_pyramidHeight = m_pyramidLevelCount = 0;
+    m_device = nullptr;
+}
+
+Error GPUCulling::buildDepthPyramid(RenderPass * _pass, RenderBuffer * _depthSource)
+{
+    STICK_ASSERT(m_device);
+    Texture * depth = _depthSource->depthStencilTarget();
+    if (!depth)
+        return Error(ec::InvalidOperation,
+                     "The render buffer has no depth target to build the pyramid from",
+                     STICK_FILE,
+                     STICK_LINE);
+
+    UInt32 w = _depthSource->width();
+    UInt32 h = _depthSource->height();
+    if (w != m_pyramidWidth || h != m_pyramidHeight)
+    {
+        UInt32 levelCount = 1;
+        while ((std::max(w, h) >> levelCount) > 0)
+            ++levelCount;
+
+        m_depthPyramid->loadPixels(
+            w, h, 1, nullptr, DataType::Float32, TextureFormat::R32F, 4, levelCount);
+        m_pyramidWidth = w;
+        m_pyramidHeight = h;
+        m_pyramidLevelCount = levelCount;
+
+        while (m_depthReducePipelines.count() < levelCount - 1)
+        {
+            auto res = createComputePipeline(m_device, m_depthReduceProgram);
+            if (!res)
+                return res.error();
+            m_depthReducePipelines.append(res.get());
+        }
+        m_cullPipeline->texture("depthPyramid")->set(m_depthPyramid, m_pyramidSampler);
+    }
+
+    m_depthCopyPipeline->texture("depthTexture")->set(depth, m_depthSampler);
+    m_depthCopyPipeline->image("pyramidLevel")->set(m_depthPyramid, 0, ImageAccess::Write);
+    _pass->dispatch(m_depthCopyPipeline,
+                    groupCount(w, s_imageGroupSize),
+                    groupCount(h, s_imageGroupSize),
+                    1);
+
+    for (UInt32 level = 1; level < m_pyramidLevelCount; ++level)
+    {
+        _pass->memoryBarrier(BarrierImageAccess);
+        Pipeline * pipe = m_depthReducePipelines[level - 1];
+        pipe->image("sourceLevel")->set(m_depthPyramid, level - 1, ImageAccess::Read);
+        pipe->image("pyramidLevel")->set(m_depthPyramid, level, ImageAccess::Write);
+        _pass->dispatch(pipe,
+                        groupCount(std::max(w >> level, (UInt32)1), s_imageGroupSize),
+                        groupCount(std::max(h >> level, (UInt32)1), s_imageGroupSize),
+                        1);
+    }
+    _pass->memoryBarrier(BarrierTextureFetch);
+
+    return Error();
+}
+
+void GPUCulling::cull(RenderPass * _pass, const GPUCullingInput & _input)
+{
+    STICK_ASSERT(m_device);
+    STICK_ASSERT(_input.viewProjection);
+
+    Int32 commandStride =
+        (_input.bIndexed ? sizeof(DrawElementsIndirectCommand) : sizeof(DrawArraysIndirectCommand)) /
+        sizeof(UInt32);
+
+    m_resetPipeline->variable("drawCount")->setInt32(_input.drawCount);
+    m_resetPipeline->variable("commandStride")->setInt32(commandStride);
+    m_resetPipeline->buffer("DrawCommands")->set(_input.drawCommands);
+    _pass->dispatch(m_resetPipeline, groupCount(_input.drawCount, s_groupSize), 1, 1);
+    _pass->memoryBarrier(BarrierStorageBuffers);
+
+    // extract the frustum planes from the column major view projection matrix
+    const Float32 * m = _input.viewProjection;
+    const char * planeNames[] = { "plane0", "plane1", "plane2", "plane3", "plane4", "plane5" };
+    for (Size i = 0; i < 6; ++i)
+    {
+        Size row = i / 2;
+        Float32 sign = i % 2 == 0 ? 1.0f : -1.0f;
+        Float32 plane[4];
+        for (Size col = 0; col < 4; ++col)
+            plane[col] = m[col * 4 + 3] + sign * m[col * 4 + row];
+
+        Float32 len = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        m_cullPipeline->variable(planeNames[i])
+            ->setVec4f(plane[0] / len, plane[1] / len, plane[2] / len, plane[3] / len);
+    }
+
+    bool bOcclusionCulling = _input.bOcclusionCulling && m_pyramidLevelCount;
+    m_cullPipeline->variable("viewProjection")->setMat4f(const_cast<Float32 *>(m));
+    m_cullPipeline->variable("pyramidSize")->setVec2f(m_pyramidWidth, m_pyramidHeight);
+    m_cullPipeline->variable("instanceCount")->setInt32(_input.instanceCount);
+    m_cullPipeline->variable("commandStride")->setInt32(commandStride);
+    m_cullPipeline->variable("occlusionCulling")->setInt32(bOcclusionCulling);
+    m_cullPipeline->buffer("Instances")->set(_input.instances);
+    m_cullPipeline->buffer("Transforms")->set(_input.transforms);
+    m_cullPipeline->buffer("DrawCommands")->set(_input.drawCommands);
+    m_cullPipeline->buffer("VisibleInstances")->set(_input.visibleInstances);
+    _pass->dispatch(m_cullPipeline, groupCount(_input.instanceCount, s_groupSize), 1, 1);
+
+    // make the results visible to the indirect draws and the vertex shaders that read the
+    // visible instances
+    _pass->memoryBarrier(BarrierIndirectCommands | BarrierStorageBuffers);
+}
+
+Texture * GPUCulling::depthPyramid() const
+{
+    return m_depthPyramid;
+}
+
+UInt32 GPUCulling::depthPyramidLevelCount() const
+{
+    return m_pyramidLevelCount;
+}
+
+} // namespace dab
@@ -0,0 +1,85 @@
+#ifndef DAB_GPUCULLING_HPP
+#define DAB_GPUCULLING_HPP
+
+#include <Dab/Dab.hpp>
+
+namespace dab
+{
+
+// std430 layout of one element of GPUCullingInput::instances
+struct STICK_API CullingInstance
+{
+    Float32 center[3]; // bounding sphere in object space
+    Float32 radius;
+    UInt32 drawIndex;      // the indirect draw command the instance is drawn with
+    UInt32 transformIndex; // index into GPUCullingInput::transforms
+    UInt32 padding[2];
+};
+
+struct STICK_API GPUCullingInput
+{
+    GPUCullingInput();
+
+    const StorageBuffer * instances; // array of CullingInstance
+    UInt32 instanceCount;
+    const StorageBuffer * transforms; // array of column major object to world matrices
+    // Indirect draw commands as built by IndirectDrawBuilder. The instance counts are overwritten
+    // with the number of visible instances. The baseInstance of each command marks the start of
+    // its range in visibleInstances, which needs to be big enough to hold all instances that
+    // reference the command.
+    StorageBuffer * drawCommands;
+    UInt32 drawCount;
+    bool bIndexed; // if drawCommands contains DrawElementsIndirectCommands
+    // Receives the indices of the visible instances. Vertex shaders look them up with
+    // gl_BaseInstance + gl_InstanceID.
+    StorageBuffer * visibleInstances;
+    const Float32 * viewProjection; // column major world to clip space matrix
+    bool bOcclusionCulling; // test against the depth pyramid built by buildDepthPyramid
+};
+
+// Compute based culling of large amounts of instances. The culling writes its results to the
+// indirect draw commands on the GPU, so they can be consumed with RenderPass::drawMeshIndirect in
+// the same frame without any CPU readback.
+class STICK_API GPUCulling
+{
+  public:
+    GPUCulling();
+    ~GPUCulling();
+
+    stick::Error init(RenderDevice * _device);
+    void deallocate();
+
+    // Records the build of a max depth pyramid from the depth target of _depthSource into _pass
+    // (usually the depth of the previous frame or a depth pre-pass). Only one pyramid can be built
+    // per pass.
+    stick::Error buildDepthPyramid(RenderPass * _pass, RenderBuffer * _depthSource);
+
+    // Records the culling into _pass. The draw commands can be used right after. Only one cull can
+    // be recorded per pass.
+    void cull(RenderPass * _pass, const GPUCullingInput & _input);
+
+    Texture * depthPyramid() const;
+    UInt32 depthPyramidLevelCount() const;
+
+  private:
+    RenderDevice * m_device;
+    Program * m_resetProgram;
+    Program * m_cullProgram;
+    Program * m_depthCopyProgram;
+    Program * m_depthReduceProgram;
+    Pipeline * m_resetPipeline;
+    Pipeline * m_cullPipeline;
+    Pipeline * m_depthCopyPipeline;
+    // the image bindings of a pipeline can't change within a pass, hence one pipeline per level
+    stick::DynamicArray<Pipeline *> m_depthReducePipelines;
+    Sampler * m_depthSampler;
+    Sampler * m_pyramidSampler;
+    Texture * m_depthPyramid;
+    UInt32 m_pyramidWidth;
+    UInt32 m_pyramidHeight;
+    UInt32 m_pyramidLevelCount;
+};
+
+} // namespace dab
+
+#endif // DAB_GPUCULLING_HPP
@@ -0,0 +1,460 @@
+#include <Dab/GeometryFile.hpp>
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dab
+{
+using namespace stick;
+
+static const char s_magic[4] = { 'D', 'A', 'B', 'G' };
+
+static Size alignUp(Size _value, Size _alignment)
+{
+    return (_value + _alignment - 1) / _alignment * _alignment;
+}
+
+GeometryFile::GeometryFile(Allocator & _alloc) :
+    m_alloc(&_alloc),
+    m_data(nullptr),
+    m_byteCount(0),
+    m_fileHandle(nullptr),
+    m_mappingHandle(nullptr),
+    m_header(nullptr),
+    m_layouts(_alloc),
+    m_buffers(_alloc),
+    m_vertexBuffers(_alloc),
+    m_indexBuffer(nullptr),
+    m_queue(nullptr),
+    m_chunkByteCount(0),
+    m_pendingChunks(_alloc)
+{
+}
+
+GeometryFile::~GeometryFile()
+{
+    close();
+}
+
+Error GeometryFile::open(const char * _path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(_path,
+                              GENERIC_READ,
+                              FILE_SHARE_READ,
+                              nullptr,
+                              OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN,
+                              nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return Error(
+            ec::InvalidOperation, "Could not open the geometry file", STICK_FILE, STICK_LINE);
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+    {
+        CloseHandle(file);
+        return Error(
+            ec::InvalidOperation, "Could not map the geometry file", STICK_FILE, STICK_LINE);
+    }
+    m_data = static_cast<const UInt8 *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    m_byteCount = (Size)size.QuadPart;
+    m_fileHandle = file;
+    m_mappingHandle = mapping;
+#else
+    int fd = ::open(_path, O_RDONLY);
+    if (fd < 0)
+        return Error(
+            ec::InvalidOperation, "Could not open the geometry file", STICK_FILE, STICK_LINE);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return Error(
+            ec::InvalidOperation, "Could not stat the geometry file", STICK_FILE, STICK_LINE);
+    }
+    void * ptr = mmap(nullptr, (Size)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive
+    ::close(fd);
+    if (ptr == MAP_FAILED)
+        return Error(
+            ec::InvalidOperation, "Could not map the geometry file", STICK_FILE, STICK_LINE);
+    // the data is read front to back once while uploading
+    madvise(ptr, (Size)st.st_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const UInt8 *>(ptr);
+    m_byteCount = (Size)st.st_size;
+#endif
+
+    if (!m_data)
+    {
+        close();
+        return Error(
+            ec::InvalidOperation, "Could not map the geometry file", STICK_FILE, STICK_LINE);
+    }
+
+    // validate everything up front, so the accessors don't have to
+    auto fail = [this](const char * _msg) {
+        close();
+        return Error(ec::InvalidOperation, _msg, STICK_FILE, STICK_LINE);
+    };
+
+    if (m_byteCount < sizeof(GeometryFileHeader))
+        return fail("The geometry file is truncated");
+    m_header = reinterpret_cast<const GeometryFileHeader *>(m_data);
+    if (std::memcmp(m_header->magic, s_magic, sizeof(s_magic)) != 0)
+        return fail("Not a geometry file");
+    if (m_header->version != s_version)
+        return fail("Unsupported geometry file version");
+
+    Size pos = sizeof(GeometryFileHeader);
+    if (m_header->bufferCount > (m_byteCount - pos) / sizeof(GeometryFileBuffer))
+        return fail("The geometry file is truncated");
+    const GeometryFileBuffer * buffers = reinterpret_cast<const GeometryFileBuffer *>(m_data + pos);
+    pos += sizeof(GeometryFileBuffer) * m_header->bufferCount;
+
+    // the device binds at most 16 vertex elements, each at its own location
+    UInt32 locations = 0;
+    for (UInt32 i = 0; i < m_header->bufferCount; ++i)
+    {
+        const GeometryFileBuffer & buff = buffers[i];
+        if (buff.byteCount > m_byteCount || buff.byteOffset > m_byteCount - buff.byteCount ||
+            buff.elementCount > (m_byteCount - pos) / sizeof(GeometryFileElement))
+            return fail("The geometry file is truncated");
+
+        VertexElementArray elements(*m_alloc);
+        const GeometryFileElement * fileElements =
+            reinterpret_cast<const GeometryFileElement *>(m_data + pos);
+        for (UInt32 j = 0; j < buff.elementCount; ++j)
+        {
+            const GeometryFileElement & el = fileElements[j];
+            if (el.dataType >= (UInt32)DataType::Count)
+                return fail("Invalid vertex element data type");
+            if (el.elementCount < 1 || el.elementCount > 4)
+                return fail("Invalid vertex element count");
+            if (el.location >= 16 || (locations & (1u << el.location)))
+                return fail("Invalid vertex element location");
+            locations |= 1u << el.location;
+            elements.append({ (DataType)el.dataType,
+                              el.elementCount,
+                              el.offset,
+                              el.stride,
+                              el.location,
+                              el.divisor,
+                              (el.flags & GeometryFileElementNormalized) != 0,
+                              (el.flags & GeometryFileElementInteger) != 0 });
+        }
+        pos += sizeof(GeometryFileElement) * buff.elementCount;
+
+        // keep the offsets, strides and locations the file was written with
+        m_layouts.append(VertexLayout(std::move(elements), VertexPacking::Explicit));
+        m_buffers.append(&buff);
+    }
+
+    if (m_header->indexByteCount > m_byteCount ||
+        m_header->indexByteOffset > m_byteCount - m_header->indexByteCount ||
+        (m_header->indexSize != 0 && m_header->indexSize != 1 && m_header->indexSize != 2 &&
+         m_header->indexSize != 4))
+        return fail("Invalid index data");
+
+    return Error();
+}
+
+void GeometryFile::close()
+{
+#ifdef _WIN32
+    // the handles are valid even if mapping the view failed
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mappingHandle)
+        CloseHandle(static_cast<HANDLE>(m_mappingHandle));
+    if (m_fileHandle)
+        CloseHandle(static_cast<HANDLE>(m_fileHandle));
+#else
+    if (m_data)
+        munmap(const_cast<UInt8 *>(m_data), m_byteCount);
+#endif
+    m_data = nullptr;
+    m_byteCount = 0;
+    m_fileHandle = nullptr;
+    m_mappingHandle = nullptr;
+    m_header = nullptr;
+    m_layouts.clear();
+    m_buffers.clear();
+    m_pendingChunks.clear();
+}
+
+Size GeometryFile::bufferCount() const
+{
+    return m_buffers.count();
+}
+
+const VertexLayout & GeometryFile::layout(Size _buffer) const
+{
+    return m_layouts[_buffer];
+}
+
+const void * GeometryFile::vertexData(Size _buffer) const
+{
+    return m_data + m_buffers[_buffer]->byteOffset;
+}
+
+Size GeometryFile::vertexByteCount(Size _buffer) const
+{
+    return m_buffers[_buffer]->byteCount;
+}
+
+const void * GeometryFile::indexData() const
+{
+    return m_header->indexSize ? m_data + m_header->indexByteOffset : nullptr;
+}
+
+Size GeometryFile::indexByteCount() const
+{
+    return m_header->indexByteCount;
+}
+
+DataType GeometryFile::indexType() const
+{
+    if (m_header->indexSize == 1)
+        return DataType::UInt8;
+    if (m_header->indexSize == 2)
+        return DataType::UInt16;
+    return DataType::UInt32;
+}
+
+UInt32 GeometryFile::indexCount() const
+{
+    return m_header->indexSize ? (UInt32)(m_header->indexByteCount / m_header->indexSize) : 0;
+}
+
+Result<Mesh *> GeometryFile::createMesh(RenderDevice * _device,
+                                        UploadQueue * _queue,
+                                        Size _chunkByteCount,
+                                        BufferUsageFlags _usage)
+{
+    STICK_ASSERT(m_data);
+    if (_queue)
+    {
+        // these would fail on every continueUpload, so catch them before creating anything
+        if (_usage & (BufferUsageDynamic | BufferUsageStream | BufferUsageDeduplicate))
+            return Error(ec::InvalidOperation,
+                         "Uploads through a queue need static buffers without deduplication",
+                         STICK_FILE,
+                         STICK_LINE);
+        if (!_chunkByteCount || _chunkByteCount > _queue->stagingByteCount())
+            return Error(ec::InvalidOperation,
+                         "The chunk size has to be between 1 and the staging buffer size",
+                         STICK_FILE,
+                         STICK_LINE);
+    }
+
+    m_vertexBuffers.clear();
+    m_indexBuffer = nullptr;
+    m_pendingChunks.clear();
+    m_queue = _queue;
+    m_chunkByteCount = _chunkByteCount;
+
+    for (Size i = 0; i < m_buffers.count(); ++i)
+    {
+        auto res = _device->createVertexBuffer(_usage);
+        if (!res)
+        {
+            destroyBuffers(_device);
+            return res.error();
+        }
+        VertexBuffer * vb = res.get();
+        m_vertexBuffers.append(vb);
+        // without a queue this is the only copy of the data before it reaches the driver
+        vb->loadDataRaw(_queue ? nullptr : vertexData(i), vertexByteCount(i));
+        if (_queue)
+            m_pendingChunks.append(
+                { vb, nullptr, m_data + m_buffers[i]->byteOffset, 0, vertexByteCount(i) });
+    }
+
+    if (m_header->indexSize)
+    {
+        auto res = _device->createIndexBuffer(_usage, indexType());
+        if (!res)
+        {
+            destroyBuffers(_device);
+            return res.error();
+        }
+        m_indexBuffer = res.get();
+        m_indexBuffer->loadDataRaw(_queue ? nullptr : indexData(), indexByteCount());
+        if (_queue)
+            m_pendingChunks.append({ nullptr,
+                                     m_indexBuffer,
+                                     m_data + m_header->indexByteOffset,
+                                     0,
+                                     indexByteCount() });
+    }
+
+    auto mres = _device->createMesh(
+        m_vertexBuffers.ptr(), m_layouts.ptr(), m_layouts.count(), m_indexBuffer);
+    if (!mres)
+    {
+        destroyBuffers(_device);
+        return mres.error();
+    }
+
+    if (_queue)
+    {
+        auto ures = continueUpload();
+        if (!ures)
+            return ures.error();
+    }
+    return mres.get();
+}
+
+void GeometryFile::destroyBuffers(RenderDevice * _device)
+{
+    for (VertexBuffer * vb : m_vertexBuffers)
+        _device->destroyVertexBuffer(vb);
+    if (m_indexBuffer)
+        _device->destroyIndexBuffer(m_indexBuffer);
+    m_vertexBuffers.clear();
+    m_indexBuffer = nullptr;
+    m_pendingChunks.clear();
+}
+
+Result<bool> GeometryFile::continueUpload()
+{
+    while (m_pendingChunks.count())
+    {
+        UploadChunk & chunk = m_pendingChunks[0];
+        while (chunk.byteOffset < chunk.byteCount)
+        {
+            Size count = std::min(m_chunkByteCount, chunk.byteCount - chunk.byteOffset);
+            auto res = chunk.vertexBuffer ? m_queue->enqueue(chunk.vertexBuffer,
+                                                             chunk.byteOffset,
+                                                             chunk.data + chunk.byteOffset,
+                                                             count)
+                                          : m_queue->enqueue(chunk.indexBuffer,
+                                                             chunk.byteOffset,
+                                                             chunk.data + chunk.byteOffset,
+                                                             count);
+            if (!res)
+                return res.error();
+            // the staging buffer is full, try again after the next UploadQueue::process
+            if (res.get() == s_noStagingSpace)
+                return false;
+            chunk.byteOffset += count;
+        }
+        m_pendingChunks.remove(m_pendingChunks.begin());
+    }
+    return true;
+}
+
+VertexBuffer * GeometryFile::vertexBuffer(Size _buffer) const
+{
+    return m_vertexBuffers[_buffer];
+}
+
+IndexBuffer * GeometryFile::indexBuffer() const
+{
+    return m_indexBuffer;
+}
+
+Error GeometryFile::write(const char * _path,
+                          const VertexLayout * _layouts,
+                          const void * const * _vertexData,
+                          const Size * _vertexByteCounts,
+                          Size _bufferCount,
+                          const UInt32 * _indices,
+                          UInt32 _indexCount)
+{
+    FILE * file = std::fopen(_path, "wb");
+    if (!file)
+        return Error(ec::InvalidOperation,
+                     "Could not open the geometry file for writing",
+                     STICK_FILE,
+                     STICK_LINE);
+
+    GeometryFileHeader header;
+    std::memcpy(header.magic, s_magic, sizeof(s_magic));
+    header.version = s_version;
+    header.bufferCount = (UInt32)_bufferCount;
+    // store the indices with the smallest type that fits them
+    DataType indexType = narrowestIndexType(_indices, _indices ? _indexCount : 0);
+    header.indexSize = _indices ? s_dataTypeByteCount[(Size)indexType] : 0;
+
+    // compute where the data goes
+    Size pos = sizeof(GeometryFileHeader) + sizeof(GeometryFileBuffer) * _bufferCount;
+    for (Size i = 0; i < _bufferCount; ++i)
+        pos += sizeof(GeometryFileElement) * _layouts[i].elements.count();
+    Size dataStart = pos;
+
+    DynamicArray<GeometryFileBuffer> buffers;
+    buffers.resize(_bufferCount);
+    for (Size i = 0; i < _bufferCount; ++i)
+    {
+        pos = alignUp(pos, s_dataAlignment);
+        buffers[i] = { pos, _vertexByteCounts[i], (UInt32)_layouts[i].elements.count(), 0 };
+        pos += _vertexByteCounts[i];
+    }
+    pos = alignUp(pos, s_dataAlignment);
+    header.indexByteOffset = _indices ? pos : 0;
+    header.indexByteCount = (UInt64)header.indexSize * _indexCount;
+
+    bool bSuccess = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    if (_bufferCount)
+        bSuccess &= std::fwrite(buffers.ptr(), sizeof(GeometryFileBuffer), _bufferCount, file) ==
+                    _bufferCount;
+    for (Size i = 0; i < _bufferCount && bSuccess; ++i)
+    {
+        for (const auto & el : _layouts[i].elements)
+        {
+            GeometryFileElement fel = {
+                (UInt32)el.dataType, el.elementCount, el.offset, el.stride, el.location, el.divisor,
+                (el.bNormalized ? (UInt32)GeometryFileElementNormalized : 0) |
+                    (el.bInteger ? (UInt32)GeometryFileElementInteger : 0)
+            };
+            bSuccess &= std::fwrite(&fel, sizeof(fel), 1, file) == 1;
+        }
+    }
+
+    // pads the file with zeros up to _offset and writes the data
+    Size cursor = dataStart;
+    auto writeAt = [file, &cursor](Size _offset, const void * _data, Size _byteCount) {
+        static const char s_zeros[256] = {};
+        while (cursor < _offset)
+        {
+            Size count = std::min(_offset - cursor, sizeof(s_zeros));
+            if (std::fwrite(s_zeros, 1, count, file) != count)
+                return false;
+            cursor += count;
+        }
+        cursor += _byteCount;
+        return !_byteCount || std::fwrite(_data, 1, _byteCount, file) == _byteCount;
+    };
+
+    for (Size i = 0; i < _bufferCount && bSuccess; ++i)
+        bSuccess &= writeAt(buffers[i].byteOffset, _vertexData[i], _vertexByteCounts[i]);
+    if (_indices && bSuccess)
+    {
+        DynamicArray<UInt8> narrowed;
+        narrowed.resize(header.indexByteCount);
+        narrowIndices(_indices, _indexCount, indexType, narrowed.ptr());
+        bSuccess &= writeAt(header.indexByteOffset, narrowed.ptr(), header.indexByteCount);
+    }
+
+    bSuccess &= std::fclose(file) == 0;
+    if (!bSuccess)
+        return Error(
+            ec::InvalidOperation, "Could not write the geometry file", STICK_FILE, STICK_LINE);
+    return Error();
+}
+
+} // namespace dab
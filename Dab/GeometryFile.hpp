@@ -0,0 +1,139 @@
+#ifndef DAB_GEOMETRYFILE_HPP
+#define DAB_GEOMETRYFILE_HPP
+
+#include <Dab/Dab.hpp>
+
+namespace dab
+{
+
+// Binary container for the vertex and index data of a mesh. It stores one VertexLayout per vertex
+// buffer, the index size and the raw buffer data, each buffer aligned to
+// GeometryFile::s_dataAlignment (a page) so it can be uploaded straight from the mapped file:
+//
+// GeometryFileHeader
+// GeometryFileBuffer[bufferCount]
+// GeometryFileElement[sum of all GeometryFileBuffer::elementCount]
+// vertex data of all buffers, index data
+//
+// All values are little endian.
+struct STICK_API GeometryFileHeader
+{
+    char magic[4]; // "DABG"
+    UInt32 version;
+    UInt32 bufferCount;
+    UInt32 indexSize; // byte size of one index, 0 if there are no indices
+    UInt64 indexByteOffset;
+    UInt64 indexByteCount;
+};
+
+struct STICK_API GeometryFileBuffer
+{
+    UInt64 byteOffset;
+    UInt64 byteCount;
+    UInt32 elementCount; // the number of elements of the buffer's layout
+    UInt32 padding;
+};
+
+struct STICK_API GeometryFileElement
+{
+    UInt32 dataType;
+    UInt32 elementCount;
+    UInt32 offset;
+    UInt32 stride;
+    UInt32 location;
+    UInt32 divisor;
+    UInt32 flags; // combination of GeometryFileElementFlags
+};
+
+enum STICK_API GeometryFileElementFlags
+{
+    GeometryFileElementNormalized = 1, // VertexElement::bNormalized
+    GeometryFileElementInteger = 1 << 1 // VertexElement::bInteger
+};
+
+// Memory maps a geometry file so that loading it neither parses nor copies the data on the CPU.
+// The mapping stays valid until close is called or the file is destroyed.
+class STICK_API GeometryFile
+{
+  public:
+    static const UInt32 s_version = 2;
+    static const Size s_dataAlignment = 4096;
+
+    GeometryFile(stick::Allocator & _alloc = stick::defaultAllocator());
+    ~GeometryFile();
+
+    GeometryFile(const GeometryFile &) = delete;
+    GeometryFile & operator=(const GeometryFile &) = delete;
+
+    stick::Error open(const char * _path);
+    void close();
+
+    Size bufferCount() const;
+    const VertexLayout & layout(Size _buffer) const;
+    const void * vertexData(Size _buffer) const;
+    Size vertexByteCount(Size _buffer) const;
+    const void * indexData() const;
+    Size indexByteCount() const;
+    DataType indexType() const;
+    UInt32 indexCount() const;
+
+    // Creates the vertex and index buffers and the mesh. Without _queue, the buffers are loaded
+    // directly from the mapping. With _queue, the buffers are only allocated and their data is
+    // enqueued in chunks of at most _chunkByteCount bytes, which has to fit the staging buffer, and
+    // _usage has to be static. If the staging buffer runs full, continueUpload has to be called
+    // after the next UploadQueue::process until it returns true.
+    // The mesh can be drawn once UploadQueue::isResident returns true for it.
+    // The created buffers and the mesh are owned by the caller, see vertexBuffer/indexBuffer.
+    stick::Result<Mesh *> createMesh(RenderDevice * _device,
+                                     UploadQueue * _queue = nullptr,
+                                     Size _chunkByteCount = 4 * 1024 * 1024,
+                                     BufferUsageFlags _usage = BufferUsageStatic);
+    // enqueues the remaining chunks, returns true once all of them are enqueued and false if the
+    // staging buffer is full
+    stick::Result<bool> continueUpload();
+
+    VertexBuffer * vertexBuffer(Size _buffer) const;
+    IndexBuffer * indexBuffer() const;
+
+    // writes the vertex data of _bufferCount buffers with their (finished) layouts and optional
+    // indices to a geometry file. The indices are stored with the smallest index type that fits
+    // them, see narrowestIndexType.
+    static stick::Error write(const char * _path,
+                              const VertexLayout * _layouts,
+                              const void * const * _vertexData,
+                              const Size * _vertexByteCounts,
+                              Size _bufferCount,
+                              const UInt32 * _indices,
+                              UInt32 _indexCount);
+
+  private:
+    struct UploadChunk
+    {
+        VertexBuffer * vertexBuffer;
+        IndexBuffer * indexBuffer;
+        const UInt8 * data;
+        Size byteOffset;
+        Size byteCount;
+    };
+
+    // destroys the buffers created by a createMesh call that failed
+    void destroyBuffers(RenderDevice * _device);
+
+    stick::Allocator * m_alloc;
+    const UInt8 * m_data;
+    Size m_byteCount;
+    void * m_fileHandle;    // platform specific handles of the mapping
+    void * m_mappingHandle;
+    const GeometryFileHeader * m_header;
+    stick::DynamicArray<VertexLayout> m_layouts;
+    stick::DynamicArray<const GeometryFileBuffer *> m_buffers;
+    stick::DynamicArray<VertexBuffer *> m_vertexBuffers;
+    IndexBuffer * m_indexBuffer;
+    UploadQueue * m_queue;
+    Size m_chunkByteCount;
+    stick::DynamicArray<UploadChunk> m_pendingChunks;
+};
+
+} // namespace dab
+
+#endif // DAB_GEOMETRYFILE_HPP
@@ -0,0 +1,802 @@
+#include <Dab/MeshOptimizer.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace dab
+{
+using namespace stick;
+
+// vertex cache size and score parameters of the Forsyth optimization, see
+// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+static const UInt32 s_forsythCacheSize = 32;
+static const Float32 s_cacheDecayPower = 1.5f;
+static const Float32 s_lastTriangleScore = 0.75f;
+static const Float32 s_valenceBoostScale = 2.0f;
+static const Float32 s_valenceBoostPower = 0.5f;
+// the valence boost is tabulated up to this many remaining triangles
+static const UInt32 s_maxValence = 32;
+
+namespace
+{
+struct ForsythScores
+{
+    ForsythScores()
+    {
+        for (UInt32 i = 0; i < s_forsythCacheSize; ++i)
+        {
+            if (i < 3)
+                cache[i] = s_lastTriangleScore;
+            else
+            {
+                Float32 s = 1.0f - (Float32)(i - 3) / (Float32)(s_forsythCacheSize - 3);
+                cache[i] = std::pow(s, s_cacheDecayPower);
+            }
+        }
+        valence[0] = 0.0f;
+        for (UInt32 i = 1; i <= s_maxValence; ++i)
+            valence[i] = s_valenceBoostScale * std::pow((Float32)i, -s_valenceBoostPower);
+    }
+
+    Float32 score(Int32 _cachePosition, UInt32 _valence) const
+    {
+        // vertices without triangles left don't matter anymore
+        if (!_valence)
+            return -1.0f;
+        Float32 ret = _cachePosition >= 0 ? cache[_cachePosition] : 0.0f;
+        return ret + valence[std::min(_valence, s_maxValence)];
+    }
+
+    Float32 cache[s_forsythCacheSize];
+    Float32 valence[s_maxValence + 1];
+};
+} // namespace
+
+void optimizeVertexCache(UInt32 * _dst,
+                         const UInt32 * _indices,
+                         Size _indexCount,
+                         Size _vertexCount,
+                         Allocator & _alloc)
+{
+    STICK_ASSERT(_indexCount % 3 == 0);
+    static const ForsythScores s_scores;
+
+    Size triangleCount = _indexCount / 3;
+    if (!triangleCount)
+        return;
+
+    // copy the input, _dst may be the same as _indices
+    DynamicArray<UInt32> indices(_alloc);
+    indices.resize(_indexCount);
+    std::memcpy(indices.ptr(), _indices, _indexCount * sizeof(UInt32));
+
+    // the triangles of each vertex, the first valence[v] entries are the ones not emitted yet
+    DynamicArray<UInt32> valence(_alloc);
+    valence.resize(_vertexCount);
+    std::fill(valence.begin(), valence.end(), 0);
+    for (Size i = 0; i < _indexCount; ++i)
+    {
+        STICK_ASSERT(indices[i] < _vertexCount);
+        valence[indices[i]]++;
+    }
+
+    DynamicArray<UInt32> triangleOffsets(_alloc);
+    triangleOffsets.resize(_vertexCount);
+    UInt32 offset = 0;
+    for (Size i = 0; i < _vertexCount; ++i)
+    {
+        triangleOffsets[i] = offset;
+        offset += valence[i];
+    }
+
+    DynamicArray<UInt32> vertexTriangles(_alloc);
+    vertexTriangles.resize(_indexCount);
+    DynamicArray<UInt32> fill(_alloc);
+    fill.resize(_vertexCount);
+    std::fill(fill.begin(), fill.end(), 0);
+    for (Size i = 0; i < _indexCount; ++i)
+    {
+        UInt32 v = indices[i];
+        vertexTriangles[triangleOffsets[v] + fill[v]++] = (UInt32)(i / 3);
+    }
+
+    DynamicArray<Int32> cachePositions(_alloc);
+    cachePositions.resize(_vertexCount);
+    std::fill(cachePositions.begin(), cachePositions.end(), -1);
+
+    DynamicArray<Float32> vertexScores(_alloc);
+    vertexScores.resize(_vertexCount);
+    for (Size i = 0; i < _vertexCount; ++i)
+        vertexScores[i] = s_scores.score(-1, valence[i]);
+
+    DynamicArray<UInt8> emitted(_alloc);
+    emitted.resize(triangleCount);
+    std::fill(emitted.begin(), emitted.end(), 0);
+
+    // the cache holds up to three more entries while the new triangle is pushed in
+    UInt32 cache[s_forsythCacheSize + 3];
+    UInt32 newCache[s_forsythCacheSize + 3];
+    UInt32 cacheCount = 0;
+
+    Size nextCandidate = 0; // scan position for when the cache has no candidate left
+    Int64 bestTriangle = -1;
+
+    for (Size emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+    {
+        if (bestTriangle < 0)
+        {
+            // no triangle is connected to the cache, continue with the next one in input order
+            while (emitted[nextCandidate])
+                ++nextCandidate;
+            bestTriangle = (Int64)nextCandidate;
+        }
+
+        UInt32 tri = (UInt32)bestTriangle;
+        const UInt32 * triVertices = &indices[tri * 3];
+        std::memcpy(_dst + emittedCount * 3, triVertices, sizeof(UInt32) * 3);
+        emitted[tri] = 1;
+
+        // remove the triangle from the pending triangles of its vertices
+        for (UInt32 i = 0; i < 3; ++i)
+        {
+            UInt32 v = triVertices[i];
+            UInt32 * triangles = &vertexTriangles[triangleOffsets[v]];
+            UInt32 * end = triangles + valence[v];
+            UInt32 * it = std::find(triangles, end, tri);
+            STICK_ASSERT(it != end);
+            *it = *(end - 1);
+            valence[v]--;
+        }
+
+        // push the triangle's vertices to the front of the cache
+        UInt32 newCount = 0;
+        for (UInt32 i = 0; i < 3; ++i)
+        {
+            UInt32 v = triVertices[i];
+            if (std::find(newCache, newCache + newCount, v) == newCache + newCount)
+                newCache[newCount++] = v;
+        }
+        for (UInt32 i = 0; i < cacheCount; ++i)
+        {
+            UInt32 v = cache[i];
+            if (std::find(newCache, newCache + newCount, v) == newCache + newCount)
+                newCache[newCount++] = v;
+        }
+
+        // update the scores of everything in the cache, including the vertices that fall out
+        for (UInt32 i = 0; i < newCount; ++i)
+        {
+            UInt32 v = newCache[i];
+            cachePositions[v] = i < s_forsythCacheSize ? (Int32)i : -1;
+            vertexScores[v] = s_scores.score(cachePositions[v], valence[v]);
+        }
+
+        // rescore the triangles touched by the cache and pick the best one as the next triangle
+        bestTriangle = -1;
+        Float32 bestScore = -1.0f;
+        for (UInt32 i = 0; i < newCount; ++i)
+        {
+            UInt32 v = newCache[i];
+            const UInt32 * triangles = &vertexTriangles[triangleOffsets[v]];
+            for (UInt32 j = 0; j < valence[v]; ++j)
+            {
+                UInt32 t = triangles[j];
+                Float32 score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] +
+                                vertexScores[indices[t * 3 + 2]];
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        cacheCount = std::min(newCount, s_forsythCacheSize);
+        std::memcpy(cache, newCache, cacheCount * sizeof(UInt32));
+    }
+}
+
+namespace
+{
+// Simulates a FIFO vertex cache. A vertex is in the cache if less than size misses happened since
+// it was added.
+class FifoCache
+{
+  public:
+    FifoCache(Size _vertexCount, UInt32 _size, Allocator & _alloc) :
+        m_timestamps(_alloc),
+        m_size(_size),
+        m_time(_size + 1)
+    {
+        m_timestamps.resize(_vertexCount);
+        std::fill(m_timestamps.begin(), m_timestamps.end(), 0);
+    }
+
+    // returns 1 if _vertex was not in the cache, 0 otherwise
+    UInt32 miss(UInt32 _vertex)
+    {
+        if (m_time - m_timestamps[_vertex] <= m_size)
+            return 0;
+        m_timestamps[_vertex] = m_time++;
+        return 1;
+    }
+
+    UInt32 triangleMisses(const UInt32 * _triangle)
+    {
+        return miss(_triangle[0]) + miss(_triangle[1]) + miss(_triangle[2]);
+    }
+
+    // empties the cache
+    void flush()
+    {
+        m_time += m_size + 1;
+    }
+
+  private:
+    DynamicArray<UInt32> m_timestamps;
+    UInt32 m_size;
+    UInt32 m_time;
+};
+} // namespace
+
+Float32 averageCacheMissRatio(const UInt32 * _indices,
+                              Size _indexCount,
+                              Size _vertexCount,
+                              UInt32 _cacheSize,
+                              Allocator & _alloc)
+{
+    if (_indexCount < 3)
+        return 0.0f;
+
+    FifoCache cache(_vertexCount, _cacheSize, _alloc);
+    Size misses = 0;
+    for (Size i = 0; i + 3 <= _indexCount; i += 3)
+        misses += cache.triangleMisses(_indices + i);
+    return (Float32)misses / (Float32)(_indexCount / 3);
+}
+
+void optimizeOverdraw(UInt32 * _dst,
+                      const UInt32 * _indices,
+                      Size _indexCount,
+                      const Float32 * _positions,
+                      Size _vertexCount,
+                      Size _positionStride,
+                      Float32 _threshold,
+                      Allocator & _alloc)
+{
+    STICK_ASSERT(_indexCount % 3 == 0);
+    STICK_ASSERT(_dst != _indices);
+
+    Size triangleCount = _indexCount / 3;
+    if (!triangleCount)
+        return;
+
+    // The cache misses of each triangle. A triangle that misses all three vertices starts with a
+    // cold cache, so the order of the clusters between two of them does not affect the cache.
+    FifoCache cache(_vertexCount, 16, _alloc);
+    DynamicArray<UInt8> triangleMisses(_alloc);
+    triangleMisses.resize(triangleCount);
+    for (Size i = 0; i < triangleCount; ++i)
+        triangleMisses[i] = (UInt8)cache.triangleMisses(_indices + i * 3);
+
+    DynamicArray<UInt32> clusters(_alloc); // first triangle of each cluster
+    Size start = 0;
+    while (start < triangleCount)
+    {
+        Size end = start + 1;
+        while (end < triangleCount && triangleMisses[end] != 3)
+            ++end;
+
+        // Split the hard cluster further wherever the part so far, starting with a cold cache,
+        // stays within _threshold of the overall miss ratio. Each part can then be drawn in any
+        // order for about that cost. Very small parts don't have a meaningful normal, hence the
+        // minimum size.
+        UInt32 clusterMisses = 0;
+        for (Size i = start; i < end; ++i)
+            clusterMisses += triangleMisses[i];
+        Float32 clusterRatio = (Float32)clusterMisses / (Float32)(end - start);
+
+        clusters.append((UInt32)start);
+        cache.flush();
+        UInt32 misses = 0;
+        for (Size i = start; i < end; ++i)
+        {
+            misses += cache.triangleMisses(_indices + i * 3);
+            Size count = i - clusters.last() + 1;
+            if (i + 1 < end && count >= 8 &&
+                (Float32)misses / (Float32)count <= clusterRatio * _threshold)
+            {
+                clusters.append((UInt32)(i + 1));
+                cache.flush();
+                misses = 0;
+            }
+        }
+        start = end;
+    }
+
+    auto position = [_positions, _positionStride](UInt32 _v) {
+        return reinterpret_cast<const Float32 *>(reinterpret_cast<const UInt8 *>(_positions) +
+                                                 _v * _positionStride);
+    };
+
+    Float32 meshCenter[3] = { 0, 0, 0 };
+    for (Size i = 0; i < _indexCount; ++i)
+    {
+        const Float32 * p = position(_indices[i]);
+        for (Size j = 0; j < 3; ++j)
+            meshCenter[j] += p[j];
+    }
+    for (Size j = 0; j < 3; ++j)
+        meshCenter[j] /= (Float32)_indexCount;
+
+    // clusters whose area weighted normal points away from the mesh center come first
+    struct ClusterKey
+    {
+        Float32 key;
+        UInt32 cluster;
+    };
+    DynamicArray<ClusterKey> keys(_alloc);
+    keys.resize(clusters.count());
+    for (Size c = 0; c < clusters.count(); ++c)
+    {
+        Size end = c + 1 < clusters.count() ? clusters[c + 1] : triangleCount;
+        Float32 center[3] = { 0, 0, 0 };
+        Float32 normal[3] = { 0, 0, 0 };
+        Float32 area = 0;
+        for (Size t = clusters[c]; t < end; ++t)
+        {
+            const Float32 * a = position(_indices[t * 3]);
+            const Float32 * b = position(_indices[t * 3 + 1]);
+            const Float32 * d = position(_indices[t * 3 + 2]);
+            Float32 e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            Float32 e1[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+            Float32 n[3] = { e0[1] * e1[2] - e0[2] * e1[1],
+                             e0[2] * e1[0] - e0[0] * e1[2],
+                             e0[0] * e1[1] - e0[1] * e1[0] };
+            Float32 triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (Size j = 0; j < 3; ++j)
+            {
+                center[j] += (a[j] + b[j] + d[j]) / 3.0f * triangleArea;
+                normal[j] += n[j];
+            }
+            area += triangleArea;
+        }
+
+        Float32 key = 0;
+        if (area > 0)
+        {
+            for (Size j = 0; j < 3; ++j)
+                key += (center[j] / area - meshCenter[j]) * normal[j];
+            key /= std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                             normal[2] * normal[2]) +
+                   1e-20f;
+        }
+        keys[c] = { key, (UInt32)c };
+    }
+
+    std::stable_sort(keys.begin(), keys.end(), [](const ClusterKey & _a, const ClusterKey & _b) {
+        return _a.key > _b.key;
+    });
+
+    UInt32 * out = _dst;
+    for (const ClusterKey & k : keys)
+    {
+        Size first = clusters[k.cluster];
+        Size end = k.cluster + 1 < clusters.count() ? clusters[k.cluster + 1] : triangleCount;
+        std::memcpy(out, _indices + first * 3, (end - first) * 3 * sizeof(UInt32));
+        out += (end - first) * 3;
+    }
+}
+
+Size optimizeVertexFetch(void * _dstVertices,
+                         UInt32 * _indices,
+                         Size _indexCount,
+                         const void * _vertices,
+                         Size _vertexCount,
+                         Size _vertexByteCount,
+                         Allocator & _alloc)
+{
+    STICK_ASSERT(_dstVertices != _vertices);
+
+    DynamicArray<UInt32> remap(_alloc);
+    remap.resize(_vertexCount);
+    std::fill(remap.begin(), remap.end(), (UInt32)-1);
+
+    const UInt8 * src = static_cast<const UInt8 *>(_vertices);
+    UInt8 * dst = static_cast<UInt8 *>(_dstVertices);
+    UInt32 next = 0;
+    for (Size i = 0; i < _indexCount; ++i)
+    {
+        UInt32 v = _indices[i];
+        STICK_ASSERT(v < _vertexCount);
+        if (remap[v] == (UInt32)-1)
+        {
+            std::memcpy(dst + next * _vertexByteCount, src + v * _vertexByteCount, _vertexByteCount);
+            remap[v] = next++;
+        }
+        _indices[i] = remap[v];
+    }
+    return next;
+}
+
+namespace
+{
+// Area weighted sum of squared distances to a set of planes, Q(p) = p'Ap + 2b'p + c. Evaluated in
+// double precision as the terms cancel out for positions far from the origin.
+struct Quadric
+{
+    Float64 a00, a01, a02, a11, a12, a22;
+    Float64 b0, b1, b2;
+    Float64 c;
+    Float64 weight; // the summed area, Q(p) / weight is the mean squared distance
+};
+
+struct Collapse
+{
+    UInt32 from;
+    UInt32 to;
+    Float32 error;
+};
+} // namespace
+
+static void addPlane(Quadric & _q, const Float64 * _n, Float64 _d, Float64 _weight)
+{
+    _q.a00 += _weight * _n[0] * _n[0];
+    _q.a01 += _weight * _n[0] * _n[1];
+    _q.a02 += _weight * _n[0] * _n[2];
+    _q.a11 += _weight * _n[1] * _n[1];
+    _q.a12 += _weight * _n[1] * _n[2];
+    _q.a22 += _weight * _n[2] * _n[2];
+    _q.b0 += _weight * _n[0] * _d;
+    _q.b1 += _weight * _n[1] * _d;
+    _q.b2 += _weight * _n[2] * _d;
+    _q.c += _weight * _d * _d;
+    _q.weight += _weight;
+}
+
+static void addQuadric(Quadric & _q, const Quadric & _other)
+{
+    _q.a00 += _other.a00;
+    _q.a01 += _other.a01;
+    _q.a02 += _other.a02;
+    _q.a11 += _other.a11;
+    _q.a12 += _other.a12;
+    _q.a22 += _other.a22;
+    _q.b0 += _other.b0;
+    _q.b1 += _other.b1;
+    _q.b2 += _other.b2;
+    _q.c += _other.c;
+    _q.weight += _other.weight;
+}
+
+// the root mean squared distance of _p to the planes of _q
+static Float32 quadricError(const Quadric & _q, const Float32 * _p)
+{
+    if (_q.weight <= 0.0)
+        return 0.0f;
+    Float64 x = _p[0], y = _p[1], z = _p[2];
+    Float64 e = x * (_q.a00 * x + 2.0 * (_q.a01 * y + _q.a02 * z + _q.b0)) +
+                y * (_q.a11 * y + 2.0 * (_q.a12 * z + _q.b1)) + z * (_q.a22 * z + 2.0 * _q.b2) +
+                _q.c;
+    return (Float32)std::sqrt(std::max(e, 0.0) / _q.weight);
+}
+
+static void triangleNormal(const Float32 * _a,
+                           const Float32 * _b,
+                           const Float32 * _c,
+                           Float64 * _out)
+{
+    Float64 e0[3] = { _b[0] - _a[0], _b[1] - _a[1], _b[2] - _a[2] };
+    Float64 e1[3] = { _c[0] - _a[0], _c[1] - _a[1], _c[2] - _a[2] };
+    _out[0] = e0[1] * e1[2] - e0[2] * e1[1];
+    _out[1] = e0[2] * e1[0] - e0[0] * e1[2];
+    _out[2] = e0[0] * e1[1] - e0[1] * e1[0];
+}
+
+enum VertexFlags
+{
+    VertexSeam = 1,  // shares its position with other vertices
+    VertexBorder = 2 // on an edge that only one triangle uses
+};
+
+Size simplifyMesh(UInt32 * _dst,
+                  const UInt32 * _indices,
+                  Size _indexCount,
+                  const Float32 * _positions,
+                  Size _vertexCount,
+                  Size _positionStride,
+                  Size _targetIndexCount,
+                  Float32 _targetError,
+                  Float32 * _outError,
+                  Allocator & _alloc)
+{
+    STICK_ASSERT(_indexCount % 3 == 0);
+
+    auto position = [_positions, _positionStride](UInt32 _v) {
+        return reinterpret_cast<const Float32 *>(reinterpret_cast<const UInt8 *>(_positions) +
+                                                 _v * _positionStride);
+    };
+
+    DynamicArray<UInt32> indices(_alloc);
+    indices.resize(_indexCount);
+    std::memcpy(indices.ptr(), _indices, _indexCount * sizeof(UInt32));
+    Float32 resultError = 0.0f;
+
+    // find the vertices that share a position, each group is represented by its first vertex
+    DynamicArray<UInt32> canonical(_alloc);
+    canonical.resize(_vertexCount);
+    DynamicArray<UInt8> flags(_alloc);
+    flags.resize(_vertexCount);
+    std::fill(flags.begin(), flags.end(), 0);
+    {
+        DynamicArray<UInt32> order(_alloc);
+        order.resize(_vertexCount);
+        for (Size i = 0; i < _vertexCount; ++i)
+            order[i] = (UInt32)i;
+        auto less = [&position](UInt32 _a, UInt32 _b) {
+            const Float32 * a = position(_a);
+            const Float32 * b = position(_b);
+            return std::lexicographical_compare(a, a + 3, b, b + 3);
+        };
+        std::sort(order.begin(), order.end(), less);
+
+        for (Size i = 0; i < _vertexCount;)
+        {
+            Size end = i + 1;
+            while (end < _vertexCount && !less(order[i], order[end]))
+                ++end;
+            for (Size j = i; j < end; ++j)
+            {
+                canonical[order[j]] = order[i];
+                if (end - i > 1)
+                    flags[order[j]] |= VertexSeam;
+            }
+            i = end;
+        }
+    }
+
+    // Open borders, found by counting the triangles of each edge between positions. Seam edges
+    // are used by triangles on both sides and not counted as borders.
+    {
+        DynamicArray<UInt64> edges(_alloc);
+        edges.resize(_indexCount);
+        for (Size i = 0; i < _indexCount; i += 3)
+        {
+            for (Size j = 0; j < 3; ++j)
+            {
+                UInt64 a = canonical[indices[i + j]];
+                UInt64 b = canonical[indices[i + (j + 1) % 3]];
+                edges[i + j] = a < b ? (a << 32) | b : (b << 32) | a;
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for (Size i = 0; i < edges.count();)
+        {
+            Size end = i + 1;
+            while (end < edges.count() && edges[end] == edges[i])
+                ++end;
+            if (end - i == 1)
+            {
+                flags[edges[i] >> 32] |= VertexBorder;
+                flags[edges[i] & 0xFFFFFFFF] |= VertexBorder;
+            }
+            i = end;
+        }
+    }
+
+    DynamicArray<Quadric> quadrics(_alloc);
+    quadrics.resize(_vertexCount);
+    std::memset(quadrics.ptr(), 0, _vertexCount * sizeof(Quadric));
+    for (Size i = 0; i < _indexCount; i += 3)
+    {
+        const Float32 * p = position(indices[i]);
+        Float64 n[3];
+        triangleNormal(p, position(indices[i + 1]), position(indices[i + 2]), n);
+        Float64 len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (len <= 0.0)
+            continue;
+        for (Size j = 0; j < 3; ++j)
+            n[j] /= len;
+        Float64 d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+        for (Size j = 0; j < 3; ++j)
+            addPlane(quadrics[indices[i + j]], n, d, len * 0.5);
+    }
+
+    // Only vertices that are alone at their position and not on a border are collapsed, onto a
+    // neighbour that is alone at its position. Everything else would tear seams or borders open.
+    auto isLocked = [&flags, &canonical](UInt32 _v) {
+        return (flags[_v] & VertexSeam) || (flags[canonical[_v]] & VertexBorder);
+    };
+
+    DynamicArray<UInt32> adjacencyOffsets(_alloc);
+    DynamicArray<UInt32> adjacency(_alloc);
+    DynamicArray<Collapse> collapses(_alloc);
+    DynamicArray<Collapse> bestCollapses(_alloc);
+    DynamicArray<UInt32> remap(_alloc);
+    DynamicArray<UInt8> touched(_alloc);
+    adjacencyOffsets.resize(_vertexCount + 1);
+    remap.resize(_vertexCount);
+    touched.resize(_vertexCount);
+    bestCollapses.resize(_vertexCount);
+
+    Size targetTriangleCount = _targetIndexCount / 3;
+    while (indices.count() / 3 > targetTriangleCount)
+    {
+        Size triangleCount = indices.count() / 3;
+
+        // the triangles of each vertex
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (UInt32 v : indices)
+            adjacencyOffsets[v + 1]++;
+        for (Size i = 0; i < _vertexCount; ++i)
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+        adjacency.resize(indices.count());
+        for (Size i = 0; i < indices.count(); ++i)
+            adjacency[adjacencyOffsets[indices[i]]++] = (UInt32)(i / 3);
+        for (Size i = _vertexCount; i > 0; --i)
+            adjacencyOffsets[i] = adjacencyOffsets[i - 1];
+        adjacencyOffsets[0] = 0;
+
+        // the cheapest collapse of each vertex
+        for (Size i = 0; i < _vertexCount; ++i)
+            bestCollapses[i] = { (UInt32)i, (UInt32)i, FLT_MAX };
+        for (Size i = 0; i < indices.count(); ++i)
+        {
+            UInt32 a = indices[i];
+            UInt32 b = indices[i - i % 3 + (i + 1) % 3];
+            UInt32 edge[2] = { a, b };
+            for (Size j = 0; j < 2; ++j)
+            {
+                UInt32 from = edge[j];
+                UInt32 to = edge[1 - j];
+                if (isLocked(from) || (flags[to] & VertexSeam))
+                    continue;
+                Quadric q = quadrics[from];
+                addQuadric(q, quadrics[to]);
+                Float32 error = quadricError(q, position(to));
+                if (error < bestCollapses[from].error)
+                    bestCollapses[from] = { from, to, error };
+            }
+        }
+        collapses.clear();
+        for (const Collapse & c : bestCollapses)
+        {
+            if (c.from != c.to)
+                collapses.append(c);
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse & _a, const Collapse & _b) {
+            return _a.error < _b.error;
+        });
+
+        // Collapse the cheapest edges first. The collapses of one pass must not affect each other,
+        // so the vertices around a collapsed vertex are left alone until the next pass.
+        for (Size i = 0; i < _vertexCount; ++i)
+            remap[i] = (UInt32)i;
+        std::fill(touched.begin(), touched.end(), 0);
+        Size collapseCount = 0;
+        for (const Collapse & c : collapses)
+        {
+            if (c.error > _targetError || triangleCount <= targetTriangleCount)
+                break;
+            if (touched[c.from] || touched[c.to])
+                continue;
+
+            // triangles that share the edge disappear, the others must not flip over
+            Size removed = 0;
+            bool bFlips = false;
+            for (UInt32 k = adjacencyOffsets[c.from]; k < adjacencyOffsets[c.from + 1]; ++k)
+            {
+                const UInt32 * tri = indices.ptr() + adjacency[k] * 3;
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+                {
+                    removed++;
+                    continue;
+                }
+                const Float32 * before[3];
+                const Float32 * after[3];
+                for (Size j = 0; j < 3; ++j)
+                {
+                    before[j] = position(tri[j]);
+                    after[j] = tri[j] == c.from ? position(c.to) : before[j];
+                }
+                Float64 n0[3], n1[3];
+                triangleNormal(before[0], before[1], before[2], n0);
+                triangleNormal(after[0], after[1], after[2], n1);
+                if (n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0)
+                {
+                    bFlips = true;
+                    break;
+                }
+            }
+            if (bFlips)
+                continue;
+
+            remap[c.from] = c.to;
+            addQuadric(quadrics[c.to], quadrics[c.from]);
+            for (UInt32 k = adjacencyOffsets[c.from]; k < adjacencyOffsets[c.from + 1]; ++k)
+            {
+                const UInt32 * tri = indices.ptr() + adjacency[k] * 3;
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+            }
+            triangleCount -= removed;
+            resultError = std::max(resultError, c.error);
+            collapseCount++;
+        }
+
+        if (!collapseCount)
+            break;
+
+        // apply the collapses and drop the triangles that became degenerate
+        Size count = 0;
+        for (Size i = 0; i < indices.count(); i += 3)
+        {
+            UInt32 a = remap[indices[i]];
+            UInt32 b = remap[indices[i + 1]];
+            UInt32 c = remap[indices[i + 2]];
+            if (a == b || b == c || c == a)
+                continue;
+            indices[count++] = a;
+            indices[count++] = b;
+            indices[count++] = c;
+        }
+        indices.resize(count);
+    }
+
+    std::memcpy(_dst, indices.ptr(), indices.count() * sizeof(UInt32));
+    if (_outError)
+        *_outError = resultError;
+    return indices.count();
+}
+
+void buildLODChain(DynamicArray<UInt32> & _outIndices,
+                   DynamicArray<MeshLOD> & _outLODs,
+                   const UInt32 * _indices,
+                   Size _indexCount,
+                   const Float32 * _positions,
+                   Size _vertexCount,
+                   Size _positionStride,
+                   UInt32 _maxLODCount,
+                   Float32 _reduction,
+                   Allocator & _alloc)
+{
+    _outIndices.clear();
+    _outLODs.clear();
+    _outIndices.append(_indices, _indices + _indexCount);
+    _outLODs.append({ 0, (UInt32)_indexCount, 0.0f });
+
+    // every level is simplified from the full detail mesh, so that its error is measured against
+    // the original surface
+    DynamicArray<UInt32> lod(_alloc);
+    lod.resize(_indexCount);
+    for (UInt32 level = 1; level < _maxLODCount; ++level)
+    {
+        UInt32 previousCount = _outLODs.last().indexCount;
+        Float32 previousError = _outLODs.last().error;
+        Size targetCount = (Size)(previousCount * _reduction) / 3 * 3;
+
+        Float32 error;
+        Size count = simplifyMesh(lod.ptr(),
+                                  _indices,
+                                  _indexCount,
+                                  _positions,
+                                  _vertexCount,
+                                  _positionStride,
+                                  targetCount,
+                                  FLT_MAX,
+                                  &error,
+                                  _alloc);
+
+        // stop once the simplification gets stuck, i.e. at locked borders and seams, rather than
+        // adding levels that barely differ
+        if (!count || (Float32)count > previousCount * (1.0f + _reduction) * 0.5f)
+            break;
+
+        optimizeVertexCache(lod.ptr(), lod.ptr(), count, _vertexCount, _alloc);
+        _outLODs.append(
+            { (UInt32)_outIndices.count(), (UInt32)count, std::max(error, previousError) });
+        _outIndices.append(lod.ptr(), lod.ptr() + count);
+    }
+}
+
+} // namespace dab
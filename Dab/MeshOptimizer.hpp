@@ -0,0 +1,93 @@
+#ifndef DAB_MESHOPTIMIZER_HPP
+#define DAB_MESHOPTIMIZER_HPP
+
+#include <Dab/Dab.hpp>
+
+#include <cfloat>
+
+namespace dab
+{
+
+// CPU passes that reorder triangle lists before they are loaded into vertex and index buffers. The
+// usual order is optimizeVertexCache, optionally optimizeOverdraw, then optimizeVertexFetch.
+// _indices always describe a triangle list of 32 bit indices, narrow them afterwards if needed
+// (see narrowestIndexType).
+
+// Reorders the triangles for the post transform vertex cache, using Tom Forsyth's linear speed
+// vertex cache optimization. _dst may be the same as _indices.
+STICK_API void optimizeVertexCache(UInt32 * _dst,
+                                   const UInt32 * _indices,
+                                   Size _indexCount,
+                                   Size _vertexCount,
+                                   stick::Allocator & _alloc = stick::defaultAllocator());
+
+// Reorders groups of triangles so that the ones facing outwards are drawn first, which lets the
+// depth test reject more of the ones behind them. _indices should already be optimized for the
+// vertex cache, the groups are chosen so that the cache miss ratio grows by at most _threshold
+// (i.e. 1.05 for 5%). _positions holds three floats per vertex, _positionStride bytes apart.
+// _dst may not be the same as _indices.
+STICK_API void optimizeOverdraw(UInt32 * _dst,
+                                const UInt32 * _indices,
+                                Size _indexCount,
+                                const Float32 * _positions,
+                                Size _vertexCount,
+                                Size _positionStride,
+                                Float32 _threshold = 1.05f,
+                                stick::Allocator & _alloc = stick::defaultAllocator());
+
+// Reorders the vertices in the order the triangles first use them, so that the vertex fetch walks
+// memory mostly linearly, and rewrites _indices accordingly. Vertices that are not referenced are
+// dropped. _dstVertices needs room for _vertexCount vertices of _vertexByteCount bytes and may not
+// overlap _vertices. Returns the number of vertices written to _dstVertices.
+STICK_API Size optimizeVertexFetch(void * _dstVertices,
+                                   UInt32 * _indices,
+                                   Size _indexCount,
+                                   const void * _vertices,
+                                   Size _vertexCount,
+                                   Size _vertexByteCount,
+                                   stick::Allocator & _alloc = stick::defaultAllocator());
+
+// Reduces a triangle list to about _targetIndexCount indices by collapsing edges in the order of
+// their quadric error. Vertices are neither moved nor added, so the result indexes the same vertex
+// buffer. Stops early once the error (the deviation from the input surface, in the units of
+// _positions) would exceed _targetError. Vertices on open borders and attribute seams (several
+// vertices at the same position) are kept. _dst may be the same as _indices and needs room for
+// _indexCount indices. Returns the number of indices written, the reached error goes to _outError.
+STICK_API Size simplifyMesh(UInt32 * _dst,
+                            const UInt32 * _indices,
+                            Size _indexCount,
+                            const Float32 * _positions,
+                            Size _vertexCount,
+                            Size _positionStride,
+                            Size _targetIndexCount,
+                            Float32 _targetError = FLT_MAX,
+                            Float32 * _outError = nullptr,
+                            stick::Allocator & _alloc = stick::defaultAllocator());
+
+// Builds up to _maxLODCount levels of detail of a triangle list, each with about _reduction times
+// the triangles of the previous one. All levels are written to _outIndices one after another,
+// starting with _indices itself, and described by _outLODs, so that a single index buffer over
+// the unchanged vertices holds the whole chain (see RenderPass::drawMeshLOD). The simplified levels
+// are optimized for the vertex cache. Fewer levels are built if the mesh can't be reduced further.
+STICK_API void buildLODChain(stick::DynamicArray<UInt32> & _outIndices,
+                             stick::DynamicArray<MeshLOD> & _outLODs,
+                             const UInt32 * _indices,
+                             Size _indexCount,
+                             const Float32 * _positions,
+                             Size _vertexCount,
+                             Size _positionStride,
+                             UInt32 _maxLODCount = 4,
+                             Float32 _reduction = 0.5f,
+                             stick::Allocator & _alloc = stick::defaultAllocator());
+
+// The average cache miss ratio (transformed vertices per triangle) of _indices with a FIFO vertex
+// cache of _cacheSize entries. Ranges from 0.5 (ideal for regular grids) to 3.
+STICK_API Float32 averageCacheMissRatio(const UInt32 * _indices,
+                                        Size _indexCount,
+                                        Size _vertexCount,
+                                        UInt32 _cacheSize = 16,
+                                        stick::Allocator & _alloc = stick::defaultAllocator());
+
+} // namespace dab
+
+#endif // DAB_MESHOPTIMIZER_HPP
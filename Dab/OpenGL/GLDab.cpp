@@ -1,5 +1,9 @@
 #include <Dab/OpenGL/GLDab.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
 #ifdef STICK_DEBUG
 #define ASSERT_NO_GL_ERROR(_func)                                                                  \
     do                                                                                             \
@@ -63,6 +67,18 @@
 #endif
 
 #define UNIFORM_BUFFER_SIZE 64 * 1024
+// the minimum of GL_MAX_VERTEX_ATTRIB_BINDINGS guaranteed by the spec
+#define MAX_VERTEX_BINDINGS 16
+// the size of the buffers that BufferUsageSuballocate buffers are stored in
+#define BUFFER_ARENA_SIZE 32 * 1024 * 1024
+// the size of the vertex and index rings that transient geometry is allocated from
+#define TRANSIENT_VERTEX_RING_SIZE 8 * 1024 * 1024
+#define TRANSIENT_INDEX_RING_SIZE 2 * 1024 * 1024
+// alignment of suballocated index data (enough for all index types)
+#define INDEX_ARENA_ALIGNMENT 4
+// waitForSubmission gives up after this many timeouts of one second each
+#define SUBMIT_WAIT_TIMEOUT_NS 1000000000
+#define SUBMIT_WAIT_MAX_TIMEOUTS 10
 #define BUFFER_OFFSET(_off) (char *)(0 + _off)
 
 namespace dab
@@ -163,7 +179,13 @@ static GLenum s_glDataTypes[] = {
     // Float32
     GL_FLOAT,
     // Float64
-    GL_DOUBLE
+    GL_DOUBLE,
+    // Float16
+    GL_HALF_FLOAT,
+    // Int2_10_10_10_Rev
+    GL_INT_2_10_10_10_REV,
+    // UInt2_10_10_10_Rev
+    GL_UNSIGNED_INT_2_10_10_10_REV
 };
 static_assert((Size)DataType::Count == sizeof(s_glDataTypes) / sizeof(s_glDataTypes[0]),
               "BufferDataType mapping is not complete!");
@@ -182,12 +204,49 @@ static GLenum s_glVertexDrawModes[] = {
     // LineStrip
     GL_LINE_STRIP,
     // LineLoop
-    GL_LINE_LOOP
+    GL_LINE_LOOP,
+    // Patches
+    GL_PATCHES
 };
 static_assert((Size)VertexDrawMode::Count ==
                   sizeof(s_glVertexDrawModes) / sizeof(s_glVertexDrawModes[0]),
               "VertexDrawMode mapping is not complete!");
 
+static GLenum s_glShaderStages[] = {
+    // Vertex
+    GL_VERTEX_SHADER,
+    // Pixel
+    GL_FRAGMENT_SHADER,
+    // Geometry
+    GL_GEOMETRY_SHADER,
+    // TessellationControl
+    GL_TESS_CONTROL_SHADER,
+    // TessellationEvaluation
+    GL_TESS_EVALUATION_SHADER,
+    // Compute
+    GL_COMPUTE_SHADER
+};
+static_assert((Size)ShaderStage::Count == sizeof(s_glShaderStages) / sizeof(s_glShaderStages[0]),
+              "ShaderStage mapping is not complete!");
+
+static GLbitfield s_glShaderStageBits[] = {
+    // Vertex
+    GL_VERTEX_SHADER_BIT,
+    // Pixel
+    GL_FRAGMENT_SHADER_BIT,
+    // Geometry
+    GL_GEOMETRY_SHADER_BIT,
+    // TessellationControl
+    GL_TESS_CONTROL_SHADER_BIT,
+    // TessellationEvaluation
+    GL_TESS_EVALUATION_SHADER_BIT,
+    // Compute
+    GL_COMPUTE_SHADER_BIT
+};
+static_assert((Size)ShaderStage::Count ==
+                  sizeof(s_glShaderStageBits) / sizeof(s_glShaderStageBits[0]),
+              "ShaderStage bit mapping is not complete!");
+
 static GLenum s_glCompareFuncs[] = {
     // Equal
     GL_EQUAL,
@@ -287,26 +346,123 @@ static GLenum s_glWrap[] = {
 static_assert((Size)TextureWrap::Count == sizeof(s_glWrap) / sizeof(s_glWrap[0]),
               "TextureWrap mapping is not complete!");
 
+static GLenum s_glImageAccess[] = {
+    // Read
+    GL_READ_ONLY,
+    // Write
+    GL_WRITE_ONLY,
+    // ReadWrite
+    GL_READ_WRITE
+};
+
+static_assert((Size)ImageAccess::Count == sizeof(s_glImageAccess) / sizeof(s_glImageAccess[0]),
+              "ImageAccess mapping is not complete!");
+
+// Returns the first error of a GL call that failed and empties the error queue, so that the
+// error ends up in the returned Error instead of being reported by an unrelated later call.
+static GLenum takeGLError()
+{
+    GLenum ret = glGetError();
+    // bounded, a lost context may keep reporting errors
+    for (Size i = 0; i < 16 && glGetError() != GL_NO_ERROR; ++i)
+        ;
+    return ret;
+}
+
+static const char * glErrorName(GLenum _err)
+{
+    switch (_err)
+    {
+    case GL_NO_ERROR:
+        return "GL_NO_ERROR";
+    case GL_INVALID_ENUM:
+        return "GL_INVALID_ENUM";
+    case GL_INVALID_VALUE:
+        return "GL_INVALID_VALUE";
+    case GL_INVALID_OPERATION:
+        return "GL_INVALID_OPERATION";
+    case GL_INVALID_FRAMEBUFFER_OPERATION:
+        return "GL_INVALID_FRAMEBUFFER_OPERATION";
+    case GL_OUT_OF_MEMORY:
+        return "GL_OUT_OF_MEMORY";
+    default:
+        return "unknown GL error";
+    }
+}
+
+static bool hasExtension(const char * _name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i)
+    {
+        const char * ext = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+        if (ext && std::strcmp(ext, _name) == 0)
+            return true;
+    }
+    return false;
+}
+
 GLRenderDevice::GLRenderDevice(Allocator & _alloc) :
     m_alloc(&_alloc),
     m_programs(_alloc),
+    m_shaders(_alloc),
     m_pipelines(_alloc),
+    m_vertexArenas(_alloc),
+    m_indexArenas(_alloc),
+    m_sharedBuffers(_alloc),
+    m_sharedTextures(_alloc),
     m_vertexBuffers(_alloc),
     m_indexBuffers(_alloc),
+    m_storageBuffers(_alloc),
+    m_vertexArrayCache(_alloc),
     m_meshes(_alloc),
+    m_vertexPools(_alloc),
+    m_uploadQueues(_alloc),
     m_textures(_alloc),
     m_samplers(_alloc),
     m_renderBuffers(_alloc),
     m_renderPasses(_alloc),
-    m_renderPassFreeList(_alloc)
+    m_renderPassFreeList(_alloc),
+    m_passCounter(0),
+    m_submitSerial(0),
+    m_completedSerial(0),
+    m_submitFences(_alloc),
+    m_statistics({ 0, 0, 0 }),
+    m_separableBlockNames(_alloc),
+    m_separableTextureNames(_alloc),
+    m_separableStorageBlockNames(_alloc),
+    m_separableImageNames(_alloc)
 {
     STICK_ASSERT(!gl3wInit());
+    m_bVertexAttribBinding =
+        gl3wIsSupported(4, 3) || hasExtension("GL_ARB_vertex_attrib_binding");
+    m_bMultiBind = gl3wIsSupported(4, 4) || hasExtension("GL_ARB_multi_bind");
+    m_bComputeShaders = gl3wIsSupported(4, 3) || hasExtension("GL_ARB_compute_shader");
+    m_bBufferStorage = gl3wIsSupported(4, 4) || hasExtension("GL_ARB_buffer_storage");
+    m_bBaseInstance = gl3wIsSupported(4, 2) || hasExtension("GL_ARB_base_instance");
+    m_bPrimitiveRestart = false;
+    m_primitiveRestartIndex = 0;
     ASSERT_NO_GL_ERROR(
         glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, (GLint *)&m_uboOffsetAlignment));
+    ASSERT_NO_GL_ERROR(
+        glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, (GLint *)&m_maxUniformBufferBindings));
+    ASSERT_NO_GL_ERROR(
+        glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, (GLint *)&m_maxTextureUnits));
+    m_maxStorageBufferBindings = 0;
+    m_maxImageUnits = 0;
+    if (m_bComputeShaders)
+    {
+        ASSERT_NO_GL_ERROR(glGetIntegerv(GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS,
+                                         (GLint *)&m_maxStorageBufferBindings));
+        ASSERT_NO_GL_ERROR(glGetIntegerv(GL_MAX_IMAGE_UNITS, (GLint *)&m_maxImageUnits));
+    }
 }
 
 GLRenderDevice::~GLRenderDevice()
 {
+    for (auto & fence : m_submitFences)
+        glDeleteSync(fence.sync);
     // all the other resources clean up after themselves in their respective destructors.
 }
 
@@ -344,10 +500,48 @@ static Error compileShader(const char * _shaderCode, GLenum _shaderType, GLuint
 }
 
 Result<Program *> GLRenderDevice::createProgram(const char * _vertexShader,
-                                                const char * _pixelShader)
+                                                const char * _pixelShader,
+                                                const char * _geometryShader,
+                                                const char * _tessControlShader,
+                                                const char * _tessEvaluationShader)
+{
+    // indexed by ShaderStage
+    const char * sources[] = { _vertexShader,      _pixelShader,          _geometryShader,
+                               _tessControlShader, _tessEvaluationShader, nullptr };
+    static_assert((Size)ShaderStage::Count == sizeof(sources) / sizeof(sources[0]),
+                  "Not all shader stages are handled!");
+
+    auto ret = stick::makeUnique<GLProgram>(*m_alloc);
+    auto err = ret->init(*m_alloc, sources, m_bComputeShaders);
+    if (err)
+        return err;
+    m_programs.append(std::move(ret));
+    return m_programs.last().get();
+}
+
+Result<Program *> GLRenderDevice::createComputeProgram(const char * _computeShader)
+{
+    if (!m_bComputeShaders)
+        return Error(ec::InvalidOperation,
+                     "Compute shaders require GL 4.3 or ARB_compute_shader",
+                     STICK_FILE,
+                     STICK_LINE);
+
+    const char * sources[(Size)ShaderStage::Count] = { nullptr };
+    sources[(Size)ShaderStage::Compute] = _computeShader;
+
+    auto ret = stick::makeUnique<GLProgram>(*m_alloc);
+    auto err = ret->init(*m_alloc, sources, m_bComputeShaders);
+    if (err)
+        return err;
+    m_programs.append(std::move(ret));
+    return m_programs.last().get();
+}
+
+Result<Program *> GLRenderDevice::createProgram(Shader * const * _stages, Size _count)
 {
     auto ret = stick::makeUnique<GLProgram>(*m_alloc);
-    auto err = ret->init(*m_alloc, _vertexShader, _pixelShader);
+    auto err = ret->init(*m_alloc, _stages, _count);
     if (err)
         return err;
     m_programs.append(std::move(ret));
@@ -359,6 +553,46 @@ void GLRenderDevice::destroyProgram(Program * _prog)
     removeItem(m_programs, static_cast<GLProgram *>(_prog));
 }
 
+Result<Shader *> GLRenderDevice::createShader(ShaderStage _stage, const char * _code)
+{
+    if (_stage == ShaderStage::Compute && !m_bComputeShaders)
+        return Error(ec::InvalidOperation,
+                     "Compute shaders require GL 4.3 or ARB_compute_shader",
+                     STICK_FILE,
+                     STICK_LINE);
+
+    auto ret = stick::makeUnique<GLShader>(*m_alloc);
+    auto err = ret->init(this, _stage, _code);
+    if (err)
+        return err;
+    m_shaders.append(std::move(ret));
+    return m_shaders.last().get();
+}
+
+void GLRenderDevice::destroyShader(Shader * _shader)
+{
+    removeItem(m_shaders, static_cast<GLShader *>(_shader));
+}
+
+Result<UInt32> GLRenderDevice::separableBinding(DynamicArray<String> & _names,
+                                                const String & _name,
+                                                UInt32 _maxCount)
+{
+    auto it = std::find(_names.begin(), _names.end(), _name);
+    if (it != _names.end())
+        return (UInt32)(it - _names.begin());
+
+    if (_names.count() >= _maxCount)
+        return Error(ec::InvalidOperation,
+                     String::concat("Out of binding points for separable shader resource: ",
+                                    _name.cString()),
+                     STICK_FILE,
+                     STICK_LINE);
+
+    _names.append(_name);
+    return (UInt32)(_names.count() - 1);
+}
+
 // helpers to create the pipeline bitmask
 static void setFlag(UInt64 & _bitMask, RenderFlag _flag, bool _b)
 {
@@ -403,6 +637,22 @@ static bool isFieldDifferent(UInt64 _diffMask, UInt64 _fieldMask)
 
 Result<Pipeline *> GLRenderDevice::createPipeline(const PipelineSettings & _settings)
 {
+    if (_settings.drawDataBlock)
+    {
+        const GLProgram * program = static_cast<const GLProgram *>(_settings.program);
+        auto it = std::find_if(program->m_storageBlocks.begin(),
+                               program->m_storageBlocks.end(),
+                               [&_settings](const GLStorageBlockBinding & _b) {
+                                   return _b.name == _settings.drawDataBlock;
+                               });
+        if (it == program->m_storageBlocks.end() || !(*it).arrayStride)
+            return Error(ec::InvalidOperation,
+                         String::concat("Draw data block is not an unsized array in the program: ",
+                                        _settings.drawDataBlock),
+                         STICK_FILE,
+                         STICK_LINE);
+    }
+
     m_pipelines.append(stick::makeUnique<GLPipeline>(*m_alloc, *m_alloc, _settings));
     return m_pipelines.last().get();
 }
@@ -412,35 +662,143 @@ void GLRenderDevice::destroyPipeline(Pipeline * _pipe)
     removeItem(m_pipelines, static_cast<GLPipeline *>(_pipe));
 }
 
+static Error validateBufferUsage(BufferUsageFlags _usage)
+{
+    if ((_usage & BufferUsageSuballocate) &&
+        (_usage & (BufferUsageDynamic | BufferUsageStream | BufferUsageReadback)))
+        return Error(ec::InvalidOperation,
+                     "BufferUsageSuballocate can only be used for static buffers",
+                     STICK_FILE,
+                     STICK_LINE);
+    if ((_usage & BufferUsageDeduplicate) &&
+        (_usage & (BufferUsageDynamic | BufferUsageStream | BufferUsageReadback |
+                   BufferUsageSuballocate)))
+        return Error(ec::InvalidOperation,
+                     "BufferUsageDeduplicate can only be used for static, not suballocated buffers",
+                     STICK_FILE,
+                     STICK_LINE);
+    return Error();
+}
+
 Result<VertexBuffer *> GLRenderDevice::createVertexBuffer(BufferUsageFlags _usage)
 {
-    m_vertexBuffers.append(stick::makeUnique<GLVertexBuffer>(*m_alloc, _usage));
+    auto err = validateBufferUsage(_usage);
+    if (err)
+        return err;
+
+    m_vertexBuffers.append(stick::makeUnique<GLVertexBuffer>(*m_alloc, this, _usage));
     return m_vertexBuffers.last().get();
 }
 
 void GLRenderDevice::destroyVertexBuffer(VertexBuffer * _buff)
 {
+    //@TODO: see comment in destroyTexture
+    for (auto & pipe : m_pipelines)
+    {
+        for (auto & buf : pipe->m_buffers)
+        {
+            if (buf->m_vertexBuffer == _buff)
+                buf->m_vertexBuffer = nullptr;
+        }
+    }
     removeItem(m_vertexBuffers, static_cast<GLVertexBuffer *>(_buff));
 }
 
-Result<IndexBuffer *> GLRenderDevice::createIndexBuffer(BufferUsageFlags _usage)
+static bool isIndexType(DataType _type)
+{
+    return _type == DataType::UInt8 || _type == DataType::UInt16 || _type == DataType::UInt32;
+}
+
+Result<IndexBuffer *> GLRenderDevice::createIndexBuffer(BufferUsageFlags _usage,
+                                                        DataType _indexType)
 {
-    m_indexBuffers.append(stick::makeUnique<GLIndexBuffer>(*m_alloc, _usage));
+    auto err = validateBufferUsage(_usage);
+    if (err)
+        return err;
+    if (!isIndexType(_indexType))
+        return Error(ec::InvalidOperation,
+                     "Index buffers only support UInt8, UInt16 and UInt32 indices",
+                     STICK_FILE,
+                     STICK_LINE);
+
+    m_indexBuffers.append(stick::makeUnique<GLIndexBuffer>(*m_alloc, this, _usage, _indexType));
     return m_indexBuffers.last().get();
 }
 
 void GLRenderDevice::destroyIndexBuffer(IndexBuffer * _buff)
 {
+    //@TODO: see comment in destroyTexture
+    for (auto & pipe : m_pipelines)
+    {
+        for (auto & buf : pipe->m_buffers)
+        {
+            if (buf->m_indexBuffer == _buff)
+                buf->m_indexBuffer = nullptr;
+        }
+    }
     removeItem(m_indexBuffers, static_cast<GLIndexBuffer *>(_buff));
 }
 
+Result<StorageBuffer *> GLRenderDevice::createStorageBuffer(BufferUsageFlags _usage)
+{
+    if (!m_bComputeShaders)
+        return Error(ec::InvalidOperation,
+                     "Storage buffers require GL 4.3 or ARB_compute_shader",
+                     STICK_FILE,
+                     STICK_LINE);
+    if (_usage & BufferUsageDeduplicate)
+        return Error(ec::InvalidOperation,
+                     "BufferUsageDeduplicate is only supported for vertex and index buffers",
+                     STICK_FILE,
+                     STICK_LINE);
+    m_storageBuffers.append(stick::makeUnique<GLStorageBuffer>(*m_alloc, _usage));
+    return m_storageBuffers.last().get();
+}
+
+void GLRenderDevice::destroyStorageBuffer(StorageBuffer * _buff)
+{
+    //@TODO: see comment in destroyTexture
+    for (auto & pipe : m_pipelines)
+    {
+        for (auto & buf : pipe->m_buffers)
+        {
+            if (buf->m_storageBuffer == _buff)
+                buf->m_storageBuffer = nullptr;
+        }
+    }
+    removeItem(m_storageBuffers, static_cast<GLStorageBuffer *>(_buff));
+}
+
 Result<Mesh *> GLRenderDevice::createMesh(VertexBuffer ** _vertexBuffers,
                                           const VertexLayout * _layouts,
                                           Size _count,
                                           IndexBuffer * _indexBuffer)
 {
-    m_meshes.append(stick::makeUnique<GLMesh>(
-        *m_alloc, *m_alloc, _vertexBuffers, _layouts, _count, _indexBuffer));
+    // the layouts of multiple streams need distinct locations, see VertexLayout::finish
+    UInt64 locations = 0;
+    Size elementCount = 0;
+    for (Size i = 0; i < _count; ++i)
+    {
+        // each element takes one buffer binding
+        elementCount += _layouts[i].elements.count();
+        if (elementCount > MAX_VERTEX_BINDINGS)
+            return Error(ec::InvalidOperation,
+                         "Meshes can't have more than 16 vertex elements",
+                         STICK_FILE,
+                         STICK_LINE);
+        for (const auto & el : _layouts[i].elements)
+        {
+            if (el.location >= 64 || (locations & (1ULL << el.location)))
+                return Error(ec::InvalidOperation,
+                             "Vertex element locations overlap between the mesh layouts",
+                             STICK_FILE,
+                             STICK_LINE);
+            locations |= 1ULL << el.location;
+        }
+    }
+
+    m_meshes.append(
+        stick::makeUnique<GLMesh>(*m_alloc, this, _vertexBuffers, _layouts, _count, _indexBuffer));
     return m_meshes.last().get();
 }
 
@@ -449,9 +807,213 @@ void GLRenderDevice::destroyMesh(Mesh * _mesh)
     removeItem(m_meshes, static_cast<GLMesh *>(_mesh));
 }
 
-Result<Texture *> GLRenderDevice::createTexture()
+UInt64 GLRenderDevice::insertSubmitFence()
 {
-    m_textures.append(makeUnique<GLTexture>(*m_alloc));
+    m_submitSerial++;
+    m_submitFences.append({ m_submitSerial, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) });
+    return m_submitSerial;
+}
+
+void GLRenderDevice::pollSubmitFences()
+{
+    while (m_submitFences.count())
+    {
+        GLenum state = glClientWaitSync(m_submitFences[0].sync, 0, 0);
+        if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(m_submitFences[0].sync);
+        m_completedSerial = m_submitFences[0].serial;
+        m_submitFences.remove(m_submitFences.begin());
+    }
+}
+
+Error GLRenderDevice::waitForSubmission(UInt64 _serial)
+{
+    Size timeoutCount = 0;
+    while (m_completedSerial < _serial && m_submitFences.count())
+    {
+        GLSubmitFence & fence = m_submitFences[0];
+        GLenum state =
+            glClientWaitSync(fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, SUBMIT_WAIT_TIMEOUT_NS);
+        if (state == GL_WAIT_FAILED)
+            return Error(ec::InvalidOperation,
+                         String::concat("Waiting for a submission failed: ",
+                                        glErrorName(takeGLError())),
+                         STICK_FILE,
+                         STICK_LINE);
+        if (state == GL_TIMEOUT_EXPIRED)
+        {
+            if (++timeoutCount == SUBMIT_WAIT_MAX_TIMEOUTS)
+                return Error(ec::InvalidOperation,
+                             "The GPU did not finish the submission in time",
+                             STICK_FILE,
+                             STICK_LINE);
+            continue;
+        }
+        glDeleteSync(fence.sync);
+        m_completedSerial = fence.serial;
+        m_submitFences.remove(m_submitFences.begin());
+    }
+    return Error();
+}
+
+GLuint GLRenderDevice::acquireVertexArray(const VertexLayout * _layouts, Size _count)
+{
+    // Offsets and strides are part of the buffer bindings, not of the vao. Only hash and compare
+    // the attribute formats, so that i.e. planar layouts of different vertex counts share a vao.
+    UInt64 hash = 14695981039346656037ULL;
+    auto hashValue = [&hash](UInt32 _value) { hash = (hash ^ _value) * 1099511628211ULL; };
+    Size elementCount = 0;
+    for (Size i = 0; i < _count; ++i)
+    {
+        for (const auto & el : _layouts[i].elements)
+        {
+            hashValue(static_cast<UInt32>(el.dataType));
+            hashValue(el.elementCount);
+            hashValue(el.location);
+            hashValue(el.divisor);
+            hashValue((UInt32)el.bNormalized | ((UInt32)el.bInteger << 1));
+        }
+        elementCount += _layouts[i].elements.count();
+    }
+
+    auto sameElements = [_layouts, _count, elementCount](const GLVertexArrayCacheEntry & _e) {
+        if (_e.elements.count() != elementCount)
+            return false;
+        Size idx = 0;
+        for (Size i = 0; i < _count; ++i)
+        {
+            for (const auto & el : _layouts[i].elements)
+            {
+                const VertexElement & other = _e.elements[idx++];
+                if (el.dataType != other.dataType || el.elementCount != other.elementCount ||
+                    el.location != other.location || el.divisor != other.divisor ||
+                    el.bNormalized != other.bNormalized || el.bInteger != other.bInteger)
+                    return false;
+            }
+        }
+        return true;
+    };
+
+    for (auto & entry : m_vertexArrayCache)
+    {
+        if (entry.hash == hash && sameElements(entry))
+        {
+            entry.refCount++;
+            return entry.glVao;
+        }
+    }
+
+    GLVertexArrayCacheEntry entry;
+    entry.hash = hash;
+    entry.elements = VertexElementArray(*m_alloc);
+    entry.refCount = 1;
+    ASSERT_NO_GL_ERROR(glGenVertexArrays(1, &entry.glVao));
+    ASSERT_NO_GL_ERROR(glBindVertexArray(entry.glVao));
+
+    // Each element gets its own binding so that offset, stride and divisor can be provided per
+    // element. The offsets are part of the buffer binding, hence the relative offset is 0.
+    // Without separate vertex formats, the format is specified together with the buffer in
+    // bindMeshBuffers instead, the vao then only holds the enabled arrays and divisors.
+    GLuint bindingIndex = 0;
+    for (Size i = 0; i < _count; ++i)
+    {
+        for (const auto & el : _layouts[i].elements)
+        {
+            STICK_ASSERT(el.elementCount <= 4);
+            // the packed types always have four components
+            STICK_ASSERT((el.dataType != DataType::Int2_10_10_10_Rev &&
+                          el.dataType != DataType::UInt2_10_10_10_Rev) ||
+                         el.elementCount == 4);
+            GLenum glType = s_glDataTypes[static_cast<Size>(el.dataType)];
+            if (!m_bVertexAttribBinding)
+            {
+                ASSERT_NO_GL_ERROR(glVertexAttribDivisor(el.location, el.divisor));
+            }
+            else if (el.bInteger)
+            {
+                STICK_ASSERT(el.dataType <= DataType::Int32);
+                ASSERT_NO_GL_ERROR(glVertexAttribIFormat(
+                    el.location, static_cast<UInt32>(el.elementCount), glType, 0));
+            }
+            else
+            {
+                ASSERT_NO_GL_ERROR(glVertexAttribFormat(el.location,
+                                                        static_cast<UInt32>(el.elementCount),
+                                                        glType,
+                                                        el.bNormalized ? GL_TRUE : GL_FALSE,
+                                                        0));
+            }
+            if (m_bVertexAttribBinding)
+            {
+                ASSERT_NO_GL_ERROR(glVertexAttribBinding(el.location, bindingIndex));
+                ASSERT_NO_GL_ERROR(glVertexBindingDivisor(bindingIndex, el.divisor));
+            }
+            ASSERT_NO_GL_ERROR(glEnableVertexAttribArray(el.location));
+            //@TODO: Do we need to support matrix attributes?
+            entry.elements.append(el);
+            ++bindingIndex;
+        }
+    }
+
+    m_vertexArrayCache.append(std::move(entry));
+    return m_vertexArrayCache.last().glVao;
+}
+
+void GLRenderDevice::releaseVertexArray(GLuint _vao)
+{
+    auto it = std::find_if(m_vertexArrayCache.begin(),
+                           m_vertexArrayCache.end(),
+                           [_vao](const GLVertexArrayCacheEntry & _e) { return _e.glVao == _vao; });
+    STICK_ASSERT(it != m_vertexArrayCache.end());
+    if (--(*it).refCount == 0)
+    {
+        glDeleteVertexArrays(1, &(*it).glVao);
+        m_vertexArrayCache.remove(it);
+    }
+}
+
+Result<VertexPool *> GLRenderDevice::createVertexPool(const VertexLayout & _layout,
+                                                      Size _vertexCapacity,
+                                                      Size _indexCapacity)
+{
+    if (!m_bComputeShaders)
+        return Error(ec::InvalidOperation,
+                     "Vertex pools require GL 4.3 or ARB_compute_shader",
+                     STICK_FILE,
+                     STICK_LINE);
+    auto pool = makeUnique<GLVertexPool>(*m_alloc, this);
+    Error err = pool->init(_layout, _vertexCapacity, _indexCapacity);
+    if (err)
+        return err;
+    m_vertexPools.append(std::move(pool));
+    return m_vertexPools.last().get();
+}
+
+void GLRenderDevice::destroyVertexPool(VertexPool * _pool)
+{
+    removeItem(m_vertexPools, static_cast<GLVertexPool *>(_pool));
+}
+
+Result<UploadQueue *> GLRenderDevice::createUploadQueue(Size _stagingByteCount,
+                                                        Size _bytesPerFrame)
+{
+    auto queue = makeUnique<GLUploadQueue>(*m_alloc, this);
+    Error err = queue->init(_stagingByteCount, _bytesPerFrame);
+    if (err)
+        return err;
+    m_uploadQueues.append(std::move(queue));
+    return m_uploadQueues.last().get();
+}
+
+void GLRenderDevice::destroyUploadQueue(UploadQueue * _queue)
+{
+    removeItem(m_uploadQueues, static_cast<GLUploadQueue *>(_queue));
+}
+
+Result<Texture *> GLRenderDevice::createTexture(TextureUsageFlags _usage)
+{
+    m_textures.append(makeUnique<GLTexture>(*m_alloc, this, _usage));
     return m_textures.last().get();
 }
 
@@ -549,6 +1111,155 @@ void GLRenderDevice::destroyRenderBuffer(RenderBuffer * _rb, bool _bDestroyRende
     removeItem(m_renderBuffers, glrb);
 }
 
+static GLint defaultFramebufferParameter(GLenum _attachment, GLenum _name)
+{
+    GLint ret = 0;
+    ASSERT_NO_GL_ERROR(
+        glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, _attachment, _name, &ret));
+    return ret;
+}
+
+// appends the closest TextureFormats to the attachments of the bound default framebuffer
+static void defaultFramebufferFormats(RenderBufferSettings & _settings)
+{
+    GLint drawBuffer = GL_NONE;
+    ASSERT_NO_GL_ERROR(glGetIntegerv(GL_DRAW_BUFFER, &drawBuffer));
+    GLenum colorAttachment = drawBuffer == GL_FRONT ? GL_FRONT_LEFT
+                             : drawBuffer == GL_BACK ? GL_BACK_LEFT
+                                                     : (GLenum)drawBuffer;
+    if (colorAttachment != GL_NONE &&
+        defaultFramebufferParameter(colorAttachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE) !=
+            GL_NONE)
+    {
+        GLint bits = 0;
+        for (GLenum name : { GL_FRAMEBUFFER_ATTACHMENT_RED_SIZE,
+                             GL_FRAMEBUFFER_ATTACHMENT_GREEN_SIZE,
+                             GL_FRAMEBUFFER_ATTACHMENT_BLUE_SIZE })
+            bits = std::max(bits, defaultFramebufferParameter(colorAttachment, name));
+        bool bAlpha =
+            defaultFramebufferParameter(colorAttachment, GL_FRAMEBUFFER_ATTACHMENT_ALPHA_SIZE) > 0;
+        bool bFloat = defaultFramebufferParameter(colorAttachment,
+                                                  GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE) ==
+                      GL_FLOAT;
+
+        TextureFormat format;
+        if (bFloat)
+            format = bits > 16 ? (bAlpha ? TextureFormat::RGBA32F : TextureFormat::RGB32F)
+                               : (bAlpha ? TextureFormat::RGBA16F : TextureFormat::RGB16F);
+        else if (bits > 16)
+            format = bAlpha ? TextureFormat::RGBA32 : TextureFormat::RGB32;
+        else if (bits > 8)
+            format = bAlpha ? TextureFormat::RGBA16 : TextureFormat::RGB16;
+        else
+            format = bAlpha ? TextureFormat::RGBA8 : TextureFormat::RGB8;
+        _settings.renderTargets.append({ format, 0 });
+    }
+
+    GLint depthBits = 0, stencilBits = 0;
+    bool bFloatDepth = false;
+    if (defaultFramebufferParameter(GL_DEPTH, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE) != GL_NONE)
+    {
+        depthBits = defaultFramebufferParameter(GL_DEPTH, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE);
+        bFloatDepth =
+            defaultFramebufferParameter(GL_DEPTH, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE) ==
+            GL_FLOAT;
+    }
+    if (defaultFramebufferParameter(GL_STENCIL, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE) != GL_NONE)
+        stencilBits =
+            defaultFramebufferParameter(GL_STENCIL, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE);
+
+    // there are no stencil only formats, stencil always comes with a depth attachment
+    if (stencilBits)
+        _settings.renderTargets.append(
+            { bFloatDepth ? TextureFormat::Depth32FStencil8 : TextureFormat::Depth24Stencil8, 0 });
+    else if (bFloatDepth)
+        _settings.renderTargets.append({ TextureFormat::Depth32F, 0 });
+    else if (depthBits > 24)
+        _settings.renderTargets.append({ TextureFormat::Depth32, 0 });
+    else if (depthBits > 16)
+        _settings.renderTargets.append({ TextureFormat::Depth24, 0 });
+    else if (depthBits)
+        _settings.renderTargets.append({ TextureFormat::Depth16, 0 });
+}
+
+Error GLRenderDevice::warmUp(Pipeline * const * _pipelines,
+                             Size _count,
+                             RenderBuffer * _target,
+                             Float64 * _outSeconds)
+{
+    RenderBufferSettings settings;
+    settings.width = 4;
+    settings.height = 4;
+    if (_target)
+    {
+        GLRenderBuffer * target = static_cast<GLRenderBuffer *>(_target);
+        settings.sampleCount = target->m_sampleCount;
+        for (auto & rt : target->m_renderTargets)
+            settings.renderTargets.append({ rt.texture->m_format, 0 });
+    }
+    else
+    {
+        // mirror the default framebuffer
+        GLint samples = 0;
+        ASSERT_NO_GL_ERROR(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+        ASSERT_NO_GL_ERROR(glGetIntegerv(GL_SAMPLES, &samples));
+        settings.sampleCount = samples;
+        defaultFramebufferFormats(settings);
+    }
+
+    auto rb = makeUnique<GLRenderBuffer>(*m_alloc, this);
+    Error err = rb->init(settings);
+    if (err)
+        return err;
+
+    // the draws don't need any vertex data, an empty vao is all we need
+    if (!m_warmUpMesh)
+        m_warmUpMesh = makeUnique<GLMesh>(*m_alloc, this, nullptr, nullptr, 0, nullptr);
+
+    // make sure that pending work does not end up in the first measurement
+    ASSERT_NO_GL_ERROR(glFinish());
+
+    for (Size i = 0; i < _count; ++i)
+    {
+        // compute programs are fully compiled when they are linked and dispatching them would
+        // have side effects, so there is nothing to warm up.
+        const GLPipeline * pipe = static_cast<const GLPipeline *>(_pipelines[i]);
+        if (pipe->m_program->m_bIsCompute)
+        {
+            if (_outSeconds)
+                _outSeconds[i] = 0.0;
+            continue;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        RenderPass * pass = beginPass(RenderPassSettings(rb.get()));
+        pass->setViewport(0, 0, settings.width, settings.height);
+
+        // programs with tessellation stages can only draw patches
+        if (pipe->m_program->m_bHasTessellation)
+            pass->drawMesh(
+                m_warmUpMesh.get(), pipe, 0, pipe->m_patchVertexCount, VertexDrawMode::Patches);
+        else
+            pass->drawMesh(m_warmUpMesh.get(), pipe, 0, 3, VertexDrawMode::Triangles);
+        err = endPass(pass);
+        if (err)
+            break;
+
+        // drivers defer most of the work, glFinish makes sure it actually happened
+        ASSERT_NO_GL_ERROR(glFinish());
+
+        if (_outSeconds)
+            _outSeconds[i] = std::chrono::duration<Float64>(
+                                 std::chrono::high_resolution_clock::now() - start)
+                                 .count();
+    }
+
+    // the render targets of the internal buffer are owned by the device's texture storage
+    rb->deallocate(true);
+    return err;
+}
+
 RenderPass * GLRenderDevice::beginPass(const RenderPassSettings & _settings)
 {
     GLRenderPass * ret;
@@ -571,16 +1282,158 @@ RenderPass * GLRenderDevice::beginPass(const RenderPassSettings & _settings)
     return ret;
 }
 
-static void clearBuffers(const ClearSettings & _clear)
+const RenderStatistics & GLRenderDevice::statistics() const
 {
-    GLuint clearMask = 0;
-    if (_clear.color)
-    {
-        auto & cc = *_clear.color;
-        ASSERT_NO_GL_ERROR(glClearColor(cc.r, cc.g, cc.b, cc.a));
-        clearMask |= GL_COLOR_BUFFER_BIT;
-    }
-    if (_clear.depth)
+    return m_statistics;
+}
+
+void GLRenderDevice::resetStatistics()
+{
+    m_statistics = { 0, 0, 0 };
+}
+
+BufferPoolStatistics GLRenderDevice::bufferPoolStatistics() const
+{
+    BufferPoolStatistics ret;
+    for (const auto & arena : m_vertexArenas)
+        arena->addStatistics(ret);
+    for (const auto & arena : m_indexArenas)
+        arena->addStatistics(ret);
+    return ret;
+}
+
+ContentCacheStatistics GLRenderDevice::contentCacheStatistics() const
+{
+    ContentCacheStatistics ret;
+    for (const auto & content : m_sharedBuffers)
+    {
+        ret.bufferCount++;
+        ret.bufferRefCount += content.refCount;
+        ret.byteCount += content.byteCount;
+        ret.savedByteCount += (content.refCount - 1) * content.byteCount;
+    }
+    for (const auto & content : m_sharedTextures)
+    {
+        ret.textureCount++;
+        ret.textureRefCount += content.refCount;
+        ret.byteCount += content.byteCount;
+        ret.savedByteCount += (content.refCount - 1) * content.byteCount;
+    }
+    return ret;
+}
+
+static Size alignUp(Size _value, Size _alignment)
+{
+    return (_value + _alignment - 1) / _alignment * _alignment;
+}
+
+template <class T>
+static void compactArenas(Allocator & _alloc,
+                          GLBufferArenaArray & _arenas,
+                          DynamicArray<UniquePtr<T>> & _buffers)
+{
+    DynamicArray<T *> arenaBuffers(_alloc);
+    for (Size i = 0; i < _arenas.count();)
+    {
+        GLBufferArena * arena = _arenas[i].get();
+        arenaBuffers.clear();
+        for (auto & buff : _buffers)
+        {
+            if (buff->m_range.arena == arena)
+                arenaBuffers.append(buff.get());
+        }
+
+        // keep one arena around so that the next allocation does not have to create it again
+        if (arenaBuffers.count() == 0 && _arenas.count() > 1)
+        {
+            _arenas.remove(_arenas.begin() + i);
+            continue;
+        }
+
+        std::sort(arenaBuffers.begin(), arenaBuffers.end(), [](const T * _a, const T * _b) {
+            return _a->m_range.byteOffset < _b->m_range.byteOffset;
+        });
+
+        Size cursor = 0;
+        for (T * buff : arenaBuffers)
+        {
+            GLSuballocation & range = buff->m_range;
+            Size dst = alignUp(cursor, range.alignment);
+            if (dst != range.byteOffset)
+            {
+                ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_READ_BUFFER, arena->m_glBuffer));
+                // copies within the same buffer must not overlap, hence go through a temporary
+                // buffer if they do
+                if (dst + range.byteCount > range.byteOffset)
+                {
+                    GLuint tmp;
+                    ASSERT_NO_GL_ERROR(glGenBuffers(1, &tmp));
+                    ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, tmp));
+                    ASSERT_NO_GL_ERROR(glBufferData(
+                        GL_COPY_WRITE_BUFFER, range.byteCount, nullptr, GL_STREAM_COPY));
+                    ASSERT_NO_GL_ERROR(glCopyBufferSubData(GL_COPY_READ_BUFFER,
+                                                           GL_COPY_WRITE_BUFFER,
+                                                           range.byteOffset,
+                                                           0,
+                                                           range.byteCount));
+                    ASSERT_NO_GL_ERROR(glCopyBufferSubData(
+                        GL_COPY_WRITE_BUFFER, GL_COPY_READ_BUFFER, 0, dst, range.byteCount));
+                    glDeleteBuffers(1, &tmp);
+                }
+                else
+                {
+                    ASSERT_NO_GL_ERROR(glCopyBufferSubData(GL_COPY_READ_BUFFER,
+                                                           GL_COPY_READ_BUFFER,
+                                                           range.byteOffset,
+                                                           dst,
+                                                           range.byteCount));
+                }
+                range.byteOffset = dst;
+            }
+            cursor = dst + range.byteCount;
+        }
+
+        arena->reset(cursor, (UInt32)arenaBuffers.count());
+        ++i;
+    }
+}
+
+void GLRenderDevice::compactBufferPools()
+{
+    compactArenas(*m_alloc, m_vertexArenas, m_vertexBuffers);
+    compactArenas(*m_alloc, m_indexArenas, m_indexBuffers);
+}
+
+GLBufferArena * GLRenderDevice::allocateRange(GLBufferArenaArray & _arenas,
+                                              Size _byteCount,
+                                              Size _alignment,
+                                              Size & _outByteOffset)
+{
+    for (auto & arena : _arenas)
+    {
+        if (arena->allocate(_byteCount, _alignment, _outByteOffset))
+            return arena.get();
+    }
+
+    Size arenaByteCount = std::max((Size)BUFFER_ARENA_SIZE, _byteCount + _alignment);
+    _arenas.append(
+        makeUnique<GLBufferArena>(*m_alloc, *m_alloc, arenaByteCount, m_bBufferStorage));
+    bool bAllocated = _arenas.last()->allocate(_byteCount, _alignment, _outByteOffset);
+    STICK_ASSERT(bAllocated);
+    (void)bAllocated;
+    return _arenas.last().get();
+}
+
+static void clearBuffers(const ClearSettings & _clear)
+{
+    GLuint clearMask = 0;
+    if (_clear.color)
+    {
+        auto & cc = *_clear.color;
+        ASSERT_NO_GL_ERROR(glClearColor(cc.r, cc.g, cc.b, cc.a));
+        clearMask |= GL_COLOR_BUFFER_BIT;
+    }
+    if (_clear.depth)
     {
         ASSERT_NO_GL_ERROR(glClearDepth(*_clear.depth));
         clearMask |= GL_DEPTH_BUFFER_BIT;
@@ -611,6 +1464,338 @@ static void bindRenderBufferImpl(GLRenderBuffer * _rb, bool _bMarkDirty)
         ASSERT_NO_GL_ERROR(glBindFramebuffer(GL_FRAMEBUFFER, 0));
 }
 
+// the buffer bindings of a mesh, resolved at draw time
+struct GLMeshBuffers
+{
+    GLsizei count;
+    GLuint buffers[MAX_VERTEX_BINDINGS];
+    GLintptr offsets[MAX_VERTEX_BINDINGS];
+    GLsizei strides[MAX_VERTEX_BINDINGS];
+    const GLVertexBinding * bindings; // the formats, if there are no separate vertex formats
+    GLuint indexBuffer;
+    UInt32 vertexBase; // added to the first vertex/base vertex of each draw
+    UInt32 indexBase;  // added to the first index of each draw
+};
+
+static void resolveMeshBuffers(const GLMesh * _mesh, GLMeshBuffers & _out)
+{
+    // Suballocated vertex data is bound at the start of its arena and addressed through the base
+    // vertex instead, so that consecutive draws of meshes in the same arena don't need any
+    // rebinding. This only works if all bindings are per vertex and start at the same vertex.
+    bool bArenaRelative = _mesh->m_bindings.count() > 0;
+    UInt32 vertexBase = 0;
+    for (Size i = 0; i < _mesh->m_bindings.count(); ++i)
+    {
+        const GLVertexBinding & binding = _mesh->m_bindings[i];
+        const GLSuballocation & range = binding.buffer->m_range;
+        if (!range.arena || binding.divisor || !binding.stride ||
+            range.byteOffset % binding.stride ||
+            (i > 0 && range.byteOffset / binding.stride != vertexBase))
+        {
+            bArenaRelative = false;
+            break;
+        }
+        vertexBase = (UInt32)(range.byteOffset / binding.stride);
+    }
+
+    _out.count = (GLsizei)_mesh->m_bindings.count();
+    _out.bindings = _mesh->m_bindings.ptr();
+    _out.vertexBase = bArenaRelative ? vertexBase : 0;
+    for (Size i = 0; i < _mesh->m_bindings.count(); ++i)
+    {
+        const GLVertexBinding & binding = _mesh->m_bindings[i];
+        _out.buffers[i] = binding.buffer->m_glVertexBuffer;
+        _out.offsets[i] =
+            binding.byteOffset + (bArenaRelative ? 0 : binding.buffer->m_range.byteOffset);
+        _out.strides[i] = binding.stride;
+    }
+
+    _out.indexBuffer = _mesh->m_indexBuffer ? _mesh->m_indexBuffer->m_glIndexBuffer : 0;
+    // the index arenas are aligned to the largest index type, so this is always exact
+    _out.indexBase = _mesh->m_indexBuffer
+                         ? (UInt32)(_mesh->m_indexBuffer->m_range.byteOffset /
+                                    s_dataTypeByteCount[(Size)_mesh->m_indexBuffer->m_indexType])
+                         : 0;
+}
+
+// bind the vertex and index buffers of a mesh to the currently bound vao. _bound are the bindings
+// of the vao, if known.
+static void bindMeshBuffers(const GLRenderDevice * _device,
+                            const GLMeshBuffers & _buffers,
+                            const GLMeshBuffers * _bound)
+{
+    if (_buffers.count &&
+        (!_bound || _bound->count != _buffers.count ||
+         std::memcmp(_bound->buffers, _buffers.buffers, sizeof(GLuint) * _buffers.count) ||
+         std::memcmp(_bound->offsets, _buffers.offsets, sizeof(GLintptr) * _buffers.count) ||
+         std::memcmp(_bound->strides, _buffers.strides, sizeof(GLsizei) * _buffers.count)))
+    {
+        if (_device->m_bMultiBind)
+        {
+            ASSERT_NO_GL_ERROR(glBindVertexBuffers(
+                0, _buffers.count, _buffers.buffers, _buffers.offsets, _buffers.strides));
+        }
+        else if (_device->m_bVertexAttribBinding)
+        {
+            for (GLsizei i = 0; i < _buffers.count; ++i)
+                ASSERT_NO_GL_ERROR(glBindVertexBuffer(
+                    i, _buffers.buffers[i], _buffers.offsets[i], _buffers.strides[i]));
+        }
+        else
+        {
+            // GL 4.1, the attribute pointers capture the buffer bound to GL_ARRAY_BUFFER
+            for (GLsizei i = 0; i < _buffers.count; ++i)
+            {
+                const GLVertexBinding & b = _buffers.bindings[i];
+                ASSERT_NO_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, _buffers.buffers[i]));
+                if (b.bInteger)
+                    ASSERT_NO_GL_ERROR(glVertexAttribIPointer(b.location,
+                                                              b.elementCount,
+                                                              b.glType,
+                                                              _buffers.strides[i],
+                                                              BUFFER_OFFSET(_buffers.offsets[i])));
+                else
+                    ASSERT_NO_GL_ERROR(glVertexAttribPointer(b.location,
+                                                             b.elementCount,
+                                                             b.glType,
+                                                             b.bNormalized ? GL_TRUE : GL_FALSE,
+                                                             _buffers.strides[i],
+                                                             BUFFER_OFFSET(_buffers.offsets[i])));
+            }
+        }
+    }
+    if (_buffers.indexBuffer && (!_bound || _bound->indexBuffer != _buffers.indexBuffer))
+        ASSERT_NO_GL_ERROR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _buffers.indexBuffer));
+}
+
+static void bindProgram(const GLProgram * _program)
+{
+    // a bound program always takes precedence over a bound program pipeline
+    ASSERT_NO_GL_ERROR(glUseProgram(_program->m_glProgram));
+    if (_program->m_glProgramPipeline)
+        ASSERT_NO_GL_ERROR(glBindProgramPipeline(_program->m_glProgramPipeline));
+}
+
+// point towards the correct locations in the uniform buffer. If _lastBindings is provided, only the
+// bindings that changed are updated.
+static void bindUniformBlocks(GLuint _ubo,
+                              const GLUBOBindingArray & _bindings,
+                              const GLUBOBindingArray * _lastBindings)
+{
+    for (UInt32 j = 0; j < _bindings.count(); ++j)
+    {
+        if (!_lastBindings || j >= _lastBindings->count() ||
+            _bindings[j].byteOffset != (*_lastBindings)[j].byteOffset ||
+            _bindings[j].bindingPoint != (*_lastBindings)[j].bindingPoint)
+        {
+            ASSERT_NO_GL_ERROR(glBindBufferRange(GL_UNIFORM_BUFFER,
+                                                 _bindings[j].bindingPoint,
+                                                 _ubo,
+                                                 _bindings[j].byteOffset,
+                                                 _bindings[j].byteCount));
+        }
+    }
+}
+
+// bind all necessary textures. If _lastPipeline is provided, textures that are already bound are
+// not bound again.
+static void bindTextures(const GLPipeline * _pipeline,
+                         const GLPipeline * _lastPipeline,
+                         GLRenderBuffer * _currentRenderBuffer)
+{
+    for (Size i = 0; i < _pipeline->m_textures.count(); ++i)
+    {
+        GLPipelineTexture * tex = _pipeline->m_textures[i].get();
+        GLuint unit = _pipeline->m_program->m_textures[i].unit;
+        if (tex->m_texture)
+        {
+            // if this is a render target, make sure its blit in case its attached to a
+            // MSAA fbo
+            if (tex->m_texture->m_renderBuffer)
+                tex->m_texture->m_renderBuffer->finalizeForReading(_currentRenderBuffer);
+
+            STICK_ASSERT(tex->m_sampler);
+            ASSERT_NO_GL_ERROR(glBindSampler(unit, tex->m_sampler->m_glSampler));
+            if (!_lastPipeline || i >= _lastPipeline->m_textures.count() ||
+                _lastPipeline->m_textures[i].get() != tex)
+            {
+                ASSERT_NO_GL_ERROR(glActiveTexture(GL_TEXTURE0 + unit));
+                ASSERT_NO_GL_ERROR(
+                    glBindTexture(tex->m_texture->m_glTarget, tex->m_texture->m_glTexture));
+            }
+        }
+    }
+}
+
+// bind the shader storage buffers and images of a pipeline
+static void bindStorage(const GLPipeline * _pipeline)
+{
+    const GLProgram * program = _pipeline->m_program;
+    for (Size i = 0; i < _pipeline->m_buffers.count(); ++i)
+    {
+        GLuint glBuffer;
+        Size byteOffset, byteCount;
+        if (!_pipeline->m_buffers[i]->resolve(glBuffer, byteOffset, byteCount))
+            continue;
+
+        GLuint bindingPoint = program->m_storageBlocks[i].bindingPoint;
+        if (byteCount)
+        {
+            ASSERT_NO_GL_ERROR(glBindBufferRange(
+                GL_SHADER_STORAGE_BUFFER, bindingPoint, glBuffer, byteOffset, byteCount));
+        }
+        else
+        {
+            ASSERT_NO_GL_ERROR(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bindingPoint, glBuffer));
+        }
+    }
+
+    for (Size i = 0; i < _pipeline->m_images.count(); ++i)
+    {
+        const GLPipelineImage * img = _pipeline->m_images[i].get();
+        if (!img->m_texture)
+            continue;
+
+        ASSERT_NO_GL_ERROR(glBindImageTexture(
+            program->m_images[i].unit,
+            img->m_texture->m_glTexture,
+            img->m_level,
+            img->m_texture->m_glTarget == GL_TEXTURE_3D,
+            0,
+            s_glImageAccess[static_cast<Size>(img->m_access)],
+            s_glTextureFormats[static_cast<Size>(img->m_texture->m_format)].glInternalFormat));
+    }
+}
+
+static GLbitfield glBarrierBits(UInt32 _barriers)
+{
+    if (_barriers == BarrierAll)
+        return GL_ALL_BARRIER_BITS;
+
+    GLbitfield ret = 0;
+    if (_barriers & BarrierVertexAttributes)
+        ret |= GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT;
+    if (_barriers & BarrierIndices)
+        ret |= GL_ELEMENT_ARRAY_BARRIER_BIT;
+    if (_barriers & BarrierUniforms)
+        ret |= GL_UNIFORM_BARRIER_BIT;
+    if (_barriers & BarrierTextureFetch)
+        ret |= GL_TEXTURE_FETCH_BARRIER_BIT;
+    if (_barriers & BarrierImageAccess)
+        ret |= GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+    if (_barriers & BarrierIndirectCommands)
+        ret |= GL_COMMAND_BARRIER_BIT;
+    if (_barriers & BarrierBufferUpdate)
+        ret |= GL_BUFFER_UPDATE_BARRIER_BIT;
+    if (_barriers & BarrierTextureUpdate)
+        ret |= GL_TEXTURE_UPDATE_BARRIER_BIT;
+    if (_barriers & BarrierFramebuffer)
+        ret |= GL_FRAMEBUFFER_BARRIER_BIT;
+    if (_barriers & BarrierStorageBuffers)
+        ret |= GL_SHADER_STORAGE_BARRIER_BIT;
+    return ret;
+}
+
+// the largest value of _indexType, see PipelineSettings::primitiveRestart
+static GLuint primitiveRestartIndex(DataType _indexType)
+{
+    if (_indexType == DataType::UInt8)
+        return 0xFF;
+    if (_indexType == DataType::UInt16)
+        return 0xFFFF;
+    return s_primitiveRestartIndex;
+}
+
+static void issueDraw(const GLDrawCmd & _cmd,
+                      GLenum _glVertexMode,
+                      UInt32 _vertexBase,
+                      UInt32 _indexBase)
+{
+    const GLMesh * mesh = _cmd.mesh;
+    DataType indexType = mesh->m_indexBuffer ? mesh->m_indexBuffer->m_indexType : DataType::UInt32;
+    GLenum glIndexType = s_glDataTypes[(Size)indexType];
+    if (_cmd.indirectBuffer)
+    {
+        if (mesh->m_indexBuffer)
+        {
+            ASSERT_NO_GL_ERROR(glMultiDrawElementsIndirect(_glVertexMode,
+                                                           glIndexType,
+                                                           BUFFER_OFFSET(_cmd.indirectByteOffset),
+                                                           _cmd.indirectDrawCount,
+                                                           _cmd.indirectStride));
+        }
+        else
+        {
+            ASSERT_NO_GL_ERROR(glMultiDrawArraysIndirect(_glVertexMode,
+                                                         BUFFER_OFFSET(_cmd.indirectByteOffset),
+                                                         _cmd.indirectDrawCount,
+                                                         _cmd.indirectStride));
+        }
+        return;
+    }
+
+    // the base instance variants need GL 4.2, so they are only used if there is a base instance
+    bool bInstanced = _cmd.instanceCount != 1 || _cmd.baseInstance != 0;
+    if (mesh->m_indexBuffer)
+    {
+        Int32 baseVertex = _cmd.baseVertex + (Int32)_vertexBase;
+        const void * indexOffset = BUFFER_OFFSET((Size)s_dataTypeByteCount[(Size)indexType] *
+                                                 (_indexBase + _cmd.vertexOffset));
+        if (_cmd.baseInstance)
+        {
+            ASSERT_NO_GL_ERROR(glDrawElementsInstancedBaseVertexBaseInstance(
+                _glVertexMode,
+                _cmd.vertexCount,
+                glIndexType,
+                indexOffset,
+                _cmd.instanceCount,
+                baseVertex,
+                _cmd.baseInstance));
+        }
+        else if (bInstanced)
+        {
+            ASSERT_NO_GL_ERROR(glDrawElementsInstancedBaseVertex(_glVertexMode,
+                                                                 _cmd.vertexCount,
+                                                                 glIndexType,
+                                                                 indexOffset,
+                                                                 _cmd.instanceCount,
+                                                                 baseVertex));
+        }
+        else if (baseVertex)
+        {
+            ASSERT_NO_GL_ERROR(glDrawElementsBaseVertex(
+                _glVertexMode, _cmd.vertexCount, glIndexType, indexOffset, baseVertex));
+        }
+        else
+        {
+            ASSERT_NO_GL_ERROR(
+                glDrawElements(_glVertexMode, _cmd.vertexCount, glIndexType, indexOffset));
+        }
+    }
+    else if (_cmd.baseInstance)
+    {
+        ASSERT_NO_GL_ERROR(glDrawArraysInstancedBaseInstance(_glVertexMode,
+                                                             mesh->m_firstIndex + _vertexBase +
+                                                                 _cmd.vertexOffset,
+                                                             _cmd.vertexCount,
+                                                             _cmd.instanceCount,
+                                                             _cmd.baseInstance));
+    }
+    else if (bInstanced)
+    {
+        ASSERT_NO_GL_ERROR(glDrawArraysInstanced(_glVertexMode,
+                                                 mesh->m_firstIndex + _vertexBase +
+                                                     _cmd.vertexOffset,
+                                                 _cmd.vertexCount,
+                                                 _cmd.instanceCount));
+    }
+    else
+    {
+        ASSERT_NO_GL_ERROR(glDrawArrays(
+            _glVertexMode, mesh->m_firstIndex + _vertexBase + _cmd.vertexOffset, _cmd.vertexCount));
+    }
+}
+
 stick::Error GLRenderDevice::endPass(RenderPass * _pass)
 {
     GLRenderPass * pass = static_cast<GLRenderPass *>(_pass);
@@ -618,10 +1803,25 @@ stick::Error GLRenderDevice::endPass(RenderPass * _pass)
     ASSERT_NO_GL_ERROR(glBindBuffer(GL_UNIFORM_BUFFER, pass->m_ubo));
     ASSERT_NO_GL_ERROR(glUnmapBuffer(GL_UNIFORM_BUFFER));
 
+    if (pass->m_drawData.count())
+    {
+        ASSERT_NO_GL_ERROR(glBindBuffer(GL_SHADER_STORAGE_BUFFER, pass->m_drawDataBuffer));
+        ASSERT_NO_GL_ERROR(glBufferData(GL_SHADER_STORAGE_BUFFER,
+                                        pass->m_drawData.count(),
+                                        pass->m_drawData.ptr(),
+                                        GL_STREAM_DRAW));
+    }
+
     Maybe<GLDrawCmd> lastDrawCall;
 
     bindRenderBufferImpl(pass->m_renderBuffer, true);
     bool bScissorSetByCmd = false;
+    GLint patchVertexCount = 0; // 0 means unknown
+    // the uniform and draw data buffers are owned by the pass, so the bindings of draws from
+    // previous passes can't be reused
+    bool bFirstDraw = true;
+    const GLVertexPool * boundPool = nullptr; // the pool whose storage buffers are bound
+    GLMeshBuffers meshBuffers; // the buffers of the last drawn mesh
     Error err;
 
     for (auto & cmd : pass->m_commands)
@@ -648,8 +1848,9 @@ stick::Error GLRenderDevice::endPass(RenderPass * _pass)
             const GLProgram * program = pipeline->m_program;
             const GLMesh * mesh = (*mdc).mesh;
 
-            if (!m_lastDrawCall || (*m_lastDrawCall).pipeline->m_program != program)
-                ASSERT_NO_GL_ERROR(glUseProgram(program->m_glProgram));
+            const GLPipeline * lastPipeline = m_lastDrawCall ? (*m_lastDrawCall).pipeline : nullptr;
+            if (!lastPipeline || lastPipeline->m_program != program)
+                bindProgram(program);
 
             UInt64 diffMask = m_lastDrawCall
                                   ? differenceMask(m_lastRenderState, pipeline->m_renderState)
@@ -795,75 +1996,121 @@ stick::Error GLRenderDevice::endPass(RenderPass * _pass)
                 }
             }
 
-            // point towards the correct locations in the uniform buffer
-            for (UInt32 j = 0; j < (*mdc).uboBindings.count(); ++j)
+            bindUniformBlocks(pass->m_ubo,
+                              (*mdc).uboBindings,
+                              m_lastDrawCall && !bFirstDraw ? &(*m_lastDrawCall).uboBindings
+                                                            : nullptr);
+            bindTextures(pipeline, lastPipeline, pass->m_renderBuffer);
+            if (lastPipeline != pipeline || bFirstDraw)
             {
-                if (!m_lastDrawCall || j >= (*m_lastDrawCall).uboBindings.count() ||
-                    (*mdc).uboBindings[j].byteOffset != (*m_lastDrawCall).uboBindings[j].byteOffset)
+                boundPool = nullptr;
+                bindStorage(pipeline);
+                if (pipeline->m_drawDataBlock >= 0)
                 {
-                    ASSERT_NO_GL_ERROR(glBindBufferRange(GL_UNIFORM_BUFFER,
-                                                         (*mdc).uboBindings[j].bindingPoint,
-                                                         pass->m_ubo,
-                                                         (*mdc).uboBindings[j].byteOffset,
-                                                         (*mdc).uboBindings[j].byteCount));
+                    ASSERT_NO_GL_ERROR(glBindBufferBase(
+                        GL_SHADER_STORAGE_BUFFER,
+                        program->m_storageBlocks[pipeline->m_drawDataBlock].bindingPoint,
+                        pass->m_drawDataBuffer));
                 }
             }
 
-            // bind all necessary textures
-            for (Size i = 0; i < pipeline->m_textures.count(); ++i)
+            // pool meshes only require a rebind if the pool changes
+            if (mesh->m_pool && mesh->m_pool != boundPool)
             {
-                GLPipelineTexture * tex = pipeline->m_textures[i].get();
-                if (tex->m_texture)
-                {
-                    // if this is a render target, make sure its blit in case its attached to a
-                    // MSAA fbo
-                    if (tex->m_texture->m_renderBuffer)
-                        tex->m_texture->m_renderBuffer->finalizeForReading(pass->m_renderBuffer);
-
-                    STICK_ASSERT(tex->m_sampler);
-                    ASSERT_NO_GL_ERROR(glBindSampler((GLuint)i, tex->m_sampler->m_glSampler));
-                    if (!m_lastDrawCall || (*m_lastDrawCall).pipeline->m_textures[i].get() != tex)
-                    {
-                        ASSERT_NO_GL_ERROR(glActiveTexture(GL_TEXTURE0 + (GLuint)i));
-                        ASSERT_NO_GL_ERROR(
-                            glBindTexture(tex->m_texture->m_glTarget, tex->m_texture->m_glTexture));
-                    }
-                }
+                STICK_ASSERT(program->m_vertexPoolVerticesBlock >= 0 &&
+                             program->m_vertexPoolIndicesBlock >= 0);
+                ASSERT_NO_GL_ERROR(glBindBufferBase(
+                    GL_SHADER_STORAGE_BUFFER,
+                    program->m_storageBlocks[program->m_vertexPoolVerticesBlock].bindingPoint,
+                    mesh->m_pool->m_glVertexBuffer));
+                ASSERT_NO_GL_ERROR(glBindBufferBase(
+                    GL_SHADER_STORAGE_BUFFER,
+                    program->m_storageBlocks[program->m_vertexPoolIndicesBlock].bindingPoint,
+                    mesh->m_pool->m_glIndexBuffer));
+                boundPool = mesh->m_pool;
+            }
+
+            if ((*mdc).drawMode == VertexDrawMode::Patches &&
+                patchVertexCount != (GLint)pipeline->m_patchVertexCount)
+            {
+                patchVertexCount = pipeline->m_patchVertexCount;
+                ASSERT_NO_GL_ERROR(glPatchParameteri(GL_PATCH_VERTICES, patchVertexCount));
             }
 
-            // draw the mesh
-            ASSERT_NO_GL_ERROR(glBindVertexArray(mesh->m_glVao));
+            // draw the mesh. Meshes with the same layout share their vao, so only the buffers have
+            // to be switched.
+            const GLMesh * lastMesh = m_lastDrawCall && !bFirstDraw ? (*m_lastDrawCall).mesh : nullptr;
+            if (lastMesh != mesh)
+            {
+                bool bVaoChanged = !lastMesh || lastMesh->m_glVao != mesh->m_glVao;
+                if (bVaoChanged)
+                    ASSERT_NO_GL_ERROR(glBindVertexArray(mesh->m_glVao));
+                GLMeshBuffers next;
+                resolveMeshBuffers(mesh, next);
+                bindMeshBuffers(this, next, bVaoChanged ? nullptr : &meshBuffers);
+                meshBuffers = next;
+            }
             GLenum glVertexMode = s_glVertexDrawModes[static_cast<Size>((*mdc).drawMode)];
 
-            if (mesh->m_indexBuffer)
+            // GL_PRIMITIVE_RESTART_FIXED_INDEX needs GL 4.3, so the index is set explicitly
+            bool bRestart = isFlagSet(pipeline->m_renderState, RF_PrimitiveRestart);
+            if (bRestart != m_bPrimitiveRestart)
             {
-                if ((*mdc).baseVertex)
+                if (bRestart)
                 {
-                    ASSERT_NO_GL_ERROR(glDrawElementsBaseVertex(
-                        glVertexMode,
-                        (*mdc).vertexCount,
-                        GL_UNSIGNED_INT,
-                        BUFFER_OFFSET(sizeof(GLuint) * (*mdc).vertexOffset),
-                        (*mdc).baseVertex));
+                    ASSERT_NO_GL_ERROR(glEnable(GL_PRIMITIVE_RESTART));
                 }
                 else
                 {
-                    ASSERT_NO_GL_ERROR(
-                        glDrawElements(glVertexMode,
-                                       (*mdc).vertexCount,
-                                       GL_UNSIGNED_INT,
-                                       BUFFER_OFFSET(sizeof(GLuint) * (*mdc).vertexOffset)));
+                    ASSERT_NO_GL_ERROR(glDisable(GL_PRIMITIVE_RESTART));
                 }
+                m_bPrimitiveRestart = bRestart;
             }
-            else
+            if (bRestart && mesh->m_indexBuffer)
             {
-                ASSERT_NO_GL_ERROR(
-                    glDrawArrays(glVertexMode, (*mdc).vertexOffset, (*mdc).vertexCount));
+                GLuint restartIndex = primitiveRestartIndex(mesh->m_indexBuffer->m_indexType);
+                if (restartIndex != m_primitiveRestartIndex)
+                {
+                    ASSERT_NO_GL_ERROR(glPrimitiveRestartIndex(restartIndex));
+                    m_primitiveRestartIndex = restartIndex;
+                }
+            }
+
+            if ((*mdc).indirectBuffer)
+            {
+                // binding the indirect buffer is cheap enough that we don't track it
+                ASSERT_NO_GL_ERROR(glBindBuffer(GL_DRAW_INDIRECT_BUFFER,
+                                                (*mdc).indirectBuffer->m_glStorageBuffer));
             }
+            if ((*mdc).baseInstance && !m_bBaseInstance)
+                return Error(ec::InvalidOperation,
+                             "Base instances require GL 4.2 or ARB_base_instance",
+                             STICK_FILE,
+                             STICK_LINE);
+            issueDraw(*mdc, glVertexMode, meshBuffers.vertexBase, meshBuffers.indexBase);
+            m_statistics.issuedDrawCount++;
+            bFirstDraw = false;
 
             m_lastDrawCall = *mdc;
             m_lastRenderState = (*m_lastDrawCall).pipeline->m_renderState;
         }
+        else if (auto mdc = cmd.maybe<GLDispatchCmd>())
+        {
+            const GLPipeline * pipeline = (*mdc).pipeline;
+            bindProgram(pipeline->m_program);
+            bindUniformBlocks(pass->m_ubo, (*mdc).uboBindings, nullptr);
+            bindTextures(pipeline, nullptr, pass->m_renderBuffer);
+            bindStorage(pipeline);
+            ASSERT_NO_GL_ERROR(glDispatchCompute((*mdc).x, (*mdc).y, (*mdc).z));
+
+            // the dispatch changed the program and resource bindings, the next draw call has to
+            // rebind them.
+            m_lastDrawCall.reset();
+        }
+        else if (auto mbc = cmd.maybe<GLMemoryBarrierCmd>())
+        {
+            ASSERT_NO_GL_ERROR(glMemoryBarrier((*mbc).barriers));
+        }
         else if (auto mdc = cmd.maybe<GLExternalDrawCmd>())
         {
             err = (*mdc).fn();
@@ -877,12 +2124,20 @@ stick::Error GLRenderDevice::endPass(RenderPass * _pass)
             // for the following draw call as there is no way for us to know hat the external
             // draw command changed regarding the opengl state.
             m_lastDrawCall.reset();
+            patchVertexCount = 0;
         }
     }
 
     if (bScissorSetByCmd)
         ASSERT_NO_GL_ERROR(glDisable(GL_SCISSOR_TEST));
 
+    // fence the submission so that multi-buffered buffers and transient geometry know when the GPU
+    // is done with it
+    UInt64 serial = insertSubmitFence();
+    if (m_transientAllocator)
+        m_transientAllocator->submit(pass, serial);
+    pollSubmitFences();
+
     pass->reset();
     m_renderPassFreeList.append(pass);
 
@@ -897,62 +2152,82 @@ void GLRenderDevice::readPixels(
     ASSERT_NO_GL_ERROR(glReadPixels(_x, _y, _w, _h, fmt.glFormat, fmt.glDataType, _outData));
 }
 
-GLProgram::GLProgram()
-{
-}
-
-Error GLProgram::init(Allocator & _alloc, const char * _vertexShader, const char * _pixelShader)
+static bool isImageType(GLenum _type)
 {
-    GLuint vertexShader, pixelShader;
-    Error err = compileShader(_vertexShader, GL_VERTEX_SHADER, vertexShader);
-    if (!err)
-        err = compileShader(_pixelShader, GL_FRAGMENT_SHADER, pixelShader);
-    if (err)
-        return err;
-
-    GLuint program = glCreateProgram();
-    ASSERT_NO_GL_ERROR(glAttachShader(program, vertexShader));
-    ASSERT_NO_GL_ERROR(glAttachShader(program, pixelShader));
-    ASSERT_NO_GL_ERROR(glLinkProgram(program));
-
-    // check if we had success
-    GLint state;
-    ASSERT_NO_GL_ERROR(glGetProgramiv(program, GL_LINK_STATUS, &state));
-
-    if (state == GL_FALSE)
+    switch (_type)
     {
-        char str[2048] = { 0 };
-        GLint infologLength = 1024;
-        ASSERT_NO_GL_ERROR(glGetProgramInfoLog(program, infologLength, &infologLength, str));
-
-        err = Error(ec::InvalidOperation,
-                    String::concat("Error linking GLSL program: ", str),
-                    STICK_FILE,
-                    STICK_LINE);
+    case GL_IMAGE_1D:
+    case GL_IMAGE_2D:
+    case GL_IMAGE_3D:
+    case GL_INT_IMAGE_1D:
+    case GL_INT_IMAGE_2D:
+    case GL_INT_IMAGE_3D:
+    case GL_UNSIGNED_INT_IMAGE_1D:
+    case GL_UNSIGNED_INT_IMAGE_2D:
+    case GL_UNSIGNED_INT_IMAGE_3D:
+        return true;
+    default:
+        return false;
     }
+}
 
-    ASSERT_NO_GL_ERROR(glDeleteShader(vertexShader));
-    ASSERT_NO_GL_ERROR(glDeleteShader(pixelShader));
-
-    if (err)
+static GLUniformType uniformType(GLenum _type, GLuint & _outByteCount)
+{
+    switch (_type)
     {
-        glDeleteProgram(program);
-        return err;
+    case GL_FLOAT:
+        _outByteCount = 4;
+        return GLUniformType::Float32;
+    case GL_INT:
+        _outByteCount = 4;
+        return GLUniformType::Int32;
+    case GL_FLOAT_VEC2:
+        _outByteCount = 8;
+        return GLUniformType::Vec2;
+    case GL_FLOAT_VEC3:
+        _outByteCount = 12;
+        return GLUniformType::Vec3;
+    case GL_FLOAT_VEC4:
+        _outByteCount = 16;
+        return GLUniformType::Vec4;
+    case GL_FLOAT_MAT3:
+        _outByteCount = 36;
+        return GLUniformType::Mat3;
+    case GL_FLOAT_MAT4:
+        _outByteCount = 64;
+        return GLUniformType::Mat4;
+    default:
+        //@TODO: Error;
+        _outByteCount = 0;
+        return GLUniformType::None;
     }
+}
 
+// collects the uniform blocks, textures, storage blocks and images of a linked program. Blocks are
+// bound to their block index, textures and images to the unit matching their index in the
+// respective output array. Storage blocks are only reflected if _bStorageReflection is set, the
+// program interface queries need GL 4.3.
+static void reflectProgram(Allocator & _alloc,
+                           GLuint _program,
+                           bool _bStorageReflection,
+                           GLUniformBlockArray & _outBlocks,
+                           GLTextureBindingArray & _outTextures,
+                           GLStorageBlockBindingArray & _outStorageBlocks,
+                           GLImageBindingArray & _outImages)
+{
     GLint numBlocks;
-    ASSERT_NO_GL_ERROR(glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &numBlocks));
+    ASSERT_NO_GL_ERROR(glGetProgramiv(_program, GL_ACTIVE_UNIFORM_BLOCKS, &numBlocks));
 
     GLint alignment;
     glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
 
-    // GLuint index = glGetUniformBlockIndex(program, "Constants");
+    // GLuint index = glGetUniformBlockIndex(_program, "Constants");
     char nameBuffer[128] = { 0 };
     for (int blockIdx = 0; blockIdx < numBlocks; ++blockIdx)
     {
         GLUniformBlock block;
         std::memset(nameBuffer, 0, 128);
-        ASSERT_NO_GL_ERROR(glGetActiveUniformBlockName(program, blockIdx, 128, NULL, nameBuffer));
+        ASSERT_NO_GL_ERROR(glGetActiveUniformBlockName(_program, blockIdx, 128, NULL, nameBuffer));
         //@TODO String allocator
         block.name = String(nameBuffer);
         // block.tmpStorage = { 0 };
@@ -961,15 +2236,15 @@ Error GLProgram::init(Allocator & _alloc, const char * _vertexShader, const char
         block.bindingPoint = blockIdx;
         // block.lastFrameID = 0;
 
-        ASSERT_NO_GL_ERROR(glUniformBlockBinding(program, blockIdx, block.bindingPoint));
+        ASSERT_NO_GL_ERROR(glUniformBlockBinding(_program, blockIdx, block.bindingPoint));
 
         int activeUniformsInBlock;
         ASSERT_NO_GL_ERROR(glGetActiveUniformBlockiv(
-            program, blockIdx, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &activeUniformsInBlock));
+            _program, blockIdx, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &activeUniformsInBlock));
 
         GLint indices[32];
         ASSERT_NO_GL_ERROR(glGetActiveUniformBlockiv(
-            program, blockIdx, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indices));
+            _program, blockIdx, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indices));
         std::memset(nameBuffer, 0, 128);
         GLint size;
         GLint type;
@@ -980,55 +2255,16 @@ Error GLProgram::init(Allocator & _alloc, const char * _vertexShader, const char
         {
             const UInt32 & idx = (UInt32)indices[i];
 
-            ASSERT_NO_GL_ERROR(glGetActiveUniformName(program, idx, 128, 0, nameBuffer));
-            ASSERT_NO_GL_ERROR(glGetActiveUniformsiv(program, 1, &idx, GL_UNIFORM_TYPE, &type));
-            ASSERT_NO_GL_ERROR(glGetActiveUniformsiv(program, 1, &idx, GL_UNIFORM_OFFSET, &offset));
-            ASSERT_NO_GL_ERROR(glGetActiveUniformsiv(program, 1, &idx, GL_UNIFORM_SIZE, &size));
+            ASSERT_NO_GL_ERROR(glGetActiveUniformName(_program, idx, 128, 0, nameBuffer));
+            ASSERT_NO_GL_ERROR(glGetActiveUniformsiv(_program, 1, &idx, GL_UNIFORM_TYPE, &type));
+            ASSERT_NO_GL_ERROR(glGetActiveUniformsiv(_program, 1, &idx, GL_UNIFORM_OFFSET, &offset));
+            ASSERT_NO_GL_ERROR(glGetActiveUniformsiv(_program, 1, &idx, GL_UNIFORM_SIZE, &size));
 
             // we don't support arrays for now.
             STICK_ASSERT(size == 1);
 
-            // determine the type
-            if (type == GL_FLOAT)
-            {
-                mt = GLUniformType::Float32;
-                byteCount = 4;
-            }
-            else if (type == GL_INT)
-            {
-                mt = GLUniformType::Int32;
-                byteCount = 4;
-            }
-            else if (type == GL_FLOAT_VEC2)
-            {
-                mt = GLUniformType::Vec2;
-                byteCount = 8;
-            }
-            else if (type == GL_FLOAT_VEC3)
-            {
-                mt = GLUniformType::Vec3;
-                byteCount = 12;
-            }
-            else if (type == GL_FLOAT_VEC4)
-            {
-                mt = GLUniformType::Vec4;
-                byteCount = 16;
-            }
-            else if (type == GL_FLOAT_MAT3)
-            {
-                mt = GLUniformType::Mat3;
-                byteCount = 36;
-            }
-            else if (type == GL_FLOAT_MAT4)
-            {
-                mt = GLUniformType::Mat4;
-                byteCount = 64;
-            }
-            else
-            {
-                //@TODO: Error;
-            }
-            // ASSERT_NO_GL_ERROR(glGetActiveUniform(program, index, 512, &len, &size, &type,
+            mt = uniformType(type, byteCount);
+            // ASSERT_NO_GL_ERROR(glGetActiveUniform(_program, index, 512, &len, &size, &type,
             // nameBuffer));
 
             block.uniforms.append({ String(nameBuffer), (GLuint)offset, mt });
@@ -1037,48 +2273,354 @@ Error GLProgram::init(Allocator & _alloc, const char * _vertexShader, const char
             if (i == activeUniformsInBlock - 1)
                 block.byteCount += byteCount;
         }
-        m_uniformBlocks.append(std::move(block));
+        _outBlocks.append(std::move(block));
     }
 
     // grag the texture uniforms
     // check what uniforms are active
     GLint uniformCount;
-    ASSERT_NO_GL_ERROR(glUseProgram(program));
-    ASSERT_NO_GL_ERROR(glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount));
+    ASSERT_NO_GL_ERROR(glGetProgramiv(_program, GL_ACTIVE_UNIFORMS, &uniformCount));
     for (GLint i = 0; i < uniformCount; ++i)
     {
         char nameBuffer[512] = { 0 };
         GLsizei len, size;
         GLenum type;
-        ASSERT_NO_GL_ERROR(glGetActiveUniform(program, i, 512, &len, &size, &type, nameBuffer));
-        GLuint loc = glGetUniformLocation(program, nameBuffer);
+        ASSERT_NO_GL_ERROR(glGetActiveUniform(_program, i, 512, &len, &size, &type, nameBuffer));
+        GLuint loc = glGetUniformLocation(_program, nameBuffer);
 
         // ignore everything but samples
         if (type == GL_SAMPLER_1D || type == GL_SAMPLER_2D || type == GL_SAMPLER_3D)
         {
-            m_textures.append({ String(nameBuffer, _alloc), loc });
-            ASSERT_NO_GL_ERROR(glUniform1i(loc, m_textures.count() - 1));
+            GLuint unit = (GLuint)_outTextures.count();
+            _outTextures.append({ String(nameBuffer, _alloc), loc, unit });
+            ASSERT_NO_GL_ERROR(glProgramUniform1i(_program, loc, unit));
+        }
+        else if (isImageType(type))
+        {
+            GLuint unit = (GLuint)_outImages.count();
+            _outImages.append({ String(nameBuffer, _alloc), loc, unit });
+            ASSERT_NO_GL_ERROR(glProgramUniform1i(_program, loc, unit));
         }
     }
 
-    m_glProgram = program;
-    return Error();
-}
+    if (!_bStorageReflection)
+        return;
 
-GLProgram::~GLProgram()
-{
-    glDeleteProgram(m_glProgram);
-}
+    GLint storageBlockCount;
+    ASSERT_NO_GL_ERROR(glGetProgramInterfaceiv(
+        _program, GL_SHADER_STORAGE_BLOCK, GL_ACTIVE_RESOURCES, &storageBlockCount));
+    for (GLint i = 0; i < storageBlockCount; ++i)
+    {
+        std::memset(nameBuffer, 0, 128);
+        ASSERT_NO_GL_ERROR(
+            glGetProgramResourceName(_program, GL_SHADER_STORAGE_BLOCK, i, 128, NULL, nameBuffer));
+        ASSERT_NO_GL_ERROR(glShaderStorageBlockBinding(_program, i, i));
+        _outStorageBlocks.append({ String(nameBuffer, _alloc), (UInt32)i, 0 });
+    }
 
-GLPipeline::GLPipeline(Allocator & _alloc, const PipelineSettings & _settings) :
-    m_program(nullptr),
-    m_renderState(0),
-    m_scissorRect({ 0, 0, 0, 0 }),
-    m_viewportRect({ 0, 0, 0, 0 }),
-    m_bChangedSinceLastDrawCall(true),
-    m_variables(_alloc),
+    // collect the element layout of blocks that are made of an unsized array. The names of the
+    // members are stripped of the array, i.e. drawData[0].color becomes color.
+    GLint bufferVariableCount;
+    ASSERT_NO_GL_ERROR(glGetProgramInterfaceiv(
+        _program, GL_BUFFER_VARIABLE, GL_ACTIVE_RESOURCES, &bufferVariableCount));
+    for (GLint i = 0; i < bufferVariableCount; ++i)
+    {
+        const GLenum props[] = {
+            GL_BLOCK_INDEX, GL_OFFSET, GL_TYPE, GL_TOP_LEVEL_ARRAY_SIZE, GL_TOP_LEVEL_ARRAY_STRIDE
+        };
+        GLint values[5];
+        ASSERT_NO_GL_ERROR(
+            glGetProgramResourceiv(_program, GL_BUFFER_VARIABLE, i, 5, props, 5, NULL, values));
+        if (values[3] != 0 || values[0] < 0 || values[0] >= storageBlockCount)
+            continue;
+
+        std::memset(nameBuffer, 0, 128);
+        ASSERT_NO_GL_ERROR(
+            glGetProgramResourceName(_program, GL_BUFFER_VARIABLE, i, 128, NULL, nameBuffer));
+        const char * memberName = std::strstr(nameBuffer, "].");
+        if (memberName)
+            memberName += 2;
+        else
+        {
+            char * bracket = std::strchr(nameBuffer, '[');
+            if (bracket)
+                *bracket = 0;
+            memberName = nameBuffer;
+        }
+
+        GLuint byteCount;
+        GLStorageBlockBinding & blk = _outStorageBlocks[values[0]];
+        blk.arrayStride = values[4];
+        blk.members.append({ String(memberName, _alloc),
+                             (GLuint)values[1],
+                             uniformType((GLenum)values[2], byteCount) });
+    }
+}
+
+GLProgram::GLProgram() :
+    m_glProgram(0),
+    m_glProgramPipeline(0),
+    m_bHasTessellation(false),
+    m_bIsCompute(false),
+    m_vertexPoolVerticesBlock(-1),
+    m_vertexPoolIndicesBlock(-1)
+{
+}
+
+void GLProgram::findVertexPoolBlocks()
+{
+    for (Size i = 0; i < m_storageBlocks.count(); ++i)
+    {
+        if (m_storageBlocks[i].name == "DabVertexPoolVertices")
+            m_vertexPoolVerticesBlock = (Int32)i;
+        else if (m_storageBlocks[i].name == "DabVertexPoolIndices")
+            m_vertexPoolIndicesBlock = (Int32)i;
+    }
+}
+
+Error GLProgram::init(Allocator & _alloc, const char * const * _sources, bool _bStorageReflection)
+{
+    GLuint shaders[(Size)ShaderStage::Count] = { 0 };
+    Error err;
+    for (Size i = 0; i < (Size)ShaderStage::Count && !err; ++i)
+    {
+        if (_sources[i])
+            err = compileShader(_sources[i], s_glShaderStages[i], shaders[i]);
+    }
+
+    GLuint program = 0;
+    if (!err)
+    {
+        program = glCreateProgram();
+        for (GLuint shader : shaders)
+        {
+            if (shader)
+                ASSERT_NO_GL_ERROR(glAttachShader(program, shader));
+        }
+        ASSERT_NO_GL_ERROR(glLinkProgram(program));
+    }
+
+    for (GLuint shader : shaders)
+    {
+        if (shader)
+            ASSERT_NO_GL_ERROR(glDeleteShader(shader));
+    }
+
+    if (err)
+        return err;
+
+    // check if we had success
+    GLint state;
+    ASSERT_NO_GL_ERROR(glGetProgramiv(program, GL_LINK_STATUS, &state));
+
+    if (state == GL_FALSE)
+    {
+        char str[2048] = { 0 };
+        GLint infologLength = 1024;
+        ASSERT_NO_GL_ERROR(glGetProgramInfoLog(program, infologLength, &infologLength, str));
+
+        err = Error(ec::InvalidOperation,
+                    String::concat("Error linking GLSL program: ", str),
+                    STICK_FILE,
+                    STICK_LINE);
+    }
+
+    if (err)
+    {
+        glDeleteProgram(program);
+        return err;
+    }
+
+    reflectProgram(_alloc,
+                   program,
+                   _bStorageReflection,
+                   m_uniformBlocks,
+                   m_textures,
+                   m_storageBlocks,
+                   m_images);
+    m_glProgram = program;
+    m_bHasTessellation = _sources[(Size)ShaderStage::TessellationEvaluation] != nullptr;
+    m_bIsCompute = _sources[(Size)ShaderStage::Compute] != nullptr;
+    findVertexPoolBlocks();
+    return Error();
+}
+
+Error GLProgram::init(Allocator & _alloc, Shader * const * _stages, Size _count)
+{
+    ASSERT_NO_GL_ERROR(glGenProgramPipelines(1, &m_glProgramPipeline));
+
+    bool bHasVertexStage = false;
+    for (Size i = 0; i < _count; ++i)
+    {
+        GLShader * stage = static_cast<GLShader *>(_stages[i]);
+        bHasVertexStage |= stage->m_stage == ShaderStage::Vertex;
+        m_bHasTessellation |= stage->m_stage == ShaderStage::TessellationEvaluation;
+        m_bIsCompute |= stage->m_stage == ShaderStage::Compute;
+        ASSERT_NO_GL_ERROR(glUseProgramStages(m_glProgramPipeline,
+                                              s_glShaderStageBits[static_cast<Size>(stage->m_stage)],
+                                              stage->m_glProgram));
+
+        // merge the reflection of all stages. Blocks and textures with the same name share the
+        // same binding point/unit across all stages (see GLRenderDevice::separableBinding)
+        for (auto & blk : stage->m_uniformBlocks)
+        {
+            auto it = std::find_if(m_uniformBlocks.begin(),
+                                   m_uniformBlocks.end(),
+                                   [&blk](const GLUniformBlock & _b) { return _b.name == blk.name; });
+            if (it == m_uniformBlocks.end())
+                m_uniformBlocks.append(blk);
+        }
+
+        for (auto & tex : stage->m_textures)
+        {
+            auto it = std::find_if(m_textures.begin(),
+                                   m_textures.end(),
+                                   [&tex](const GLTextureBinding & _t) { return _t.name == tex.name; });
+            if (it == m_textures.end())
+                m_textures.append(tex);
+        }
+
+        for (auto & blk : stage->m_storageBlocks)
+        {
+            auto it = std::find_if(
+                m_storageBlocks.begin(),
+                m_storageBlocks.end(),
+                [&blk](const GLStorageBlockBinding & _b) { return _b.name == blk.name; });
+            if (it == m_storageBlocks.end())
+                m_storageBlocks.append(blk);
+        }
+
+        for (auto & img : stage->m_images)
+        {
+            auto it = std::find_if(m_images.begin(),
+                                   m_images.end(),
+                                   [&img](const GLImageBinding & _i) { return _i.name == img.name; });
+            if (it == m_images.end())
+                m_images.append(img);
+        }
+    }
+
+    if (bHasVertexStage == m_bIsCompute)
+        return Error(ec::InvalidOperation,
+                     "A separable program requires either a vertex or a compute stage",
+                     STICK_FILE,
+                     STICK_LINE);
+
+    findVertexPoolBlocks();
+    return Error();
+}
+
+GLProgram::~GLProgram()
+{
+    glDeleteProgram(m_glProgram);
+    if (m_glProgramPipeline)
+        glDeleteProgramPipelines(1, &m_glProgramPipeline);
+}
+
+GLShader::GLShader() : m_glProgram(0)
+{
+}
+
+Error GLShader::init(GLRenderDevice * _device, ShaderStage _stage, const char * _code)
+{
+    m_stage = _stage;
+    m_uniformBlocks = GLUniformBlockArray(*_device->m_alloc);
+    m_textures = GLTextureBindingArray(*_device->m_alloc);
+    m_storageBlocks = GLStorageBlockBindingArray(*_device->m_alloc);
+    m_images = GLImageBindingArray(*_device->m_alloc);
+
+    GLuint program =
+        glCreateShaderProgramv(s_glShaderStages[static_cast<Size>(_stage)], 1, &_code);
+
+    GLint state;
+    ASSERT_NO_GL_ERROR(glGetProgramiv(program, GL_LINK_STATUS, &state));
+    if (state == GL_FALSE)
+    {
+        char str[2048] = { 0 };
+        GLint infologLength = 1024;
+        ASSERT_NO_GL_ERROR(glGetProgramInfoLog(program, infologLength, &infologLength, str));
+        glDeleteProgram(program);
+
+        return Error(ec::InvalidOperation,
+                     String::concat("Error compiling separable GLSL stage: ", str),
+                     STICK_FILE,
+                     STICK_LINE);
+    }
+
+    reflectProgram(*_device->m_alloc,
+                   program,
+                   _device->m_bComputeShaders,
+                   m_uniformBlocks,
+                   m_textures,
+                   m_storageBlocks,
+                   m_images);
+    m_glProgram = program;
+
+    // reflectProgram binds blocks and textures to their index. Since stages are shared between
+    // programs, we instead assign device wide binding points based on the name.
+    for (Size i = 0; i < m_uniformBlocks.count(); ++i)
+    {
+        auto & blk = m_uniformBlocks[i];
+        auto res = _device->separableBinding(
+            _device->m_separableBlockNames, blk.name, _device->m_maxUniformBufferBindings);
+        if (res.error())
+            return res.error();
+        blk.bindingPoint = res.get();
+        ASSERT_NO_GL_ERROR(glUniformBlockBinding(program, (GLuint)i, blk.bindingPoint));
+    }
+
+    for (auto & tex : m_textures)
+    {
+        auto res = _device->separableBinding(
+            _device->m_separableTextureNames, tex.name, _device->m_maxTextureUnits);
+        if (res.error())
+            return res.error();
+        tex.unit = res.get();
+        ASSERT_NO_GL_ERROR(glProgramUniform1i(program, tex.location, tex.unit));
+    }
+
+    for (Size i = 0; i < m_storageBlocks.count(); ++i)
+    {
+        auto & blk = m_storageBlocks[i];
+        auto res = _device->separableBinding(
+            _device->m_separableStorageBlockNames, blk.name, _device->m_maxStorageBufferBindings);
+        if (res.error())
+            return res.error();
+        blk.bindingPoint = res.get();
+        ASSERT_NO_GL_ERROR(glShaderStorageBlockBinding(program, (GLuint)i, blk.bindingPoint));
+    }
+
+    for (auto & img : m_images)
+    {
+        auto res = _device->separableBinding(
+            _device->m_separableImageNames, img.name, _device->m_maxImageUnits);
+        if (res.error())
+            return res.error();
+        img.unit = res.get();
+        ASSERT_NO_GL_ERROR(glProgramUniform1i(program, img.location, img.unit));
+    }
+
+    return Error();
+}
+
+GLShader::~GLShader()
+{
+    glDeleteProgram(m_glProgram);
+}
+
+GLPipeline::GLPipeline(Allocator & _alloc, const PipelineSettings & _settings) :
+    m_program(nullptr),
+    m_renderState(0),
+    m_scissorRect({ 0, 0, 0, 0 }),
+    m_viewportRect({ 0, 0, 0, 0 }),
+    m_patchVertexCount(_settings.patchVertexCount),
+    m_bChangedSinceLastDrawCall(true),
+    m_variables(_alloc),
     m_textures(_alloc),
-    m_uniformBlockStorage(_alloc)
+    m_buffers(_alloc),
+    m_images(_alloc),
+    m_uniformBlockStorage(_alloc),
+    m_drawDataBlock(-1)
 {
     UInt64 renderState = 0;
 
@@ -1092,6 +2634,7 @@ GLPipeline::GLPipeline(Allocator & _alloc, const PipelineSettings & _settings) :
     setFlag(renderState, RF_ColorWriteAlpha, _settings.colorWriteSettings.a);
     setFlag(renderState, RF_FrontFaceClockwise, _settings.faceDirection == FaceDirection::CW);
     setField(renderState, RF_CullFaceShift, RF_CullFaceMask, _settings.cullFace);
+    setFlag(renderState, RF_PrimitiveRestart, _settings.primitiveRestart);
 
     if (_settings.blendSettings)
     {
@@ -1134,16 +2677,54 @@ GLPipeline::GLPipeline(Allocator & _alloc, const PipelineSettings & _settings) :
             m_variables.append(stick::makeUnique<GLPipelineVariable>(_alloc, this, i, j));
         }
         GLUniformBlockStorage storage;
+        storage.lastByteOffset = 0;
+        storage.lastPassID = 0;
+        storage.bDirty = true;
         storage.data = DynamicArray<char>(_alloc);
         storage.data.resize(blk.byteCount);
         m_uniformBlockStorage.append(std::move(storage));
     }
 
+    if (_settings.drawDataBlock)
+    {
+        for (Size i = 0; i < m_program->m_storageBlocks.count(); ++i)
+        {
+            auto & blk = m_program->m_storageBlocks[i];
+            if (blk.name != _settings.drawDataBlock)
+                continue;
+
+            m_drawDataBlock = (Int32)i;
+            for (Size j = 0; j < blk.members.count(); ++j)
+            {
+                m_variables.append(stick::makeUnique<GLPipelineVariable>(
+                    _alloc, this, m_program->m_uniformBlocks.count(), j));
+            }
+            GLUniformBlockStorage storage;
+            storage.lastByteOffset = 0;
+            storage.lastPassID = 0;
+            storage.bDirty = true;
+            storage.data = DynamicArray<char>(_alloc);
+            storage.data.resize(blk.arrayStride);
+            m_uniformBlockStorage.append(std::move(storage));
+            break;
+        }
+    }
+
     m_textures.reserve(2);
     for (Size i = 0; i < m_program->m_textures.count(); ++i)
     {
         m_textures.append(stick::makeUnique<GLPipelineTexture>(_alloc, this));
     }
+
+    for (Size i = 0; i < m_program->m_storageBlocks.count(); ++i)
+    {
+        m_buffers.append(stick::makeUnique<GLPipelineBuffer>(_alloc, this));
+    }
+
+    for (Size i = 0; i < m_program->m_images.count(); ++i)
+    {
+        m_images.append(stick::makeUnique<GLPipelineImage>(_alloc, this));
+    }
 }
 
 GLPipeline::~GLPipeline()
@@ -1155,14 +2736,21 @@ PipelineVariable * GLPipeline::variable(const char * _name)
 {
     for (auto & var : m_variables)
     {
-        GLBlockedUniform & uniform =
-            m_program->m_uniformBlocks[var->m_blockIndex].uniforms[var->m_uniformIndex];
-        if (uniform.name == _name)
+        if (blockedUniform(var->m_blockIndex, var->m_uniformIndex).name == _name)
             return var.get();
     }
     return nullptr;
 }
 
+GLBlockedUniform & GLPipeline::blockedUniform(UInt32 _blockIndex, UInt32 _uniformIndex)
+{
+    if (_blockIndex < m_program->m_uniformBlocks.count())
+        return m_program->m_uniformBlocks[_blockIndex].uniforms[_uniformIndex];
+
+    STICK_ASSERT(m_drawDataBlock >= 0);
+    return m_program->m_storageBlocks[m_drawDataBlock].members[_uniformIndex];
+}
+
 PipelineTexture * GLPipeline::texture(const char * _name)
 {
     for (Size idx = 0; idx < m_program->m_textures.count(); ++idx)
@@ -1173,6 +2761,26 @@ PipelineTexture * GLPipeline::texture(const char * _name)
     return nullptr;
 }
 
+PipelineBuffer * GLPipeline::buffer(const char * _name)
+{
+    for (Size idx = 0; idx < m_program->m_storageBlocks.count(); ++idx)
+    {
+        if (m_program->m_storageBlocks[idx].name == _name)
+            return m_buffers[idx].get();
+    }
+    return nullptr;
+}
+
+PipelineImage * GLPipeline::image(const char * _name)
+{
+    for (Size idx = 0; idx < m_program->m_images.count(); ++idx)
+    {
+        if (m_program->m_images[idx].name == _name)
+            return m_images[idx].get();
+    }
+    return nullptr;
+}
+
 // // pipeline variable helpers
 // static inline Error setBlockedVariable(GLUniformBlock & _block,
 //                                        UInt32 _uniformIndex,
@@ -1234,7 +2842,7 @@ void GLPipelineVariable::setVec3f(Float32 _x, Float32 _y, Float32 _z)
 
 void GLPipelineVariable::setVec4f(Float32 _x, Float32 _y, Float32 _z, Float32 _w)
 {
-    Float32 tmp[] = { _x, _y, _z, _y };
+    Float32 tmp[] = { _x, _y, _z, _w };
     setHelper(tmp, sizeof(tmp), GLUniformType::Vec4);
 }
 
@@ -1245,12 +2853,9 @@ void GLPipelineVariable::setMat4f(Float32 * _mat)
 
 void GLPipelineVariable::setHelper(const void * _data, Size _byteCount, GLUniformType _type)
 {
-    STICK_ASSERT(m_blockIndex < m_pipeline->m_program->m_uniformBlocks.count());
-    GLUniformBlock & blk = m_pipeline->m_program->m_uniformBlocks[m_blockIndex];
+    STICK_ASSERT(m_blockIndex < m_pipeline->m_uniformBlockStorage.count());
     GLUniformBlockStorage & storage = m_pipeline->m_uniformBlockStorage[m_blockIndex];
-    STICK_ASSERT(m_uniformIndex < blk.uniforms.count());
-
-    GLBlockedUniform & uniform = blk.uniforms[m_uniformIndex];
+    GLBlockedUniform & uniform = m_pipeline->blockedUniform(m_blockIndex, m_uniformIndex);
 
     // check if the variable changed
     if (std::memcmp(storage.data.ptr() + uniform.byteOffset, _data, _byteCount) == 0)
@@ -1260,6 +2865,7 @@ void GLPipelineVariable::setHelper(const void * _data, Size _byteCount, GLUnifor
     // storage
     STICK_ASSERT(uniform.type == _type);
     std::memcpy(storage.data.ptr() + uniform.byteOffset, _data, _byteCount);
+    storage.bDirty = true;
 }
 
 GLPipelineTexture::GLPipelineTexture(GLPipeline * _pipe) :
@@ -1275,93 +2881,1069 @@ void GLPipelineTexture::set(const Texture * _tex, const Sampler * _sampler)
     m_sampler = static_cast<const GLSampler *>(_sampler);
 }
 
-GLVertexBuffer::GLVertexBuffer(BufferUsageFlags _flags) : m_usageFlags(_flags)
+GLPipelineBuffer::GLPipelineBuffer(GLPipeline * _pipe) :
+    m_pipeline(_pipe),
+    m_storageBuffer(nullptr),
+    m_vertexBuffer(nullptr),
+    m_indexBuffer(nullptr),
+    m_byteOffset(0),
+    m_byteCount(0)
 {
-    ASSERT_NO_GL_ERROR(glGenBuffers(1, &m_glVertexBuffer));
+}
+
+void GLPipelineBuffer::set(const StorageBuffer * _buffer, Size _byteOffset, Size _byteCount)
+{
+    setHelper(_byteOffset, _byteCount);
+    m_storageBuffer = static_cast<const GLStorageBuffer *>(_buffer);
+}
+
+// suballocated buffers are bound as a range of their arena
+template <class T>
+static void suballocatedRange(const T * _buffer, Size & _byteOffset, Size & _byteCount)
+{
+    if (!_buffer || !_buffer->m_range.arena)
+        return;
+    if (!_byteCount)
+        _byteCount = _buffer->m_range.byteCount - _byteOffset;
+    _byteOffset += _buffer->m_range.byteOffset;
+}
+
+void GLPipelineBuffer::set(const VertexBuffer * _buffer, Size _byteOffset, Size _byteCount)
+{
+    setHelper(_byteOffset, _byteCount);
+    m_vertexBuffer = static_cast<const GLVertexBuffer *>(_buffer);
+}
+
+void GLPipelineBuffer::set(const IndexBuffer * _buffer, Size _byteOffset, Size _byteCount)
+{
+    setHelper(_byteOffset, _byteCount);
+    m_indexBuffer = static_cast<const GLIndexBuffer *>(_buffer);
+}
+
+void GLPipelineBuffer::setHelper(Size _byteOffset, Size _byteCount)
+{
+    m_storageBuffer = nullptr;
+    m_vertexBuffer = nullptr;
+    m_indexBuffer = nullptr;
+    m_byteOffset = _byteOffset;
+    m_byteCount = _byteCount;
+}
+
+bool GLPipelineBuffer::resolve(GLuint & _outGLBuffer,
+                               Size & _outByteOffset,
+                               Size & _outByteCount) const
+{
+    _outGLBuffer = 0;
+    _outByteOffset = m_byteOffset;
+    _outByteCount = m_byteCount;
+    if (m_storageBuffer)
+    {
+        _outGLBuffer = m_storageBuffer->m_glStorageBuffer;
+    }
+    else if (m_vertexBuffer)
+    {
+        _outGLBuffer = m_vertexBuffer->m_glVertexBuffer;
+        suballocatedRange(m_vertexBuffer, _outByteOffset, _outByteCount);
+    }
+    else if (m_indexBuffer)
+    {
+        _outGLBuffer = m_indexBuffer->m_glIndexBuffer;
+        suballocatedRange(m_indexBuffer, _outByteOffset, _outByteCount);
+    }
+    return _outGLBuffer != 0;
+}
+
+GLPipelineImage::GLPipelineImage(GLPipeline * _pipe) :
+    m_pipeline(_pipe),
+    m_texture(nullptr),
+    m_level(0),
+    m_access(ImageAccess::ReadWrite)
+{
+}
+
+void GLPipelineImage::set(const Texture * _tex, UInt32 _level, ImageAccess _access)
+{
+    m_texture = static_cast<const GLTexture *>(_tex);
+    m_level = _level;
+    m_access = _access;
+}
+
+GLBufferArena::GLBufferArena(Allocator & _alloc, Size _byteCount, bool _bBufferStorage) :
+    m_byteCount(_byteCount),
+    m_usedByteCount(0),
+    m_allocationCount(0),
+    m_freeRanges(_alloc)
+{
+    ASSERT_NO_GL_ERROR(glGenBuffers(1, &m_glBuffer));
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, m_glBuffer));
+    if (_bBufferStorage)
+    {
+        ASSERT_NO_GL_ERROR(glBufferStorage(GL_COPY_WRITE_BUFFER,
+                                           _byteCount,
+                                           nullptr,
+                                           GL_DYNAMIC_STORAGE_BIT | GL_MAP_READ_BIT |
+                                               GL_MAP_WRITE_BIT));
+    }
+    else
+    {
+        // the arena is never reallocated, so mutable storage behaves the same
+        ASSERT_NO_GL_ERROR(
+            glBufferData(GL_COPY_WRITE_BUFFER, _byteCount, nullptr, GL_STATIC_DRAW));
+    }
+    m_freeRanges.append({ 0, _byteCount });
+}
+
+GLBufferArena::~GLBufferArena()
+{
+    glDeleteBuffers(1, &m_glBuffer);
+}
+
+bool GLBufferArena::allocate(Size _byteCount, Size _alignment, Size & _outByteOffset)
+{
+    // best fit, the padding needed for the alignment counts as waste
+    Size best = m_freeRanges.count();
+    Size bestWaste = 0;
+    for (Size i = 0; i < m_freeRanges.count(); ++i)
+    {
+        const GLFreeRange & range = m_freeRanges[i];
+        Size padding = alignUp(range.byteOffset, _alignment) - range.byteOffset;
+        if (padding + _byteCount > range.byteCount)
+            continue;
+        Size waste = range.byteCount - _byteCount;
+        if (best == m_freeRanges.count() || waste < bestWaste)
+        {
+            best = i;
+            bestWaste = waste;
+            if (!waste)
+                break;
+        }
+    }
+
+    if (best == m_freeRanges.count())
+        return false;
+
+    GLFreeRange range = m_freeRanges[best];
+    Size offset = alignUp(range.byteOffset, _alignment);
+    Size end = offset + _byteCount;
+    m_freeRanges.remove(m_freeRanges.begin() + best);
+    if (end < range.byteOffset + range.byteCount)
+        m_freeRanges.insert(m_freeRanges.begin() + best,
+                            { end, range.byteOffset + range.byteCount - end });
+    if (offset > range.byteOffset)
+        m_freeRanges.insert(m_freeRanges.begin() + best,
+                            { range.byteOffset, offset - range.byteOffset });
+
+    m_usedByteCount += _byteCount;
+    m_allocationCount++;
+    _outByteOffset = offset;
+    return true;
+}
+
+void GLBufferArena::free(Size _byteOffset, Size _byteCount)
+{
+    STICK_ASSERT(m_allocationCount > 0 && m_usedByteCount >= _byteCount);
+    m_usedByteCount -= _byteCount;
+    m_allocationCount--;
+
+    auto it = std::lower_bound(
+        m_freeRanges.begin(),
+        m_freeRanges.end(),
+        _byteOffset,
+        [](const GLFreeRange & _r, Size _offset) { return _r.byteOffset < _offset; });
+    Size idx = it - m_freeRanges.begin();
+
+    // coalesce with the neighbouring ranges
+    bool bMergePrev =
+        idx > 0 &&
+        m_freeRanges[idx - 1].byteOffset + m_freeRanges[idx - 1].byteCount == _byteOffset;
+    bool bMergeNext =
+        idx < m_freeRanges.count() && _byteOffset + _byteCount == m_freeRanges[idx].byteOffset;
+    if (bMergePrev && bMergeNext)
+    {
+        m_freeRanges[idx - 1].byteCount += _byteCount + m_freeRanges[idx].byteCount;
+        m_freeRanges.remove(m_freeRanges.begin() + idx);
+    }
+    else if (bMergePrev)
+        m_freeRanges[idx - 1].byteCount += _byteCount;
+    else if (bMergeNext)
+    {
+        m_freeRanges[idx].byteOffset = _byteOffset;
+        m_freeRanges[idx].byteCount += _byteCount;
+    }
+    else
+        m_freeRanges.insert(m_freeRanges.begin() + idx, { _byteOffset, _byteCount });
+}
+
+void GLBufferArena::reset(Size _usedByteCount, UInt32 _allocationCount)
+{
+    // the alignment padding between the compacted allocations is not tracked as free
+    m_freeRanges.clear();
+    if (_usedByteCount < m_byteCount)
+        m_freeRanges.append({ _usedByteCount, m_byteCount - _usedByteCount });
+    m_allocationCount = _allocationCount;
+}
+
+void GLBufferArena::addStatistics(BufferPoolStatistics & _stats) const
+{
+    _stats.poolCount++;
+    _stats.allocationCount += m_allocationCount;
+    _stats.freeRangeCount += (UInt32)m_freeRanges.count();
+    _stats.byteCount += m_byteCount;
+    _stats.usedByteCount += m_usedByteCount;
+    for (const auto & range : m_freeRanges)
+        _stats.largestFreeRange = std::max(_stats.largestFreeRange, range.byteCount);
+}
+
+// (re)allocates _range if needed and uploads _data to it, returns the buffer of the arena
+static GLuint loadSuballocated(GLRenderDevice * _device,
+                               GLBufferArenaArray & _arenas,
+                               GLSuballocation & _range,
+                               const void * _data,
+                               Size _byteCount)
+{
+    if (!_range.arena || _range.byteCount != _byteCount)
+    {
+        if (_range.arena)
+            _range.arena->free(_range.byteOffset, _range.byteCount);
+        _range.arena =
+            _device->allocateRange(_arenas, _byteCount, _range.alignment, _range.byteOffset);
+        _range.byteCount = _byteCount;
+    }
+
+    if (_data)
+    {
+        ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, _range.arena->m_glBuffer));
+        ASSERT_NO_GL_ERROR(
+            glBufferSubData(GL_COPY_WRITE_BUFFER, _range.byteOffset, _byteCount, _data));
+    }
+    return _range.arena->m_glBuffer;
+}
+
+static Error updateBufferRange(GLuint _glBuffer,
+                               const GLSuballocation & _range,
+                               Size _byteOffset,
+                               const void * _data,
+                               Size _byteCount)
+{
+    if (_byteOffset + _byteCount > _range.byteCount)
+        return Error(
+            ec::InvalidOperation, "The range exceeds the buffer size", STICK_FILE, STICK_LINE);
+
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, _glBuffer));
+    ASSERT_NO_GL_ERROR(
+        glBufferSubData(GL_COPY_WRITE_BUFFER, _range.byteOffset + _byteOffset, _byteCount, _data));
+    return Error();
+}
+
+static Result<void *> mapBufferRange(GLuint _glBuffer,
+                                     const GLSuballocation & _range,
+                                     Size _byteOffset,
+                                     Size _byteCount,
+                                     UInt32 _flags)
+{
+    if (_byteOffset + _byteCount > _range.byteCount)
+        return Error(
+            ec::InvalidOperation, "The range exceeds the buffer size", STICK_FILE, STICK_LINE);
+    if ((_flags & BufferMapRead) && (_flags & BufferMapInvalidateRange))
+        return Error(ec::InvalidOperation,
+                     "BufferMapInvalidateRange can't be combined with BufferMapRead",
+                     STICK_FILE,
+                     STICK_LINE);
+    if (!(_flags & (BufferMapRead | BufferMapWrite)))
+        return Error(ec::InvalidOperation,
+                     "Buffers have to be mapped with BufferMapRead, BufferMapWrite or both",
+                     STICK_FILE,
+                     STICK_LINE);
+
+    GLbitfield access = 0;
+    if (_flags & BufferMapRead)
+        access |= GL_MAP_READ_BIT;
+    if (_flags & BufferMapWrite)
+        access |= GL_MAP_WRITE_BIT;
+    if (_flags & BufferMapInvalidateRange)
+        access |= GL_MAP_INVALIDATE_RANGE_BIT;
+    if (_flags & BufferMapUnsynchronized)
+        access |= GL_MAP_UNSYNCHRONIZED_BIT;
+
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, _glBuffer));
+    void * ret =
+        glMapBufferRange(GL_COPY_WRITE_BUFFER, _range.byteOffset + _byteOffset, _byteCount, access);
+    if (!ret)
+        return Error(ec::InvalidOperation,
+                     String::concat("Could not map the buffer range: ", glErrorName(takeGLError())),
+                     STICK_FILE,
+                     STICK_LINE);
+    return ret;
+}
+
+static Error unmapBuffer(GLuint _glBuffer)
+{
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, _glBuffer));
+    GLint bMapped = GL_FALSE;
+    ASSERT_NO_GL_ERROR(glGetBufferParameteriv(GL_COPY_WRITE_BUFFER, GL_BUFFER_MAPPED, &bMapped));
+    if (!bMapped)
+        return Error(ec::InvalidOperation, "The buffer is not mapped", STICK_FILE, STICK_LINE);
+
+    if (glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_FALSE)
+    {
+        // GL_FALSE without a GL error means that the data store got corrupted, i.e. by a display
+        // mode change
+        GLenum err = takeGLError();
+        if (err != GL_NO_ERROR)
+            return Error(ec::InvalidOperation,
+                         String::concat("Could not unmap the buffer: ", glErrorName(err)),
+                         STICK_FILE,
+                         STICK_LINE);
+        return Error(ec::InvalidOperation,
+                     "The buffer contents got corrupted while it was mapped",
+                     STICK_FILE,
+                     STICK_LINE);
+    }
+    return Error();
+}
+
+static bool isMultiBuffered(BufferUsageFlags _flags)
+{
+    return _flags & (BufferUsageDynamic | BufferUsageStream);
+}
+
+static GLenum glBufferUsage(BufferUsageFlags _flags, GLenum _staticUsage = GL_STATIC_DRAW)
+{
+    if (_flags & BufferUsageReadback)
+        return GL_STREAM_READ;
+    if (_flags & BufferUsageStream)
+        return GL_STREAM_DRAW;
+    if (_flags & BufferUsageDynamic)
+        return GL_DYNAMIC_DRAW;
+    return _staticUsage;
+}
+
+static void createBufferCopies(GLBufferCopies & _copies)
+{
+    ASSERT_NO_GL_ERROR(glGenBuffers(BUFFER_COPY_COUNT, _copies.glBuffers));
+    for (Size i = 0; i < BUFFER_COPY_COUNT; ++i)
+        _copies.submitSerials[i] = 0;
+    _copies.current = 0;
+    _copies.currentSince = 0;
+}
+
+// Returns a copy that no submitted pass reads from. If the current copy might be in use, the next
+// one becomes current (waiting for the GPU if it still reads that one, too) and the first
+// _preserveByteCount bytes are copied over on the GPU.
+static GLuint prepareWrite(GLRenderDevice * _device,
+                           GLBufferCopies & _copies,
+                           Size _preserveByteCount)
+{
+    if (_copies.currentSince == _device->m_submitSerial)
+        return _copies.glBuffers[_copies.current];
+
+    UInt32 next = (_copies.current + 1) % BUFFER_COPY_COUNT;
+    if (_device->waitForSubmission(_copies.submitSerials[next]))
+    {
+        // the GPU might still read the copy, respecifying its storage detaches it from the
+        // pending draws instead
+        GLint byteCount, usage;
+        ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, _copies.glBuffers[next]));
+        ASSERT_NO_GL_ERROR(
+            glGetBufferParameteriv(GL_COPY_WRITE_BUFFER, GL_BUFFER_SIZE, &byteCount));
+        ASSERT_NO_GL_ERROR(glGetBufferParameteriv(GL_COPY_WRITE_BUFFER, GL_BUFFER_USAGE, &usage));
+        ASSERT_NO_GL_ERROR(
+            glBufferData(GL_COPY_WRITE_BUFFER, byteCount, nullptr, (GLenum)usage));
+    }
+    _copies.submitSerials[_copies.current] = _device->m_submitSerial;
+    if (_preserveByteCount)
+    {
+        ASSERT_NO_GL_ERROR(
+            glBindBuffer(GL_COPY_READ_BUFFER, _copies.glBuffers[_copies.current]));
+        ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, _copies.glBuffers[next]));
+        ASSERT_NO_GL_ERROR(glCopyBufferSubData(
+            GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, _preserveByteCount));
+    }
+    _copies.current = next;
+    _copies.currentSince = _device->m_submitSerial;
+    return _copies.glBuffers[next];
+}
+
+static Size sharedContentIndex(const GLSharedContentArray & _contents,
+                               UInt64 _hash,
+                               Size _byteCount)
+{
+    auto it = std::lower_bound(_contents.begin(),
+                               _contents.end(),
+                               _hash,
+                               [_byteCount](const GLSharedContent & _c, UInt64 _h) {
+                                   return _c.hash < _h ||
+                                          (_c.hash == _h && _c.byteCount < _byteCount);
+                               });
+    return it - _contents.begin();
+}
+
+static bool isSharedContent(const GLSharedContent & _content, UInt64 _hash, Size _byteCount)
+{
+    return _content.hash == _hash && _content.byteCount == _byteCount;
+}
+
+// Returns the shared content with the given hash and bytes after adding a reference to it, nullptr
+// if there is none yet. _params (i.e. the dimensions of a texture) are compared along with the
+// _byteCount bytes of _data, so that a hash collision never shares different content.
+static GLSharedContent * acquireSharedContent(GLSharedContentArray & _contents,
+                                              UInt64 _hash,
+                                              const void * _params,
+                                              Size _paramsByteCount,
+                                              const void * _data,
+                                              Size _byteCount)
+{
+    for (Size idx = sharedContentIndex(_contents, _hash, _byteCount);
+         idx < _contents.count() && isSharedContent(_contents[idx], _hash, _byteCount);
+         ++idx)
+    {
+        GLSharedContent & content = _contents[idx];
+        if (content.data.count() != _paramsByteCount + _byteCount ||
+            (_paramsByteCount && std::memcmp(content.data.ptr(), _params, _paramsByteCount)) ||
+            std::memcmp(content.data.ptr() + _paramsByteCount, _data, _byteCount))
+            continue;
+        content.refCount++;
+        return &content;
+    }
+    return nullptr;
+}
+
+static void addSharedContent(GLSharedContentArray & _contents,
+                             UInt64 _hash,
+                             const void * _params,
+                             Size _paramsByteCount,
+                             const void * _data,
+                             Size _byteCount,
+                             GLuint _glObject)
+{
+    Size idx = sharedContentIndex(_contents, _hash, _byteCount);
+    _contents.insert(
+        _contents.begin() + idx,
+        { _hash, _byteCount, _glObject, 1, DynamicArray<UInt8>(_contents.allocator()) });
+    // keep a copy of the content to compare against on hash hits
+    DynamicArray<UInt8> & data = _contents[idx].data;
+    data.resize(_paramsByteCount + _byteCount);
+    if (_paramsByteCount)
+        std::memcpy(data.ptr(), _params, _paramsByteCount);
+    std::memcpy(data.ptr() + _paramsByteCount, _data, _byteCount);
+}
+
+// Drops a reference to the shared content held in _glObject. Returns true if it was the last one,
+// in which case the caller owns the GL object from now on.
+static bool releaseSharedContent(GLSharedContentArray & _contents,
+                                 UInt64 _hash,
+                                 Size _byteCount,
+                                 GLuint _glObject)
+{
+    Size idx = sharedContentIndex(_contents, _hash, _byteCount);
+    while (idx < _contents.count() && _contents[idx].glObject != _glObject)
+        ++idx;
+    STICK_ASSERT(idx < _contents.count() && isSharedContent(_contents[idx], _hash, _byteCount));
+    if (--_contents[idx].refCount)
+        return false;
+    _contents.remove(_contents.begin() + idx);
+    return true;
+}
+
+// loads the data of a BufferUsageDeduplicate buffer, returns the buffer that holds it. Buffers
+// without data can't be shared and get their own.
+static GLuint loadDeduplicated(GLRenderDevice * _device,
+                               GLuint _glBuffer,
+                               UInt64 & _contentHash,
+                               bool & _bShared,
+                               GLSuballocation & _range,
+                               const void * _data,
+                               Size _byteCount)
+{
+    if (_bShared && !releaseSharedContent(
+                        _device->m_sharedBuffers, _contentHash, _range.byteCount, _glBuffer))
+        _glBuffer = 0;
+    _bShared = false;
+    _range.byteCount = _byteCount;
+
+    if (_data)
+    {
+        _contentHash = hashBytes(_data, _byteCount);
+        GLSharedContent * shared = acquireSharedContent(
+            _device->m_sharedBuffers, _contentHash, nullptr, 0, _data, _byteCount);
+        _bShared = true;
+        if (shared)
+        {
+            if (_glBuffer)
+                glDeleteBuffers(1, &_glBuffer);
+            return shared->glObject;
+        }
+    }
+
+    if (!_glBuffer)
+        ASSERT_NO_GL_ERROR(glGenBuffers(1, &_glBuffer));
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, _glBuffer));
+    ASSERT_NO_GL_ERROR(glBufferData(GL_COPY_WRITE_BUFFER, _byteCount, _data, GL_STATIC_DRAW));
+    if (_bShared)
+        addSharedContent(
+            _device->m_sharedBuffers, _contentHash, nullptr, 0, _data, _byteCount, _glBuffer);
+    return _glBuffer;
+}
+
+// Copy on write for deduplicated buffers: returns a buffer with the same content that is not
+// shared with any other buffer, copying it on the GPU if necessary.
+static GLuint detachDeduplicated(GLRenderDevice * _device,
+                                 GLuint _glBuffer,
+                                 UInt64 _contentHash,
+                                 bool & _bShared,
+                                 const GLSuballocation & _range)
+{
+    if (!_bShared)
+        return _glBuffer;
+    _bShared = false;
+    if (releaseSharedContent(_device->m_sharedBuffers, _contentHash, _range.byteCount, _glBuffer))
+        return _glBuffer;
+
+    GLuint ret;
+    ASSERT_NO_GL_ERROR(glGenBuffers(1, &ret));
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_READ_BUFFER, _glBuffer));
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, ret));
+    ASSERT_NO_GL_ERROR(
+        glBufferData(GL_COPY_WRITE_BUFFER, _range.byteCount, nullptr, GL_STATIC_DRAW));
+    ASSERT_NO_GL_ERROR(glCopyBufferSubData(
+        GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, _range.byteCount));
+    return ret;
+}
+
+static void destroyDeduplicated(GLRenderDevice * _device,
+                                GLuint _glBuffer,
+                                UInt64 _contentHash,
+                                bool _bShared,
+                                const GLSuballocation & _range)
+{
+    if (_bShared && !releaseSharedContent(
+                        _device->m_sharedBuffers, _contentHash, _range.byteCount, _glBuffer))
+        return;
+    if (_glBuffer)
+        glDeleteBuffers(1, &_glBuffer);
+}
+
+// loads the data of a buffer that is not suballocated, returns the buffer that holds it
+static GLuint loadBufferData(GLRenderDevice * _device,
+                             GLuint _glBuffer,
+                             BufferUsageFlags _flags,
+                             GLBufferCopies & _copies,
+                             GLSuballocation & _range,
+                             const void * _data,
+                             Size _byteCount)
+{
+    GLenum usage = glBufferUsage(_flags);
+    if (!isMultiBuffered(_flags))
+    {
+        ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, _glBuffer));
+        ASSERT_NO_GL_ERROR(glBufferData(GL_COPY_WRITE_BUFFER, _byteCount, _data, usage));
+        _range.byteCount = _byteCount;
+        return _glBuffer;
+    }
+
+    if (_byteCount != _range.byteCount)
+    {
+        // respecifying the storage of all copies detaches them from pending draws, no need to wait
+        for (Size i = 0; i < BUFFER_COPY_COUNT; ++i)
+        {
+            ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, _copies.glBuffers[i]));
+            ASSERT_NO_GL_ERROR(glBufferData(GL_COPY_WRITE_BUFFER,
+                                            _byteCount,
+                                            i == _copies.current ? _data : nullptr,
+                                            usage));
+            _copies.submitSerials[i] = 0;
+        }
+        _copies.currentSince = _device->m_submitSerial;
+        _range.byteCount = _byteCount;
+        return _copies.glBuffers[_copies.current];
+    }
+
+    GLuint ret = prepareWrite(_device, _copies, 0);
+    if (_data)
+    {
+        ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, ret));
+        ASSERT_NO_GL_ERROR(glBufferSubData(GL_COPY_WRITE_BUFFER, 0, _byteCount, _data));
+    }
+    return ret;
+}
+
+GLVertexBuffer::GLVertexBuffer(GLRenderDevice * _device, BufferUsageFlags _flags) :
+    m_device(_device),
+    m_glVertexBuffer(0),
+    m_usageFlags(_flags),
+    m_range({ nullptr, 0, 0, 4 }),
+    m_contentHash(0),
+    m_bShared(false)
+{
+    if (isMultiBuffered(m_usageFlags))
+    {
+        createBufferCopies(m_copies);
+        m_glVertexBuffer = m_copies.glBuffers[0];
+    }
+    // deduplicated buffers create theirs when loading unless they can share an existing one
+    else if (!(m_usageFlags & (BufferUsageSuballocate | BufferUsageDeduplicate)))
+        ASSERT_NO_GL_ERROR(glGenBuffers(1, &m_glVertexBuffer));
 }
 
 GLVertexBuffer::~GLVertexBuffer()
 {
-    glDeleteBuffers(1, &m_glVertexBuffer);
+    if (m_range.arena)
+        m_range.arena->free(m_range.byteOffset, m_range.byteCount);
+    else if (isMultiBuffered(m_usageFlags))
+        glDeleteBuffers(BUFFER_COPY_COUNT, m_copies.glBuffers);
+    else if (m_usageFlags & BufferUsageDeduplicate)
+        destroyDeduplicated(m_device, m_glVertexBuffer, m_contentHash, m_bShared, m_range);
+    else if (!(m_usageFlags & BufferUsageSuballocate))
+        glDeleteBuffers(1, &m_glVertexBuffer);
+}
+
+void GLVertexBuffer::loadDataRaw(const void * _data, Size _byteCount)
+{
+    if (m_usageFlags & BufferUsageSuballocate)
+        m_glVertexBuffer = loadSuballocated(
+            m_device, m_device->m_vertexArenas, m_range, _data, _byteCount);
+    else if (m_usageFlags & BufferUsageDeduplicate)
+        m_glVertexBuffer = loadDeduplicated(
+            m_device, m_glVertexBuffer, m_contentHash, m_bShared, m_range, _data, _byteCount);
+    else
+        m_glVertexBuffer = loadBufferData(
+            m_device, m_glVertexBuffer, m_usageFlags, m_copies, m_range, _data, _byteCount);
+}
+
+Error GLVertexBuffer::updateRange(Size _byteOffset, const void * _data, Size _byteCount)
+{
+    if (isMultiBuffered(m_usageFlags))
+        m_glVertexBuffer = prepareWrite(m_device, m_copies, m_range.byteCount);
+    m_glVertexBuffer =
+        detachDeduplicated(m_device, m_glVertexBuffer, m_contentHash, m_bShared, m_range);
+    return updateBufferRange(m_glVertexBuffer, m_range, _byteOffset, _data, _byteCount);
+}
+
+Result<void *> GLVertexBuffer::map(Size _byteOffset, Size _byteCount, UInt32 _flags)
+{
+    if (isMultiBuffered(m_usageFlags) && (_flags & BufferMapWrite))
+    {
+        // the old contents only need to be copied over if they are not overwritten entirely
+        bool bDiscard = (_flags & BufferMapInvalidateRange) && _byteOffset == 0 &&
+                        _byteCount == m_range.byteCount;
+        m_glVertexBuffer = prepareWrite(m_device, m_copies, bDiscard ? 0 : m_range.byteCount);
+    }
+    if (_flags & BufferMapWrite)
+        m_glVertexBuffer =
+            detachDeduplicated(m_device, m_glVertexBuffer, m_contentHash, m_bShared, m_range);
+    return mapBufferRange(m_glVertexBuffer, m_range, _byteOffset, _byteCount, _flags);
+}
+
+Error GLVertexBuffer::unmap()
+{
+    return unmapBuffer(m_glVertexBuffer);
+}
+
+Size GLVertexBuffer::byteOffset() const
+{
+    return m_range.arena ? m_range.byteOffset : 0;
+}
+
+void GLVertexBuffer::alignSuballocation(Size _alignment)
+{
+    if (!(m_usageFlags & BufferUsageSuballocate) || !_alignment)
+        return;
+
+    m_range.alignment = _alignment;
+    if (!m_range.arena || m_range.byteOffset % _alignment == 0)
+        return;
+
+    Size byteOffset;
+    GLBufferArena * arena = m_device->allocateRange(
+        m_device->m_vertexArenas, m_range.byteCount, _alignment, byteOffset);
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_READ_BUFFER, m_range.arena->m_glBuffer));
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, arena->m_glBuffer));
+    ASSERT_NO_GL_ERROR(glCopyBufferSubData(GL_COPY_READ_BUFFER,
+                                           GL_COPY_WRITE_BUFFER,
+                                           m_range.byteOffset,
+                                           byteOffset,
+                                           m_range.byteCount));
+    m_range.arena->free(m_range.byteOffset, m_range.byteCount);
+    m_range.arena = arena;
+    m_range.byteOffset = byteOffset;
+    m_glVertexBuffer = arena->m_glBuffer;
+}
+
+GLIndexBuffer::GLIndexBuffer(GLRenderDevice * _device,
+                             BufferUsageFlags _flags,
+                             DataType _indexType) :
+    m_device(_device),
+    m_glIndexBuffer(0),
+    m_usageFlags(_flags),
+    m_range({ nullptr, 0, 0, INDEX_ARENA_ALIGNMENT }),
+    m_indexType(_indexType),
+    m_contentHash(0),
+    m_bShared(false)
+{
+    if (isMultiBuffered(m_usageFlags))
+    {
+        createBufferCopies(m_copies);
+        m_glIndexBuffer = m_copies.glBuffers[0];
+    }
+    // deduplicated buffers create theirs when loading unless they can share an existing one
+    else if (!(m_usageFlags & (BufferUsageSuballocate | BufferUsageDeduplicate)))
+        ASSERT_NO_GL_ERROR(glGenBuffers(1, &m_glIndexBuffer));
+}
+
+GLIndexBuffer::~GLIndexBuffer()
+{
+    if (m_range.arena)
+        m_range.arena->free(m_range.byteOffset, m_range.byteCount);
+    else if (isMultiBuffered(m_usageFlags))
+        glDeleteBuffers(BUFFER_COPY_COUNT, m_copies.glBuffers);
+    else if (m_usageFlags & BufferUsageDeduplicate)
+        destroyDeduplicated(m_device, m_glIndexBuffer, m_contentHash, m_bShared, m_range);
+    else if (!(m_usageFlags & BufferUsageSuballocate))
+        glDeleteBuffers(1, &m_glIndexBuffer);
+}
+
+void GLIndexBuffer::loadDataRaw(const void * _data, Size _byteCount)
+{
+    if (m_usageFlags & BufferUsageSuballocate)
+        m_glIndexBuffer =
+            loadSuballocated(m_device, m_device->m_indexArenas, m_range, _data, _byteCount);
+    else if (m_usageFlags & BufferUsageDeduplicate)
+        m_glIndexBuffer = loadDeduplicated(
+            m_device, m_glIndexBuffer, m_contentHash, m_bShared, m_range, _data, _byteCount);
+    else
+        m_glIndexBuffer = loadBufferData(
+            m_device, m_glIndexBuffer, m_usageFlags, m_copies, m_range, _data, _byteCount);
+}
+
+void GLIndexBuffer::loadIndices(const UInt32 * _indices, Size _count)
+{
+    m_indexType = narrowestIndexType(_indices, _count);
+    if (m_indexType == DataType::UInt32)
+    {
+        loadDataRaw(_indices, _count * sizeof(UInt32));
+        return;
+    }
+
+    Size byteCount = _count * s_dataTypeByteCount[(Size)m_indexType];
+    DynamicArray<UInt8> narrowed(*m_device->m_alloc);
+    narrowed.resize(byteCount);
+    narrowIndices(_indices, _count, m_indexType, narrowed.ptr());
+    loadDataRaw(narrowed.ptr(), byteCount);
+}
+
+Error GLIndexBuffer::updateRange(Size _byteOffset, const void * _data, Size _byteCount)
+{
+    if (isMultiBuffered(m_usageFlags))
+        m_glIndexBuffer = prepareWrite(m_device, m_copies, m_range.byteCount);
+    m_glIndexBuffer =
+        detachDeduplicated(m_device, m_glIndexBuffer, m_contentHash, m_bShared, m_range);
+    return updateBufferRange(m_glIndexBuffer, m_range, _byteOffset, _data, _byteCount);
+}
+
+Result<void *> GLIndexBuffer::map(Size _byteOffset, Size _byteCount, UInt32 _flags)
+{
+    if (isMultiBuffered(m_usageFlags) && (_flags & BufferMapWrite))
+    {
+        // the old contents only need to be copied over if they are not overwritten entirely
+        bool bDiscard = (_flags & BufferMapInvalidateRange) && _byteOffset == 0 &&
+                        _byteCount == m_range.byteCount;
+        m_glIndexBuffer = prepareWrite(m_device, m_copies, bDiscard ? 0 : m_range.byteCount);
+    }
+    if (_flags & BufferMapWrite)
+        m_glIndexBuffer =
+            detachDeduplicated(m_device, m_glIndexBuffer, m_contentHash, m_bShared, m_range);
+    return mapBufferRange(m_glIndexBuffer, m_range, _byteOffset, _byteCount, _flags);
+}
+
+Error GLIndexBuffer::unmap()
+{
+    return unmapBuffer(m_glIndexBuffer);
+}
+
+Size GLIndexBuffer::byteOffset() const
+{
+    return m_range.arena ? m_range.byteOffset : 0;
+}
+
+DataType GLIndexBuffer::indexType() const
+{
+    return m_indexType;
+}
+
+void GLIndexBuffer::setIndexType(DataType _type)
+{
+    STICK_ASSERT(isIndexType(_type));
+    m_indexType = _type;
+}
+
+GLStorageBuffer::GLStorageBuffer(BufferUsageFlags _flags) : m_usageFlags(_flags)
+{
+    ASSERT_NO_GL_ERROR(glGenBuffers(1, &m_glStorageBuffer));
+}
+
+GLStorageBuffer::~GLStorageBuffer()
+{
+    glDeleteBuffers(1, &m_glStorageBuffer);
+}
+
+void GLStorageBuffer::loadDataRaw(const void * _data, Size _byteCount)
+{
+    // storage buffers are not multi-buffered as shaders may write to them
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_glStorageBuffer));
+    ASSERT_NO_GL_ERROR(glBufferData(GL_SHADER_STORAGE_BUFFER,
+                                    _byteCount,
+                                    _data,
+                                    glBufferUsage(m_usageFlags, GL_DYNAMIC_COPY)));
+}
+
+GLMesh::GLMesh(GLRenderDevice * _device,
+               VertexBuffer ** _vertexBuffers,
+               const VertexLayout * _layouts,
+               Size _count,
+               IndexBuffer * _indexBuffer) :
+    m_device(_device),
+    m_glVao(_device->acquireVertexArray(_layouts, _count)),
+    m_bindings(*_device->m_alloc),
+    m_indexBuffer(static_cast<GLIndexBuffer *>(_indexBuffer)),
+    m_pool(nullptr),
+    m_firstIndex(0)
+{
+    for (Size i = 0; i < _count; ++i)
+    {
+        GLVertexBuffer * vb = static_cast<GLVertexBuffer *>(_vertexBuffers[i]);
+        for (const auto & el : _layouts[i].elements)
+            m_bindings.append({ vb,
+                                (GLintptr)el.offset,
+                                (GLsizei)el.stride,
+                                el.divisor,
+                                el.location,
+                                (GLint)el.elementCount,
+                                s_glDataTypes[static_cast<Size>(el.dataType)],
+                                el.bNormalized,
+                                el.bInteger });
+
+        // suballocated vertices need to start at a multiple of the stride to be addressable
+        // through the base vertex, see resolveMeshBuffers
+        if (_layouts[i].elements.count())
+            vb->alignSuballocation(_layouts[i].elements[0].stride);
+    }
+    STICK_ASSERT(m_bindings.count() <= MAX_VERTEX_BINDINGS); // checked in createMesh
 }
 
-void GLVertexBuffer::loadDataRaw(const void * _data, Size _byteCount)
+GLMesh::GLMesh(Allocator & _alloc, GLVertexPool * _pool, UInt32 _firstIndex) :
+    m_device(nullptr),
+    m_glVao(_pool->m_glVao),
+    m_bindings(_alloc),
+    m_indexBuffer(nullptr),
+    m_pool(_pool),
+    m_firstIndex(_firstIndex)
 {
-    //@TODO: Take usage into account
-    ASSERT_NO_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, m_glVertexBuffer));
-    ASSERT_NO_GL_ERROR(glBufferData(GL_ARRAY_BUFFER, _byteCount, _data, GL_STATIC_DRAW));
 }
 
-GLIndexBuffer::GLIndexBuffer(BufferUsageFlags _flags) : m_usageFlags(_flags)
+GLMesh::~GLMesh()
 {
-    ASSERT_NO_GL_ERROR(glGenBuffers(1, &m_glIndexBuffer));
+    // the vao of pool meshes is owned by the pool
+    if (!m_pool)
+        m_device->releaseVertexArray(m_glVao);
 }
 
-GLIndexBuffer::~GLIndexBuffer()
+GLVertexPool::GLVertexPool(GLRenderDevice * _device) :
+    m_device(_device),
+    m_vertexStride(0),
+    m_vertexCapacity(0),
+    m_indexCapacity(0),
+    m_vertexCount(0),
+    m_indexCount(0),
+    m_glVertexBuffer(0),
+    m_glIndexBuffer(0),
+    m_glVao(0),
+    m_fetchCode(*_device->m_alloc),
+    m_meshes(*_device->m_alloc)
 {
-    glDeleteBuffers(1, &m_glIndexBuffer);
 }
 
-void GLIndexBuffer::loadDataRaw(const void * _data, Size _byteCount)
+GLVertexPool::~GLVertexPool()
 {
-    //@TODO: Take usage into account
-    ASSERT_NO_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, m_glIndexBuffer));
-    ASSERT_NO_GL_ERROR(glBufferData(GL_ARRAY_BUFFER, _byteCount, _data, GL_STATIC_DRAW));
+    // destroy the meshes before the vao they use
+    m_meshes.clear();
+    if (m_glVertexBuffer)
+        glDeleteBuffers(1, &m_glVertexBuffer);
+    if (m_glIndexBuffer)
+        glDeleteBuffers(1, &m_glIndexBuffer);
+    if (m_glVao)
+        glDeleteVertexArrays(1, &m_glVao);
 }
 
-GLMesh::GLMesh(Allocator & _alloc,
-               VertexBuffer ** _vertexBuffers,
-               const VertexLayout * _layouts,
-               Size _count,
-               IndexBuffer * _indexBuffer) :
-    m_vertexBuffers(_alloc),
-    m_indexBuffer(static_cast<GLIndexBuffer *>(_indexBuffer))
+Error GLVertexPool::init(const VertexLayout & _layout, Size _vertexCapacity, Size _indexCapacity)
 {
-    ASSERT_NO_GL_ERROR(glGenVertexArrays(1, &m_glVao));
-    ASSERT_NO_GL_ERROR(glBindVertexArray(m_glVao));
+    static const char * s_scalarTypes[] = { "uint", "int", "float" };
+    static const char * s_vectorTypes[] = { "uvec", "ivec", "vec" };
+    static const char * s_conversions[] = { "", "int", "uintBitsToFloat" };
 
-    for (Size i = 0; i < _count; ++i)
+    // the vertices are fetched from storage buffers
+    STICK_ASSERT(m_device->m_bComputeShaders);
+
+    if (!_layout.isInterleaved())
+        return Error(ec::InvalidOperation,
+                     "Vertex pools only support interleaved layouts",
+                     STICK_FILE,
+                     STICK_LINE);
+
+    for (const auto & el : _layout.elements)
     {
-        GLVertexBuffer * vb = static_cast<GLVertexBuffer *>(_vertexBuffers[i]);
-        const VertexLayout & layout = _layouts[i];
-        ASSERT_NO_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, vb->m_glVertexBuffer));
-        for (const auto & el : layout.elements)
+        if (el.dataType != DataType::UInt32 && el.dataType != DataType::Int32 &&
+            el.dataType != DataType::Float32)
+            return Error(ec::InvalidOperation,
+                         "Vertex pools only support 32 bit vertex element types",
+                         STICK_FILE,
+                         STICK_LINE);
+
+        if (el.bNormalized)
+            return Error(ec::InvalidOperation,
+                         "Vertex pools don't support normalized vertex elements",
+                         STICK_FILE,
+                         STICK_LINE);
+    }
+
+    m_fetchCode.append("layout(std430) readonly buffer DabVertexPoolVertices \n"
+                       "{ \n"
+                       "   uint dabVertexWords[]; \n"
+                       "}; \n"
+                       "layout(std430) readonly buffer DabVertexPoolIndices \n"
+                       "{ \n"
+                       "   uint dabVertexIndices[]; \n"
+                       "}; \n"
+                       "uint dabVertexIndex() \n"
+                       "{ \n"
+                       "   return dabVertexIndices[gl_VertexID]; \n"
+                       "} \n");
+
+    char buffer[256];
+    for (const auto & el : _layout.elements)
+    {
+        Size typeIndex =
+            el.dataType == DataType::UInt32 ? 0 : el.dataType == DataType::Int32 ? 1 : 2;
+        STICK_ASSERT(el.elementCount >= 1 && el.elementCount <= 4);
+        m_vertexStride = el.stride;
+
+        // i.e. vec3 dabFetchAttribute0(uint _vertex)
+        char typeName[16];
+        if (el.elementCount == 1)
+            std::snprintf(typeName, sizeof(typeName), "%s", s_scalarTypes[typeIndex]);
+        else
+            std::snprintf(
+                typeName, sizeof(typeName), "%s%u", s_vectorTypes[typeIndex], el.elementCount);
+
+        std::snprintf(buffer,
+                      sizeof(buffer),
+                      "%s dabFetchAttribute%u(uint _vertex) \n"
+                      "{ \n"
+                      "   uint base = _vertex * %uu + %uu; \n"
+                      "   return %s(",
+                      typeName,
+                      el.location,
+                      el.stride / 4,
+                      el.offset / 4,
+                      typeName);
+        m_fetchCode.append(buffer);
+        for (UInt32 i = 0; i < el.elementCount; ++i)
         {
-            STICK_ASSERT(el.elementCount <= 4);
-            ASSERT_NO_GL_ERROR(glVertexAttribPointer(el.location,
-                                                     static_cast<UInt32>(el.elementCount),
-                                                     s_glDataTypes[static_cast<Size>(el.dataType)],
-                                                     GL_FALSE,
-                                                     static_cast<UInt32>(el.stride),
-                                                     ((char *)0 + el.offset)));
-            ASSERT_NO_GL_ERROR(glEnableVertexAttribArray(el.location));
-            //@TODO: Do we need to support per instance attributes or matrix attributes?
+            std::snprintf(buffer,
+                          sizeof(buffer),
+                          "%s%s(dabVertexWords[base + %uu])",
+                          i > 0 ? ", " : "",
+                          s_conversions[typeIndex],
+                          i);
+            m_fetchCode.append(buffer);
         }
-
-        m_vertexBuffers.append(vb);
+        m_fetchCode.append("); \n} \n");
     }
 
-    if (m_indexBuffer)
-        ASSERT_NO_GL_ERROR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer->m_glIndexBuffer));
+    m_vertexCapacity = (UInt32)_vertexCapacity;
+    m_indexCapacity = (UInt32)_indexCapacity;
+
+    ASSERT_NO_GL_ERROR(glGenVertexArrays(1, &m_glVao));
+    ASSERT_NO_GL_ERROR(glGenBuffers(1, &m_glVertexBuffer));
+    ASSERT_NO_GL_ERROR(glGenBuffers(1, &m_glIndexBuffer));
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_glVertexBuffer));
+    ASSERT_NO_GL_ERROR(glBufferData(
+        GL_SHADER_STORAGE_BUFFER, _vertexCapacity * m_vertexStride, nullptr, GL_STATIC_DRAW));
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_glIndexBuffer));
+    ASSERT_NO_GL_ERROR(glBufferData(
+        GL_SHADER_STORAGE_BUFFER, _indexCapacity * sizeof(UInt32), nullptr, GL_STATIC_DRAW));
+
+    return Error();
+}
+
+Result<Mesh *> GLVertexPool::allocateMesh(const void * _vertices,
+                                          UInt32 _vertexCount,
+                                          const UInt32 * _indices,
+                                          UInt32 _indexCount)
+{
+    if (!_indices)
+        _indexCount = _vertexCount;
+
+    if (m_vertexCount + _vertexCount > m_vertexCapacity ||
+        m_indexCount + _indexCount > m_indexCapacity)
+        return Error(ec::InvalidOperation, "Vertex pool capacity exceeded", STICK_FILE, STICK_LINE);
+
+    // the indices are stored with the vertex base applied, so the shader can use them directly
+    DynamicArray<UInt32> indices(*m_device->m_alloc);
+    indices.resize(_indexCount);
+    for (UInt32 i = 0; i < _indexCount; ++i)
+        indices[i] = m_vertexCount + (_indices ? _indices[i] : i);
+
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_glVertexBuffer));
+    ASSERT_NO_GL_ERROR(glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                                       (GLintptr)m_vertexCount * m_vertexStride,
+                                       (GLsizeiptr)_vertexCount * m_vertexStride,
+                                       _vertices));
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_glIndexBuffer));
+    ASSERT_NO_GL_ERROR(glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                                       (GLintptr)m_indexCount * sizeof(UInt32),
+                                       (GLsizeiptr)_indexCount * sizeof(UInt32),
+                                       indices.ptr()));
+
+    m_meshes.append(makeUnique<GLMesh>(*m_device->m_alloc, *m_device->m_alloc, this, m_indexCount));
+    m_vertexCount += _vertexCount;
+    m_indexCount += _indexCount;
+    return m_meshes.last().get();
+}
+
+void GLVertexPool::clear()
+{
+    m_meshes.clear();
+    m_vertexCount = 0;
+    m_indexCount = 0;
 }
 
-GLMesh::~GLMesh()
+UInt32 GLVertexPool::firstIndex(const Mesh * _mesh) const
 {
-    glDeleteVertexArrays(1, &m_glVao);
+    STICK_ASSERT(static_cast<const GLMesh *>(_mesh)->m_pool == this);
+    return static_cast<const GLMesh *>(_mesh)->m_firstIndex;
+}
+
+const char * GLVertexPool::fetchShaderCode() const
+{
+    return m_fetchCode.cString();
 }
 
 GLRenderPass::GLRenderPass(GLRenderDevice * _device, Allocator & _alloc) :
     m_device(_device),
     m_commands(_alloc),
     m_mappedUBO(nullptr),
-    m_mappedUBOOffset(0)
+    m_mappedUBOOffset(0),
+    m_passID(0),
+    m_drawData(_alloc)
 {
     ASSERT_NO_GL_ERROR(glGenBuffers(1, &m_ubo));
+    ASSERT_NO_GL_ERROR(glGenBuffers(1, &m_drawDataBuffer));
 }
 
 GLRenderPass::~GLRenderPass()
 {
     glDeleteBuffers(1, &m_ubo);
+    glDeleteBuffers(1, &m_drawDataBuffer);
 }
 
 void GLRenderPass::prepareDrawing()
@@ -1370,6 +3952,7 @@ void GLRenderPass::prepareDrawing()
     ASSERT_NO_GL_ERROR(glBufferData(GL_UNIFORM_BUFFER, UNIFORM_BUFFER_SIZE, NULL, GL_DYNAMIC_DRAW));
     m_mappedUBO = (UInt8 *)glMapBuffer(GL_UNIFORM_BUFFER, GL_WRITE_ONLY);
     m_mappedUBOOffset = 0;
+    m_passID = ++m_device->m_passCounter;
     STICK_ASSERT(m_mappedUBO);
 }
 
@@ -1400,29 +3983,172 @@ void GLRenderPass::drawMesh(const Mesh * _mesh,
                             UInt32 _vertexCount,
                             UInt32 _baseVertex,
                             VertexDrawMode _drawMode)
+{
+    drawMeshInstanced(_mesh, _pipeline, _vertexOffset, _vertexCount, _baseVertex, 1, 0, _drawMode);
+}
+
+void GLRenderPass::drawMeshInstanced(const Mesh * _mesh,
+                                     const Pipeline * _pipeline,
+                                     UInt32 _vertexOffset,
+                                     UInt32 _vertexCount,
+                                     UInt32 _instanceCount,
+                                     UInt32 _baseInstance,
+                                     VertexDrawMode _drawMode)
+{
+    drawMeshInstanced(
+        _mesh, _pipeline, _vertexOffset, _vertexCount, 0, _instanceCount, _baseInstance, _drawMode);
+}
+
+void GLRenderPass::drawMeshInstanced(const Mesh * _mesh,
+                                     const Pipeline * _pipeline,
+                                     UInt32 _vertexOffset,
+                                     UInt32 _vertexCount,
+                                     UInt32 _baseVertex,
+                                     UInt32 _instanceCount,
+                                     UInt32 _baseInstance,
+                                     VertexDrawMode _drawMode)
+{
+    GLDrawCmd cmd = makeDrawCmd(_mesh, _pipeline, _drawMode);
+    cmd.vertexOffset = _vertexOffset;
+    cmd.vertexCount = _vertexCount;
+    cmd.baseVertex = _baseVertex;
+    cmd.instanceCount = _instanceCount;
+    cmd.baseInstance = _baseInstance;
+    m_device->m_statistics.recordedDrawCount++;
+
+    // with draw data, the base instance is used to index it
+    if (cmd.pipeline->m_drawDataBlock >= 0)
+    {
+        STICK_ASSERT(_instanceCount == 1);
+        cmd.baseInstance = appendDrawData(cmd.pipeline);
+        if (foldDraw(cmd))
+        {
+            m_device->m_statistics.foldedDrawCount++;
+            return;
+        }
+    }
+    m_commands.append(std::move(cmd));
+}
+
+void GLRenderPass::drawMeshIndirect(const Mesh * _mesh,
+                                    const Pipeline * _pipeline,
+                                    const StorageBuffer * _indirectBuffer,
+                                    Size _byteOffset,
+                                    UInt32 _drawCount,
+                                    UInt32 _stride,
+                                    VertexDrawMode _drawMode)
+{
+    GLDrawCmd cmd = makeDrawCmd(_mesh, _pipeline, _drawMode);
+    cmd.indirectBuffer = static_cast<const GLStorageBuffer *>(_indirectBuffer);
+    cmd.indirectByteOffset = _byteOffset;
+    cmd.indirectDrawCount = _drawCount;
+    cmd.indirectStride = _stride;
+    m_device->m_statistics.recordedDrawCount++;
+    m_commands.append(std::move(cmd));
+}
+
+GLDrawCmd GLRenderPass::makeDrawCmd(const Mesh * _mesh,
+                                    const Pipeline * _pipeline,
+                                    VertexDrawMode _drawMode)
+{
+    const GLPipeline * pipe = static_cast<const GLPipeline *>(_pipeline);
+    STICK_ASSERT(!pipe->m_program->m_bIsCompute);
+
+    GLDrawCmd ret;
+    ret.mesh = static_cast<const GLMesh *>(_mesh);
+    ret.pipeline = pipe;
+    ret.vertexOffset = 0;
+    ret.vertexCount = 0;
+    ret.baseVertex = 0;
+    ret.instanceCount = 1;
+    ret.baseInstance = 0;
+    ret.drawMode = _drawMode;
+    ret.uboBindings = copyUniforms(pipe);
+    ret.indirectBuffer = nullptr;
+    ret.indirectByteOffset = 0;
+    ret.indirectDrawCount = 0;
+    ret.indirectStride = 0;
+    return ret;
+}
+
+void GLRenderPass::dispatch(const Pipeline * _pipeline, UInt32 _x, UInt32 _y, UInt32 _z)
+{
+    const GLPipeline * pipe = static_cast<const GLPipeline *>(_pipeline);
+    STICK_ASSERT(pipe->m_program->m_bIsCompute);
+    m_commands.append((GLDispatchCmd){ pipe, _x, _y, _z, copyUniforms(pipe) });
+}
+
+void GLRenderPass::memoryBarrier(UInt32 _barriers)
+{
+    m_commands.append((GLMemoryBarrierCmd){ glBarrierBits(_barriers) });
+}
+
+GLUBOBindingArray GLRenderPass::copyUniforms(const GLPipeline * _pipeline)
 {
     // copy all the uniforms of the pipeline to the uniform buffer
     GLUBOBindingArray bindings(*m_device->m_alloc);
-    const GLPipeline * pipe = static_cast<const GLPipeline *>(_pipeline);
-    bindings.reserve(pipe->m_uniformBlockStorage.count());
+    bindings.reserve(_pipeline->m_uniformBlockStorage.count());
 
-    for (Size i = 0; i < pipe->m_uniformBlockStorage.count(); ++i)
+    for (Size i = 0; i < _pipeline->m_program->m_uniformBlocks.count(); ++i)
     {
         GLUniformBlockStorage & storage =
-            const_cast<GLUniformBlockStorage &>(pipe->m_uniformBlockStorage[i]);
-        auto & block = pipe->m_program->m_uniformBlocks[i];
-        storage.lastByteOffset = copyToUBO(storage.data.count(), storage.data.ptr());
+            const_cast<GLUniformBlockStorage &>(_pipeline->m_uniformBlockStorage[i]);
+        auto & block = _pipeline->m_program->m_uniformBlocks[i];
+        // only copy the block if it changed since it was last copied in this pass
+        if (storage.bDirty || storage.lastPassID != m_passID)
+        {
+            storage.lastByteOffset = copyToUBO(storage.data.count(), storage.data.ptr());
+            storage.lastPassID = m_passID;
+            storage.bDirty = false;
+        }
         bindings.append(
             { block.bindingPoint, storage.lastByteOffset, (UInt32)storage.data.count() });
     }
+    return bindings;
+}
+
+UInt32 GLRenderPass::appendDrawData(const GLPipeline * _pipeline)
+{
+    const GLUniformBlockStorage & storage = _pipeline->m_uniformBlockStorage.last();
+    Size stride = storage.data.count();
+
+    // the elements have to start at a multiple of the stride so that the buffer can be bound once
+    // for all draws with the same stride
+    Size index = (m_drawData.count() + stride - 1) / stride;
+    m_drawData.resize(index * stride);
+    m_drawData.append(storage.data.begin(), storage.data.end());
+    return (UInt32)index;
+}
+
+bool GLRenderPass::foldDraw(const GLDrawCmd & _cmd)
+{
+    if (!m_commands.count())
+        return false;
+
+    auto mlast = m_commands.last().maybe<GLDrawCmd>();
+    if (!mlast)
+        return false;
+
+    // the previous draw has to be the same draw, and its draw data has to end where the draw data
+    // of _cmd starts
+    GLDrawCmd & last = *mlast;
+    if (last.indirectBuffer || last.mesh != _cmd.mesh || last.pipeline != _cmd.pipeline ||
+        last.drawMode != _cmd.drawMode || last.vertexOffset != _cmd.vertexOffset ||
+        last.vertexCount != _cmd.vertexCount || last.baseVertex != _cmd.baseVertex ||
+        last.baseInstance + last.instanceCount != _cmd.baseInstance)
+        return false;
+
+    // uniform blocks that did not change between the draws share the same UBO range
+    if (last.uboBindings.count() != _cmd.uboBindings.count())
+        return false;
+    for (Size i = 0; i < _cmd.uboBindings.count(); ++i)
+    {
+        if (last.uboBindings[i].byteOffset != _cmd.uboBindings[i].byteOffset)
+            return false;
+    }
 
-    m_commands.append((GLDrawCmd){ static_cast<const GLMesh *>(_mesh),
-                                   static_cast<const GLPipeline *>(_pipeline),
-                                   _vertexOffset,
-                                   _vertexCount,
-                                   _baseVertex,
-                                   _drawMode,
-                                   std::move(bindings) });
+    last.instanceCount++;
+    return true;
 }
 
 void GLRenderPass::drawCustom(ExternalDrawFunction _fn)
@@ -1454,21 +4180,55 @@ void GLRenderPass::reset()
     m_mappedUBOOffset = 0;
     m_mappedUBO = nullptr;
     m_commands.clear();
+    m_drawData.clear();
 }
 
-GLTexture::GLTexture() :
+GLTexture::GLTexture(GLRenderDevice * _device, TextureUsageFlags _usage) :
+    m_device(_device),
     m_glTarget(GL_TEXTURE_2D),
     m_format(TextureFormat::RGBA8),
-    m_renderBuffer(nullptr)
+    m_renderBuffer(nullptr),
+    m_usageFlags(_usage),
+    m_contentHash(0),
+    m_contentByteCount(0),
+    m_bShared(false)
 {
     ASSERT_NO_GL_ERROR(glGenTextures(1, &m_glTexture));
 }
 
 GLTexture::~GLTexture()
 {
+    if (m_bShared &&
+        !releaseSharedContent(
+            m_device->m_sharedTextures, m_contentHash, m_contentByteCount, m_glTexture))
+        return;
     glDeleteTextures(1, &m_glTexture);
 }
 
+// the size of the base level pixels passed to Texture::loadPixels
+static Size pixelByteCount(UInt32 _width,
+                           UInt32 _height,
+                           UInt32 _depth,
+                           DataType _dataType,
+                           GLenum _glFormat,
+                           UInt32 _alignment)
+{
+    Size pixelSize = 4;
+    if (_dataType != DataType::Int2_10_10_10_Rev && _dataType != DataType::UInt2_10_10_10_Rev)
+    {
+        Size componentCount = 4;
+        if (_glFormat == GL_RED)
+            componentCount = 1;
+        else if (_glFormat == GL_RG)
+            componentCount = 2;
+        else if (_glFormat == GL_RGB || _glFormat == GL_BGR)
+            componentCount = 3;
+        pixelSize = componentCount * s_dataTypeByteCount[static_cast<Size>(_dataType)];
+    }
+    Size rowByteCount = alignUp(_width * pixelSize, std::max(_alignment, (UInt32)1));
+    return rowByteCount * std::max(_height, (UInt32)1) * std::max(_depth, (UInt32)1);
+}
+
 void GLTexture::loadPixels(UInt32 _width,
                            UInt32 _height,
                            UInt32 _depth,
@@ -1482,45 +4242,110 @@ void GLTexture::loadPixels(UInt32 _width,
     if (_height > 1)
         m_glTarget = _depth > 1 ? GL_TEXTURE_3D : GL_TEXTURE_2D;
 
-    ASSERT_NO_GL_ERROR(glActiveTexture(GL_TEXTURE0));
-    ASSERT_NO_GL_ERROR(glBindTexture(m_glTarget, m_glTexture));
-
-    // tex.format = cmd.command.loadPixelsCommand.format;
-    ASSERT_NO_GL_ERROR(glPixelStorei(GL_UNPACK_ALIGNMENT, _alignment));
-
     GLenum glDataType = s_glDataTypes[static_cast<Size>(_dataType)];
     const GLTextureFormat & format = s_glTextureFormats[static_cast<Size>(_format)];
+    m_format = _format;
 
-    if (m_glTarget == GL_TEXTURE_1D)
+    // new pixels end the sharing, the texture keeps the GL texture if it was the last user
+    if (m_bShared)
     {
-        ASSERT_NO_GL_ERROR(glTexImage1D(
-            m_glTarget, 0, format.glInternalFormat, _width, 0, format.glFormat, glDataType, _data));
+        if (!releaseSharedContent(
+                m_device->m_sharedTextures, m_contentHash, m_contentByteCount, m_glTexture))
+            ASSERT_NO_GL_ERROR(glGenTextures(1, &m_glTexture));
+        m_bShared = false;
     }
-    else if (m_glTarget == GL_TEXTURE_2D)
+
+    // the parameters go into the seed and the retained copy, so that the same bytes with a
+    // different layout or format are not considered equal
+    UInt32 params[] = { _width,
+                        _height,
+                        _depth,
+                        static_cast<UInt32>(_dataType),
+                        static_cast<UInt32>(_format),
+                        _alignment,
+                        _mipmapLevelCount };
+    bool bDeduplicate = (m_usageFlags & TextureUsageDeduplicate) && _data &&
+                        s_textureFormatInfos[static_cast<Size>(_format)].bIsColorFormat;
+    if (bDeduplicate)
     {
-        ASSERT_NO_GL_ERROR(glTexImage2D(m_glTarget,
-                                        0,
-                                        format.glInternalFormat,
-                                        _width,
-                                        _height,
-                                        0,
-                                        format.glFormat,
-                                        glDataType,
-                                        _data));
+        m_contentByteCount =
+            pixelByteCount(_width, _height, _depth, _dataType, format.glFormat, _alignment);
+        m_contentHash =
+            hashBytes(_data, m_contentByteCount, hashBytes(params, sizeof(params)));
+        m_bShared = true;
+
+        GLSharedContent * shared = acquireSharedContent(m_device->m_sharedTextures,
+                                                        m_contentHash,
+                                                        params,
+                                                        sizeof(params),
+                                                        _data,
+                                                        m_contentByteCount);
+        if (shared)
+        {
+            glDeleteTextures(1, &m_glTexture);
+            m_glTexture = shared->glObject;
+            return;
+        }
     }
-    else if (m_glTarget == GL_TEXTURE_3D)
+
+    ASSERT_NO_GL_ERROR(glActiveTexture(GL_TEXTURE0));
+    ASSERT_NO_GL_ERROR(glBindTexture(m_glTarget, m_glTexture));
+
+    // tex.format = cmd.command.loadPixelsCommand.format;
+    ASSERT_NO_GL_ERROR(glPixelStorei(GL_UNPACK_ALIGNMENT, _alignment));
+
+    // _data only provides the base level, the remaining mip levels are allocated so that they can
+    // be filled by rendering or image stores.
+    UInt32 levelCount = std::max(_mipmapLevelCount, (UInt32)1);
+    ASSERT_NO_GL_ERROR(glTexParameteri(m_glTarget, GL_TEXTURE_BASE_LEVEL, 0));
+    ASSERT_NO_GL_ERROR(glTexParameteri(m_glTarget, GL_TEXTURE_MAX_LEVEL, levelCount - 1));
+
+    for (UInt32 level = 0; level < levelCount; ++level)
     {
-        ASSERT_NO_GL_ERROR(glTexImage3D(m_glTarget,
-                                        0,
-                                        format.glInternalFormat,
-                                        _width,
-                                        _height,
-                                        _depth,
-                                        0,
-                                        format.glFormat,
-                                        glDataType,
-                                        _data));
+        const void * data = level == 0 ? _data : nullptr;
+        GLsizei w = std::max(_width >> level, (UInt32)1);
+        GLsizei h = std::max(_height >> level, (UInt32)1);
+        GLsizei d = std::max(_depth >> level, (UInt32)1);
+        if (m_glTarget == GL_TEXTURE_1D)
+        {
+            ASSERT_NO_GL_ERROR(glTexImage1D(
+                m_glTarget, level, format.glInternalFormat, w, 0, format.glFormat, glDataType, data));
+        }
+        else if (m_glTarget == GL_TEXTURE_2D)
+        {
+            ASSERT_NO_GL_ERROR(glTexImage2D(m_glTarget,
+                                            level,
+                                            format.glInternalFormat,
+                                            w,
+                                            h,
+                                            0,
+                                            format.glFormat,
+                                            glDataType,
+                                            data));
+        }
+        else if (m_glTarget == GL_TEXTURE_3D)
+        {
+            ASSERT_NO_GL_ERROR(glTexImage3D(m_glTarget,
+                                            level,
+                                            format.glInternalFormat,
+                                            w,
+                                            h,
+                                            d,
+                                            0,
+                                            format.glFormat,
+                                            glDataType,
+                                            data));
+        }
     }
+
+    if (m_bShared)
+        addSharedContent(m_device->m_sharedTextures,
+                         m_contentHash,
+                         params,
+                         sizeof(params),
+                         _data,
+                         m_contentByteCount,
+                         m_glTexture);
 }
 
 GLSampler::GLSampler(const SamplerSettings & _settings)
@@ -1602,7 +4427,7 @@ Error GLRenderBuffer::init(const RenderBufferSettings & _settings)
         const GLTextureFormat & format = s_glTextureFormats[static_cast<Size>(rt.format)];
         bool bIsColorAttachment = info.bIsColorFormat;
 
-        auto tex = makeUnique<GLTexture>(*m_device->m_alloc);
+        auto tex = makeUnique<GLTexture>(*m_device->m_alloc, m_device, TextureUsageDefault);
         tex->m_glTarget = GL_TEXTURE_2D;
         tex->m_format = rt.format;
         tex->m_renderBuffer = this;
@@ -1854,5 +4679,419 @@ void GLRenderBuffer::finalizeForReading(GLRenderBuffer * _currentBuffer)
     }
 }
 
+Result<TransientGeometry> GLRenderPass::allocateTransientGeometry(const VertexLayout & _layout,
+                                                                  UInt32 _vertexCount,
+                                                                  UInt32 _indexCount)
+{
+    if (!m_device->m_bBufferStorage)
+        return Error(ec::InvalidOperation,
+                     "Transient geometry requires GL 4.4 or ARB_buffer_storage",
+                     STICK_FILE,
+                     STICK_LINE);
+    if (!m_device->m_transientAllocator)
+        m_device->m_transientAllocator =
+            makeUnique<GLTransientAllocator>(*m_device->m_alloc, m_device);
+    return m_device->m_transientAllocator->allocate(this, _layout, _vertexCount, _indexCount);
+}
+
+// Returns the offset of _byteCount free bytes in a ring buffer of _capacity bytes, where
+// allocations end at _head and the oldest one still in use starts at _tail (nullptr if there are
+// none).
+static Maybe<Size> findRingSpace(
+    Size _capacity, Size _head, const Size * _tail, Size _byteCount, Size _alignment)
+{
+    Size offset = alignUp(_head, _alignment);
+    if (!_tail)
+        return offset + _byteCount <= _capacity ? offset : 0;
+
+    if (_head > *_tail)
+    {
+        if (offset + _byteCount <= _capacity)
+            return offset;
+        // wrap around
+        if (_byteCount <= *_tail)
+            return (Size)0;
+    }
+    else if (offset + _byteCount <= *_tail)
+        return offset;
+    return Maybe<Size>();
+}
+
+GLUploadQueue::GLUploadQueue(GLRenderDevice * _device) :
+    m_device(_device),
+    m_glStagingBuffer(0),
+    m_mapped(nullptr),
+    m_stagingByteCount(0),
+    m_head(0),
+    m_bytesPerFrame(0),
+    m_nextID(1),
+    m_uploads(*_device->m_alloc)
+{
+}
+
+GLUploadQueue::~GLUploadQueue()
+{
+    // the driver keeps the buffer alive until pending copies finished
+    if (m_glStagingBuffer)
+        glDeleteBuffers(1, &m_glStagingBuffer);
+}
+
+Error GLUploadQueue::init(Size _stagingByteCount, Size _bytesPerFrame)
+{
+    // the staging buffer stays mapped while the GPU copies from it
+    if (!m_device->m_bBufferStorage)
+        return Error(ec::InvalidOperation,
+                     "Upload queues require GL 4.4 or ARB_buffer_storage",
+                     STICK_FILE,
+                     STICK_LINE);
+
+    m_stagingByteCount = _stagingByteCount;
+    m_bytesPerFrame = _bytesPerFrame;
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    ASSERT_NO_GL_ERROR(glGenBuffers(1, &m_glStagingBuffer));
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_READ_BUFFER, m_glStagingBuffer));
+    ASSERT_NO_GL_ERROR(glBufferStorage(GL_COPY_READ_BUFFER, _stagingByteCount, nullptr, flags));
+    m_mapped =
+        static_cast<UInt8 *>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, _stagingByteCount, flags));
+    if (!m_mapped)
+        return Error(
+            ec::InvalidOperation, "Could not map the staging buffer", STICK_FILE, STICK_LINE);
+    return Error();
+}
+
+Result<UploadID> GLUploadQueue::enqueue(VertexBuffer * _buffer,
+                                        Size _byteOffset,
+                                        const void * _data,
+                                        Size _byteCount)
+{
+    const GLVertexBuffer * buff = static_cast<const GLVertexBuffer *>(_buffer);
+    return enqueueImpl(
+        buff, nullptr, buff->m_usageFlags, buff->m_range, _byteOffset, _data, _byteCount);
+}
+
+Result<UploadID> GLUploadQueue::enqueue(IndexBuffer * _buffer,
+                                        Size _byteOffset,
+                                        const void * _data,
+                                        Size _byteCount)
+{
+    const GLIndexBuffer * buff = static_cast<const GLIndexBuffer *>(_buffer);
+    return enqueueImpl(
+        nullptr, buff, buff->m_usageFlags, buff->m_range, _byteOffset, _data, _byteCount);
+}
+
+Result<UploadID> GLUploadQueue::enqueueImpl(const GLVertexBuffer * _vertexBuffer,
+                                            const GLIndexBuffer * _indexBuffer,
+                                            BufferUsageFlags _usage,
+                                            const GLSuballocation & _range,
+                                            Size _byteOffset,
+                                            const void * _data,
+                                            Size _byteCount)
+{
+    // the copies of multi-buffered buffers would only end up in one of them
+    if (isMultiBuffered(_usage))
+        return Error(ec::InvalidOperation,
+                     "Uploads into dynamic or stream buffers are not supported",
+                     STICK_FILE,
+                     STICK_LINE);
+    // enqueue may be called from other threads, so deduplicated buffers can't be detached here
+    if (_usage & BufferUsageDeduplicate)
+        return Error(ec::InvalidOperation,
+                     "Uploads into deduplicated buffers are not supported",
+                     STICK_FILE,
+                     STICK_LINE);
+    if (_byteOffset + _byteCount > _range.byteCount)
+        return Error(ec::InvalidOperation,
+                     "The upload exceeds the destination buffer size",
+                     STICK_FILE,
+                     STICK_LINE);
+    if (_byteCount > m_stagingByteCount)
+        return Error(ec::InvalidOperation,
+                     "The upload is bigger than the staging buffer",
+                     STICK_FILE,
+                     STICK_LINE);
+
+    Size stagingOffset;
+    UploadID id;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // an empty reservation would make the ring look full, so there is nothing to enqueue
+        if (!_byteCount)
+            return m_nextID++;
+
+        Maybe<Size> found =
+            findRingSpace(m_stagingByteCount,
+                          m_head,
+                          m_uploads.count() ? &m_uploads[0].stagingOffset : nullptr,
+                          _byteCount,
+                          16);
+        if (!found)
+            return s_noStagingSpace;
+
+        stagingOffset = *found;
+        m_head = stagingOffset + _byteCount;
+        id = m_nextID++;
+        m_uploads.append(
+            { id, _vertexBuffer, _indexBuffer, _byteOffset, stagingOffset, _byteCount, false, 0 });
+    }
+
+    // the staging memory is reserved, so the copy can happen without holding the lock
+    std::memcpy(m_mapped + stagingOffset, _data, _byteCount);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto & upload : m_uploads)
+    {
+        if (upload.id == id)
+        {
+            upload.bStaged = true;
+            break;
+        }
+    }
+    return id;
+}
+
+void GLUploadQueue::process()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // release the staging memory of completed uploads. The fences are polled here as well, as
+    // uploads may be processed without any pass being submitted.
+    m_device->pollSubmitFences();
+    while (m_uploads.count() && m_uploads[0].fenceSerial &&
+           m_uploads[0].fenceSerial <= m_device->m_completedSerial)
+        m_uploads.remove(m_uploads.begin());
+
+    Size issuedByteCount = 0;
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_READ_BUFFER, m_glStagingBuffer));
+    for (auto & upload : m_uploads)
+    {
+        if (upload.fenceSerial)
+            continue;
+        // uploads are issued in order, so that later uploads to the same range don't overtake
+        if (!upload.bStaged ||
+            (issuedByteCount && issuedByteCount + upload.byteCount > m_bytesPerFrame))
+            break;
+
+        GLuint dst = upload.vertexBuffer ? upload.vertexBuffer->m_glVertexBuffer
+                                         : upload.indexBuffer->m_glIndexBuffer;
+        Size dstOffset = upload.vertexBuffer ? upload.vertexBuffer->byteOffset()
+                                             : upload.indexBuffer->byteOffset();
+        ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, dst));
+        ASSERT_NO_GL_ERROR(glCopyBufferSubData(GL_COPY_READ_BUFFER,
+                                               GL_COPY_WRITE_BUFFER,
+                                               upload.stagingOffset,
+                                               dstOffset + upload.byteOffset,
+                                               upload.byteCount));
+        issuedByteCount += upload.byteCount;
+        upload.fenceSerial = m_device->m_submitSerial + 1;
+    }
+
+    if (issuedByteCount)
+        m_device->insertSubmitFence();
+}
+
+void GLUploadQueue::setBytesPerFrame(Size _byteCount)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bytesPerFrame = _byteCount;
+}
+
+Size GLUploadQueue::stagingByteCount() const
+{
+    return m_stagingByteCount;
+}
+
+bool GLUploadQueue::isComplete(UploadID _id) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::none_of(m_uploads.begin(), m_uploads.end(), [_id](const GLUpload & _upload) {
+        return _upload.id == _id;
+    });
+}
+
+bool GLUploadQueue::isResident(const Mesh * _mesh) const
+{
+    const GLMesh * mesh = static_cast<const GLMesh *>(_mesh);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto & upload : m_uploads)
+    {
+        if (upload.indexBuffer && upload.indexBuffer == mesh->m_indexBuffer)
+            return false;
+        for (const auto & binding : mesh->m_bindings)
+        {
+            if (upload.vertexBuffer == binding.buffer)
+                return false;
+        }
+    }
+    return true;
+}
+
+GLTransientRing::GLTransientRing(GLRenderDevice * _device, GLuint _glBuffer, Size _byteCount) :
+    m_device(_device),
+    m_byteCount(_byteCount),
+    m_head(0),
+    m_ranges(*_device->m_alloc)
+{
+    STICK_ASSERT(_device->m_bBufferStorage);
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    ASSERT_NO_GL_ERROR(glBindBuffer(GL_COPY_WRITE_BUFFER, _glBuffer));
+    ASSERT_NO_GL_ERROR(glBufferStorage(GL_COPY_WRITE_BUFFER, _byteCount, nullptr, flags));
+    m_mapped =
+        static_cast<UInt8 *>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, _byteCount, flags));
+    STICK_ASSERT(m_mapped);
+}
+
+Result<Size> GLTransientRing::allocate(const GLRenderPass * _pass,
+                                       Size _byteCount,
+                                       Size _alignment)
+{
+    if (_byteCount > m_byteCount)
+        return Error(ec::InvalidOperation,
+                     "The transient geometry exceeds the ring buffer size",
+                     STICK_FILE,
+                     STICK_LINE);
+    // an empty range would make the ring look full, and there is nothing to write anyway
+    if (!_byteCount)
+        return (Size)0;
+
+    while (true)
+    {
+        // release the ranges the GPU is done with
+        while (m_ranges.count() && m_ranges[0].serial &&
+               m_ranges[0].serial <= m_device->m_completedSerial)
+            m_ranges.remove(m_ranges.begin());
+
+        Maybe<Size> found = findRingSpace(m_byteCount,
+                                          m_head,
+                                          m_ranges.count() ? &m_ranges[0].begin : nullptr,
+                                          _byteCount,
+                                          _alignment);
+        if (found)
+        {
+            Size begin = *found;
+            Size end = begin + _byteCount;
+            // extend the last range if it belongs to the same pass and did not wrap around
+            if (m_ranges.count() && m_ranges.last().pass == _pass && !m_ranges.last().serial &&
+                begin >= m_ranges.last().end)
+                m_ranges.last().end = end;
+            else
+                m_ranges.append({ _pass, 0, begin, end });
+            m_head = end;
+            return begin;
+        }
+
+        // the ring is full, wait for the oldest submitted pass
+        if (!m_ranges[0].serial)
+            return Error(ec::InvalidOperation,
+                         "The transient geometry ring is full with geometry of passes that did not "
+                         "end yet",
+                         STICK_FILE,
+                         STICK_LINE);
+        auto err = m_device->waitForSubmission(m_ranges[0].serial);
+        if (err)
+            return err;
+    }
+}
+
+void GLTransientRing::submit(const GLRenderPass * _pass, UInt64 _serial)
+{
+    for (auto & range : m_ranges)
+    {
+        if (range.pass == _pass && !range.serial)
+            range.serial = _serial;
+    }
+}
+
+static bool sameElements(const VertexLayout & _a, const VertexLayout & _b)
+{
+    if (_a.elements.count() != _b.elements.count())
+        return false;
+    for (Size i = 0; i < _a.elements.count(); ++i)
+    {
+        const VertexElement & a = _a.elements[i];
+        const VertexElement & b = _b.elements[i];
+        if (a.dataType != b.dataType || a.elementCount != b.elementCount || a.offset != b.offset ||
+            a.stride != b.stride || a.location != b.location || a.divisor != b.divisor ||
+            a.bNormalized != b.bNormalized || a.bInteger != b.bInteger)
+            return false;
+    }
+    return true;
+}
+
+GLTransientAllocator::GLTransientAllocator(GLRenderDevice * _device) :
+    m_device(_device),
+    m_vertexBuffer(_device, BufferUsageStatic),
+    m_indexBuffer(_device, BufferUsageStatic),
+    m_vertices(_device, m_vertexBuffer.m_glVertexBuffer, TRANSIENT_VERTEX_RING_SIZE),
+    m_indices(_device, m_indexBuffer.m_glIndexBuffer, TRANSIENT_INDEX_RING_SIZE),
+    m_meshes(*_device->m_alloc)
+{
+}
+
+Result<TransientGeometry> GLTransientAllocator::allocate(const GLRenderPass * _pass,
+                                                         const VertexLayout & _layout,
+                                                         UInt32 _vertexCount,
+                                                         UInt32 _indexCount)
+{
+    STICK_ASSERT(_layout.elements.count() && _layout.hash);
+    if (!_layout.isInterleaved())
+        return Error(ec::InvalidOperation,
+                     "Transient geometry only supports interleaved layouts",
+                     STICK_FILE,
+                     STICK_LINE);
+    Size stride = _layout.elements[0].stride;
+
+    auto vres = m_vertices.allocate(_pass, stride * _vertexCount, stride);
+    if (!vres)
+        return vres.error();
+
+    TransientGeometry ret;
+    ret.vertices = m_vertices.m_mapped + vres.get();
+    ret.vertexCount = _vertexCount;
+    ret.baseVertex = (UInt32)(vres.get() / stride);
+    ret.indices = nullptr;
+    ret.indexCount = _indexCount;
+    ret.firstIndex = 0;
+    if (_indexCount)
+    {
+        auto ires = m_indices.allocate(_pass, sizeof(UInt32) * _indexCount, sizeof(UInt32));
+        if (!ires)
+            return ires.error();
+        ret.indices = reinterpret_cast<UInt32 *>(m_indices.m_mapped + ires.get());
+        ret.firstIndex = (UInt32)(ires.get() / sizeof(UInt32));
+    }
+
+    // the hash only narrows it down, different layouts may share it
+    bool bIndexed = _indexCount > 0;
+    auto it = std::find_if(m_meshes.begin(), m_meshes.end(), [&](const GLTransientMesh & _m) {
+        return _m.bIndexed == bIndexed && _m.layout.hash == _layout.hash &&
+               sameElements(_m.layout, _layout);
+    });
+    if (it != m_meshes.end())
+    {
+        ret.mesh = (*it).mesh.get();
+    }
+    else
+    {
+        VertexBuffer * vb = &m_vertexBuffer;
+        m_meshes.append({ _layout,
+                          bIndexed,
+                          makeUnique<GLMesh>(*m_device->m_alloc,
+                                             m_device,
+                                             &vb,
+                                             &_layout,
+                                             1,
+                                             bIndexed ? &m_indexBuffer : nullptr) });
+        ret.mesh = m_meshes.last().mesh.get();
+    }
+    return ret;
+}
+
+void GLTransientAllocator::submit(const GLRenderPass * _pass, UInt64 _serial)
+{
+    m_vertices.submit(_pass, _serial);
+    m_indices.submit(_pass, _serial);
+}
+
 } // namespace gl
 } // namespace dab
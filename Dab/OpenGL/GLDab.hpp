@@ -9,6 +9,8 @@
 #include <Stick/UniquePtr.hpp>
 #include <Stick/Variant.hpp>
 
+#include <mutex>
+
 namespace dab
 {
 namespace gl
@@ -58,7 +60,8 @@ enum STICK_API RenderFlag : UInt64
     RF_DepthFuncShift = RF_CullFaceShift + 24,
     RF_DepthFuncMask = ((UInt64)1 << RF_DepthFuncShift) | ((UInt64)1 << (RF_DepthFuncShift + 1)) |
                        ((UInt64)1 << (RF_DepthFuncShift + 2)) |
-                       ((UInt64)1 << (RF_DepthFuncShift + 3))
+                       ((UInt64)1 << (RF_DepthFuncShift + 3)),
+    RF_PrimitiveRestart = (UInt64)1 << (RF_DepthFuncShift + 4)
 };
 
 //@TODO: Complete this list with array types etc.
@@ -96,6 +99,10 @@ struct STICK_API GLUniformBlockStorage
     // that stored the most recent version of it.
     // this is updated by each draw call.
     UInt32 lastByteOffset;
+    // the pass that lastByteOffset refers to. If the data did not change since, the region is
+    // reused rather than copying the data again.
+    UInt64 lastPassID;
+    bool bDirty;
     DynamicArray<char> data;
 };
 using GLUniformBlockStorageArray = stick::DynamicArray<GLUniformBlockStorage>;
@@ -112,22 +119,76 @@ struct STICK_API GLTextureBinding
 {
     String name;
     GLuint location; // uniform location of the sampler
+    GLuint unit;     // texture unit the sampler reads from
 };
 using GLTextureBindingArray = stick::DynamicArray<GLTextureBinding>;
 
+struct STICK_API GLStorageBlockBinding
+{
+    String name;
+    UInt32 bindingPoint;
+    // if the block consists of an unsized array, the layout of one of its elements (see
+    // PipelineSettings::drawDataBlock). 0 otherwise.
+    UInt32 arrayStride;
+    StaticArray<GLBlockedUniform, 16> members;
+};
+using GLStorageBlockBindingArray = stick::DynamicArray<GLStorageBlockBinding>;
+
+struct STICK_API GLImageBinding
+{
+    String name;
+    GLuint location; // uniform location of the image
+    GLuint unit;     // image unit the image is bound to
+};
+using GLImageBindingArray = stick::DynamicArray<GLImageBinding>;
+
+class GLRenderDevice;
+
+class STICK_API GLShader : public Shader
+{
+    friend class GLRenderDevice;
+
+  public:
+    GLShader();
+    Error init(GLRenderDevice * _device, ShaderStage _stage, const char * _code);
+    ~GLShader() override;
+
+    GLuint m_glProgram; // separable program holding the single stage
+    ShaderStage m_stage;
+    GLUniformBlockArray m_uniformBlocks;
+    GLTextureBindingArray m_textures;
+    GLStorageBlockBindingArray m_storageBlocks;
+    GLImageBindingArray m_images;
+};
+
 class STICK_API GLProgram : public Program
 {
     friend class GLRenderDevice;
 
   public:
     GLProgram();
-    Error init(Allocator & _alloc, const char * _vertexShader, const char * _pixelShader);
+    // _sources are indexed by ShaderStage, stages that are nullptr are skipped
+    // _bStorageReflection has to be false if the context has no shader storage blocks (pre GL 4.3)
+    Error init(Allocator & _alloc, const char * const * _sources, bool _bStorageReflection);
+    Error init(Allocator & _alloc, Shader * const * _stages, Size _count);
     ~GLProgram() override;
 
-    GLuint m_glProgram;
+    GLuint m_glProgram;         // 0 for programs built from separable stages
+    GLuint m_glProgramPipeline; // 0 for monolithic programs
+    bool m_bHasTessellation;    // if true, the program can only draw VertexDrawMode::Patches
+    bool m_bIsCompute;          // if true, the program can only be dispatched
     GLUniformBlockArray m_uniformBlocks;
     // the textures that the program requires/uses
     GLTextureBindingArray m_textures;
+    GLStorageBlockBindingArray m_storageBlocks;
+    GLImageBindingArray m_images;
+    // indices into m_storageBlocks of the vertex pool blocks declared by
+    // VertexPool::fetchShaderCode, -1 if the program does not use them
+    Int32 m_vertexPoolVerticesBlock;
+    Int32 m_vertexPoolIndicesBlock;
+
+  private:
+    void findVertexPoolBlocks();
 };
 
 class GLPipeline;
@@ -170,9 +231,54 @@ class STICK_API GLPipelineTexture : public PipelineTexture
     const GLSampler * m_sampler;
 };
 
+class GLVertexBuffer;
+class GLIndexBuffer;
+class GLStorageBuffer;
+class STICK_API GLPipelineBuffer : public PipelineBuffer
+{
+    friend class GLRenderDevice;
+
+  public:
+    GLPipelineBuffer(GLPipeline * _pipe);
+    void set(const StorageBuffer * _buffer, Size _byteOffset, Size _byteCount) override;
+    void set(const VertexBuffer * _buffer, Size _byteOffset, Size _byteCount) override;
+    void set(const IndexBuffer * _buffer, Size _byteOffset, Size _byteCount) override;
+
+    void setHelper(Size _byteOffset, Size _byteCount);
+
+    // the GL buffer and range to bind. Multi-buffered, deduplicated and suballocated buffers
+    // change their GL buffer or offset over time, so this is resolved when binding. Returns false
+    // if no buffer is set.
+    bool resolve(GLuint & _outGLBuffer, Size & _outByteOffset, Size & _outByteCount) const;
+
+    GLPipeline * m_pipeline;
+    // at most one of the buffers is set
+    const GLStorageBuffer * m_storageBuffer;
+    const GLVertexBuffer * m_vertexBuffer;
+    const GLIndexBuffer * m_indexBuffer;
+    Size m_byteOffset; // relative to the start of the buffer
+    Size m_byteCount;  // 0 binds the whole buffer
+};
+
+class STICK_API GLPipelineImage : public PipelineImage
+{
+    friend class GLRenderDevice;
+
+  public:
+    GLPipelineImage(GLPipeline * _pipe);
+    void set(const Texture * _tex, UInt32 _level, ImageAccess _access) override;
+
+    GLPipeline * m_pipeline;
+    const GLTexture * m_texture;
+    UInt32 m_level;
+    ImageAccess m_access;
+};
+
 //@NOTE: For implementation simplicity we heap allocate each pipeline variable/texture for now...
 using GLPipelineVariableArray = stick::DynamicArray<UniquePtr<GLPipelineVariable>>;
 using GLPipelineTextureArray = stick::DynamicArray<UniquePtr<GLPipelineTexture>>;
+using GLPipelineBufferArray = stick::DynamicArray<UniquePtr<GLPipelineBuffer>>;
+using GLPipelineImageArray = stick::DynamicArray<UniquePtr<GLPipelineImage>>;
 
 class STICK_API GLPipeline : public Pipeline
 {
@@ -183,31 +289,120 @@ class STICK_API GLPipeline : public Pipeline
     ~GLPipeline() override;
     PipelineVariable * variable(const char * _name) override;
     PipelineTexture * texture(const char * _name) override;
+    PipelineBuffer * buffer(const char * _name) override;
+    PipelineImage * image(const char * _name) override;
+
+    // block indices past the program's uniform blocks refer to the draw data block
+    GLBlockedUniform & blockedUniform(UInt32 _blockIndex, UInt32 _uniformIndex);
 
     GLProgram * m_program;
     // bitmask of opengl render state flags for this pipeline
     UInt64 m_renderState;
     Rect m_scissorRect;
     Rect m_viewportRect;
+    UInt32 m_patchVertexCount;
     bool m_bChangedSinceLastDrawCall;
     GLPipelineVariableArray m_variables;
     GLPipelineTextureArray m_textures;
+    GLPipelineBufferArray m_buffers;
+    GLPipelineImageArray m_images;
+    // storage of the uniform blocks followed by the draw data storage (if any)
     GLUniformBlockStorageArray m_uniformBlockStorage;
+    Int32 m_drawDataBlock; // index into the program's storage blocks, -1 if not used
+};
+
+struct STICK_LOCAL GLFreeRange
+{
+    Size byteOffset;
+    Size byteCount;
 };
 
+// One big buffer that BufferUsageSuballocate buffers are stored in. The free ranges are kept
+// sorted by offset so that neighbours can be coalesced on free, allocations take the best fitting
+// range. The device keeps track of which buffer lives where (see compactBufferPools).
+class STICK_LOCAL GLBufferArena
+{
+  public:
+    // without _bBufferStorage (GL 4.4 or ARB_buffer_storage) the storage is allocated mutable
+    GLBufferArena(Allocator & _alloc, Size _byteCount, bool _bBufferStorage);
+    ~GLBufferArena();
+
+    // _alignment does not need to be a power of two, vertex data is aligned to its stride
+    bool allocate(Size _byteCount, Size _alignment, Size & _outByteOffset);
+    void free(Size _byteOffset, Size _byteCount);
+    // marks everything up to _byteCount as used, only used after compaction
+    void reset(Size _usedByteCount, UInt32 _allocationCount);
+    void addStatistics(BufferPoolStatistics & _stats) const;
+
+    GLuint m_glBuffer;
+    Size m_byteCount;
+    Size m_usedByteCount;
+    UInt32 m_allocationCount;
+    DynamicArray<GLFreeRange> m_freeRanges;
+};
+using GLBufferArenaArray = stick::DynamicArray<stick::UniquePtr<GLBufferArena>>;
+
+// the range of a suballocated buffer
+struct STICK_LOCAL GLSuballocation
+{
+    GLBufferArena * arena; // nullptr if the buffer is not suballocated (yet)
+    Size byteOffset;
+    Size byteCount; // also tracks the size of buffers that are not suballocated
+    Size alignment;
+};
+
+#define BUFFER_COPY_COUNT 3
+
+// The GL buffers of a BufferUsageDynamic or BufferUsageStream buffer. Each copy remembers the last
+// pass submission that may read it, see GLRenderDevice::waitForSubmission.
+struct STICK_LOCAL GLBufferCopies
+{
+    GLuint glBuffers[BUFFER_COPY_COUNT];
+    UInt64 submitSerials[BUFFER_COPY_COUNT];
+    UInt32 current;
+    UInt64 currentSince; // the submit serial at which the current copy became current
+};
+
+// A GL buffer or texture shared by all BufferUsageDeduplicate buffers or TextureUsageDeduplicate
+// textures that were loaded with the same content. The hash only finds candidates, content is
+// only shared if the retained copy of the bytes matches, too.
+struct STICK_LOCAL GLSharedContent
+{
+    UInt64 hash;
+    Size byteCount;
+    GLuint glObject;
+    UInt32 refCount;
+    DynamicArray<UInt8> data; // the parameters (textures only) followed by the byteCount bytes
+};
+
+using GLSharedContentArray = stick::DynamicArray<GLSharedContent>; // sorted by hash and byteCount
+
 class STICK_API GLVertexBuffer : public VertexBuffer
 {
     friend class GLRenderDevice;
 
   public:
-    GLVertexBuffer(BufferUsageFlags _flags);
+    GLVertexBuffer(GLRenderDevice * _device, BufferUsageFlags _flags);
 
     ~GLVertexBuffer() override;
 
     void loadDataRaw(const void * _data, Size _byteCount) override;
+    Error updateRange(Size _byteOffset, const void * _data, Size _byteCount) override;
+    Result<void *> map(Size _byteOffset, Size _byteCount, UInt32 _flags) override;
+    Error unmap() override;
+
+    Size byteOffset() const override;
 
-    GLuint m_glVertexBuffer;
+    // moves suballocated data to an offset that is a multiple of _alignment
+    void alignSuballocation(Size _alignment);
+
+    GLRenderDevice * m_device;
+    GLuint m_glVertexBuffer; // the buffer of the arena if suballocated, the current copy if dynamic
     BufferUsageFlags m_usageFlags;
+    GLSuballocation m_range;
+    GLBufferCopies m_copies;
+    UInt64 m_contentHash;
+    bool m_bShared; // m_glVertexBuffer is shared with other deduplicated buffers
 };
 
 class STICK_API GLIndexBuffer : public IndexBuffer
@@ -215,38 +410,187 @@ class STICK_API GLIndexBuffer : public IndexBuffer
     friend class GLRenderDevice;
 
   public:
-    GLIndexBuffer(BufferUsageFlags _flags);
+    GLIndexBuffer(GLRenderDevice * _device,
+                  BufferUsageFlags _flags,
+                  DataType _indexType = DataType::UInt32);
 
     ~GLIndexBuffer() override;
 
+    void loadDataRaw(const void * _data, Size _byteCount) override;
+    void loadIndices(const UInt32 * _indices, Size _count) override;
+    Error updateRange(Size _byteOffset, const void * _data, Size _byteCount) override;
+    Result<void *> map(Size _byteOffset, Size _byteCount, UInt32 _flags) override;
+    Error unmap() override;
+
+    Size byteOffset() const override;
+
+    DataType indexType() const override;
+    void setIndexType(DataType _type) override;
+
+    GLRenderDevice * m_device;
+    GLuint m_glIndexBuffer; // the buffer of the arena if suballocated, the current copy if dynamic
+    BufferUsageFlags m_usageFlags;
+    GLSuballocation m_range;
+    GLBufferCopies m_copies;
+    DataType m_indexType;
+    UInt64 m_contentHash;
+    bool m_bShared; // m_glIndexBuffer is shared with other deduplicated buffers
+};
+
+class STICK_API GLStorageBuffer : public StorageBuffer
+{
+    friend class GLRenderDevice;
+
+  public:
+    GLStorageBuffer(BufferUsageFlags _flags);
+
+    ~GLStorageBuffer() override;
+
     void loadDataRaw(const void * _data, Size _byteCount) override;
 
-    GLuint m_glIndexBuffer;
+    GLuint m_glStorageBuffer;
     BufferUsageFlags m_usageFlags;
 };
 
+// the vertex buffer range that feeds one vertex element
+struct STICK_LOCAL GLVertexBinding
+{
+    const GLVertexBuffer * buffer;
+    GLintptr byteOffset;
+    GLsizei stride;
+    UInt32 divisor;
+    // the attribute format, only needed without separate vertex formats (see
+    // GLRenderDevice::m_bVertexAttribBinding) where it is specified together with the buffer
+    UInt32 location;
+    GLint elementCount;
+    GLenum glType;
+    bool bNormalized;
+    bool bInteger;
+};
+using GLVertexBindingArray = stick::DynamicArray<GLVertexBinding>;
+
+// VAOs only describe the vertex formats and are shared between all meshes with the same layouts
+struct STICK_LOCAL GLVertexArrayCacheEntry
+{
+    UInt64 hash;
+    VertexElementArray elements;
+    GLuint glVao;
+    UInt32 refCount;
+};
+using GLVertexArrayCache = stick::DynamicArray<GLVertexArrayCacheEntry>;
+
+class GLVertexPool;
 class STICK_API GLMesh : public Mesh
 {
   public:
     friend class GLRenderDevice;
 
-    GLMesh(Allocator & _alloc,
+    GLMesh(GLRenderDevice * _device,
            VertexBuffer ** _vertexBuffers,
            const VertexLayout * _layouts,
            Size _count,
            IndexBuffer * _indexBuffer);
+    // mesh stored in a vertex pool, drawn with the pool's VAO
+    GLMesh(Allocator & _alloc, GLVertexPool * _pool, UInt32 _firstIndex);
     ~GLMesh() override;
 
-    GLuint m_glVao;
-    DynamicArray<GLVertexBuffer *> m_vertexBuffers;
+    GLRenderDevice * m_device;
+    GLuint m_glVao; // shared, see GLRenderDevice::acquireVertexArray
+    // one binding per vertex element, the binding index is the index in this array
+    GLVertexBindingArray m_bindings;
     GLIndexBuffer * m_indexBuffer;
+    GLVertexPool * m_pool;
+    UInt32 m_firstIndex; // position of the first index in m_pool
+};
+
+class STICK_API GLVertexPool : public VertexPool
+{
+  public:
+    GLVertexPool(GLRenderDevice * _device);
+    ~GLVertexPool() override;
+
+    Error init(const VertexLayout & _layout, Size _vertexCapacity, Size _indexCapacity);
+
+    Result<Mesh *> allocateMesh(const void * _vertices,
+                                UInt32 _vertexCount,
+                                const UInt32 * _indices,
+                                UInt32 _indexCount) override;
+    void clear() override;
+    UInt32 firstIndex(const Mesh * _mesh) const override;
+    const char * fetchShaderCode() const override;
+
+    GLRenderDevice * m_device;
+    UInt32 m_vertexStride;
+    UInt32 m_vertexCapacity;
+    UInt32 m_indexCapacity;
+    UInt32 m_vertexCount;
+    UInt32 m_indexCount;
+    GLuint m_glVertexBuffer; // storage buffer with the vertex data as 32 bit words
+    GLuint m_glIndexBuffer;  // storage buffer with indices that already include the vertex base
+    GLuint m_glVao;          // attribute-less vao shared by all meshes of the pool
+    String m_fetchCode;
+    DynamicArray<UniquePtr<GLMesh>> m_meshes;
+};
+
+struct STICK_LOCAL GLUpload
+{
+    UploadID id;
+    const GLVertexBuffer * vertexBuffer; // the destination is either a vertex or an index buffer
+    const GLIndexBuffer * indexBuffer;
+    Size byteOffset;
+    Size stagingOffset;
+    Size byteCount;
+    bool bStaged;       // the data was copied to the staging buffer
+    UInt64 fenceSerial; // the submit serial of the copy, 0 until it was issued
+};
+
+class STICK_API GLUploadQueue : public UploadQueue
+{
+  public:
+    GLUploadQueue(GLRenderDevice * _device);
+    ~GLUploadQueue() override;
+
+    Error init(Size _stagingByteCount, Size _bytesPerFrame);
+
+    Result<UploadID> enqueue(VertexBuffer * _buffer,
+                             Size _byteOffset,
+                             const void * _data,
+                             Size _byteCount) override;
+    Result<UploadID> enqueue(IndexBuffer * _buffer,
+                             Size _byteOffset,
+                             const void * _data,
+                             Size _byteCount) override;
+    void process() override;
+    void setBytesPerFrame(Size _byteCount) override;
+    Size stagingByteCount() const override;
+    bool isComplete(UploadID _id) const override;
+    bool isResident(const Mesh * _mesh) const override;
+
+    Result<UploadID> enqueueImpl(const GLVertexBuffer * _vertexBuffer,
+                                 const GLIndexBuffer * _indexBuffer,
+                                 BufferUsageFlags _usage,
+                                 const GLSuballocation & _range,
+                                 Size _byteOffset,
+                                 const void * _data,
+                                 Size _byteCount);
+
+    GLRenderDevice * m_device;
+    GLuint m_glStagingBuffer;
+    UInt8 * m_mapped;
+    Size m_stagingByteCount;
+    Size m_head;
+    Size m_bytesPerFrame;
+    UploadID m_nextID;
+    // protects everything below, the upload state is shared with the enqueuing threads
+    mutable std::mutex m_mutex;
+    DynamicArray<GLUpload> m_uploads; // in staging order
 };
 
 class GLRenderBuffer;
 class STICK_API GLTexture : public Texture
 {
   public:
-    GLTexture();
+    GLTexture(GLRenderDevice * _device, TextureUsageFlags _usage);
     ~GLTexture() override;
 
     void loadPixels(UInt32 _width,
@@ -258,10 +602,15 @@ class STICK_API GLTexture : public Texture
                     UInt32 _alignment,
                     UInt32 _mipmapLevelCount) override;
 
+    GLRenderDevice * m_device;
     GLuint m_glTexture;
     GLenum m_glTarget;
     TextureFormat m_format;
     GLRenderBuffer * m_renderBuffer;
+    TextureUsageFlags m_usageFlags;
+    UInt64 m_contentHash;
+    Size m_contentByteCount;
+    bool m_bShared; // m_glTexture is shared with other deduplicated textures
 };
 
 class STICK_API GLSampler : public Sampler
@@ -273,7 +622,6 @@ class STICK_API GLSampler : public Sampler
     GLuint m_glSampler;
 };
 
-class GLRenderDevice;
 class STICK_API GLRenderBuffer : public RenderBuffer
 {
   public:
@@ -319,8 +667,27 @@ struct STICK_API GLDrawCmd
     UInt32 vertexOffset;
     UInt32 vertexCount;
     UInt32 baseVertex;
+    UInt32 instanceCount;
+    UInt32 baseInstance;
     VertexDrawMode drawMode;
     GLUBOBindingArray uboBindings;
+    // if set, the draw parameters are sourced from this buffer
+    const GLStorageBuffer * indirectBuffer;
+    Size indirectByteOffset;
+    UInt32 indirectDrawCount;
+    UInt32 indirectStride;
+};
+
+struct STICK_API GLDispatchCmd
+{
+    const GLPipeline * pipeline;
+    UInt32 x, y, z;
+    GLUBOBindingArray uboBindings;
+};
+
+struct STICK_API GLMemoryBarrierCmd
+{
+    GLbitfield barriers;
 };
 
 struct STICK_API GLExternalDrawCmd
@@ -346,6 +713,14 @@ struct STICK_API GLClearCmd
 };
 
 class GLRenderPass;
+class GLTransientAllocator;
+
+// signaled once the GPU finished the pass with the given submit serial
+struct STICK_LOCAL GLSubmitFence
+{
+    UInt64 serial;
+    GLsync sync;
+};
 
 class STICK_API GLRenderDevice : public RenderDevice
 {
@@ -354,21 +729,38 @@ class STICK_API GLRenderDevice : public RenderDevice
 
     ~GLRenderDevice() override;
 
-    Result<Program *> createProgram(const char * _vertexShader, const char * _pixelShader) override;
+    Result<Program *> createProgram(const char * _vertexShader,
+                                    const char * _pixelShader,
+                                    const char * _geometryShader = nullptr,
+                                    const char * _tessControlShader = nullptr,
+                                    const char * _tessEvaluationShader = nullptr) override;
+    Result<Program *> createProgram(Shader * const * _stages, Size _count) override;
+    Result<Program *> createComputeProgram(const char * _computeShader) override;
     void destroyProgram(Program * _prog) override;
+    Result<Shader *> createShader(ShaderStage _stage, const char * _code) override;
+    void destroyShader(Shader * _shader) override;
     Result<Pipeline *> createPipeline(const PipelineSettings & s) override;
     void destroyPipeline(Pipeline * _pipe) override;
     Result<VertexBuffer *> createVertexBuffer(BufferUsageFlags _usage) override;
     void destroyVertexBuffer(VertexBuffer * _buff) override;
-    Result<IndexBuffer *> createIndexBuffer(BufferUsageFlags _usage) override;
+    Result<IndexBuffer *> createIndexBuffer(BufferUsageFlags _usage,
+                                            DataType _indexType) override;
     void destroyIndexBuffer(IndexBuffer * _buff) override;
+    Result<StorageBuffer *> createStorageBuffer(BufferUsageFlags _usage) override;
+    void destroyStorageBuffer(StorageBuffer * _buff) override;
     Result<Mesh *> createMesh(VertexBuffer ** _vertexBuffers,
                               const VertexLayout * _layouts,
                               Size _count,
                               IndexBuffer * _indexBuffer = nullptr) override;
     void destroyMesh(Mesh * _mesh) override;
-
-    Result<Texture *> createTexture() override;
+    Result<VertexPool *> createVertexPool(const VertexLayout & _layout,
+                                          Size _vertexCapacity,
+                                          Size _indexCapacity) override;
+    void destroyVertexPool(VertexPool * _pool) override;
+    Result<UploadQueue *> createUploadQueue(Size _stagingByteCount, Size _bytesPerFrame) override;
+    void destroyUploadQueue(UploadQueue * _queue) override;
+
+    Result<Texture *> createTexture(TextureUsageFlags _usage) override;
     void destroyTexture(Texture * _texture) override;
     Result<Sampler *> createSampler(const SamplerSettings & _settings) override;
     void destroySampler(Sampler * _sampler) override;
@@ -376,9 +768,21 @@ class STICK_API GLRenderDevice : public RenderDevice
     Result<RenderBuffer *> createRenderBuffer(const RenderBufferSettings & _settings) override;
     void destroyRenderBuffer(RenderBuffer * _renderBuffer, bool _bDestroyRenderTargets) override;
 
+    stick::Error warmUp(Pipeline * const * _pipelines,
+                        Size _count,
+                        RenderBuffer * _target = nullptr,
+                        Float64 * _outSeconds = nullptr) override;
+
     RenderPass * beginPass(const RenderPassSettings & _settings) override;
     stick::Error endPass(RenderPass * _pass) override;
 
+    const RenderStatistics & statistics() const override;
+    void resetStatistics() override;
+
+    BufferPoolStatistics bufferPoolStatistics() const override;
+    void compactBufferPools() override;
+    ContentCacheStatistics contentCacheStatistics() const override;
+
     void readPixels(
         Int32 _x, Int32 _y, Int32 _w, Int32 _h, TextureFormat _format, void * _outData) override;
 
@@ -396,12 +800,45 @@ class STICK_API GLRenderDevice : public RenderDevice
         _array.remove(it);
     }
 
+    // returns the arena that a range of _byteCount bytes was allocated in, creating a new arena
+    // if none of _arenas has enough space left
+    GLBufferArena * allocateRange(GLBufferArenaArray & _arenas,
+                                  Size _byteCount,
+                                  Size _alignment,
+                                  Size & _outByteOffset);
+
+    // fences the GL commands issued so far and returns the submit serial of the fence
+    UInt64 insertSubmitFence();
+    // advances m_completedSerial past all submit fences that are signaled already, without blocking
+    void pollSubmitFences();
+    // Blocks until the GPU finished all passes up to and including the _serial-th submitted one.
+    // Fails if the wait fails or the GPU did not get there after SUBMIT_WAIT_MAX_TIMEOUTS seconds.
+    Error waitForSubmission(UInt64 _serial);
+
+    // returns a VAO for the vertex formats of _layouts, creating it if necessary
+    GLuint acquireVertexArray(const VertexLayout * _layouts, Size _count);
+    void releaseVertexArray(GLuint _vao);
+
+    // returns the device wide binding point/unit of a separable shader resource
+    Result<UInt32> separableBinding(DynamicArray<String> & _names,
+                                    const String & _name,
+                                    UInt32 _maxCount);
+
     Allocator * m_alloc;
     DynamicArray<UniquePtr<GLProgram>> m_programs;
+    DynamicArray<UniquePtr<GLShader>> m_shaders;
     DynamicArray<UniquePtr<GLPipeline>> m_pipelines;
+    GLBufferArenaArray m_vertexArenas; // need to outlive the buffers
+    GLBufferArenaArray m_indexArenas;
+    GLSharedContentArray m_sharedBuffers; // need to outlive the buffers and textures, too
+    GLSharedContentArray m_sharedTextures;
     DynamicArray<UniquePtr<GLVertexBuffer>> m_vertexBuffers;
     DynamicArray<UniquePtr<GLIndexBuffer>> m_indexBuffers;
+    DynamicArray<UniquePtr<GLStorageBuffer>> m_storageBuffers;
+    GLVertexArrayCache m_vertexArrayCache; // needs to outlive all meshes
     DynamicArray<UniquePtr<GLMesh>> m_meshes;
+    DynamicArray<UniquePtr<GLVertexPool>> m_vertexPools;
+    DynamicArray<UniquePtr<GLUploadQueue>> m_uploadQueues;
     DynamicArray<UniquePtr<GLTexture>> m_textures;
     DynamicArray<UniquePtr<GLSampler>> m_samplers;
     DynamicArray<UniquePtr<GLRenderBuffer>> m_renderBuffers;
@@ -410,10 +847,49 @@ class STICK_API GLRenderDevice : public RenderDevice
     Maybe<GLDrawCmd> m_lastDrawCall;
     UInt64 m_lastRenderState; // if there is a last drawcall, we will store its renderstate in here
                               // because we need it to be mutable
+    // GL_PRIMITIVE_RESTART is left untouched until a pipeline enables it. The restart index follows
+    // the index type of the drawn mesh.
+    bool m_bPrimitiveRestart;
+    GLuint m_primitiveRestartIndex;
     UInt32 m_uboOffsetAlignment;
+    UInt64 m_passCounter; // used to hand out unique pass ids
+    UInt64 m_submitSerial;    // number of submit fences (one per ended pass and upload batch)
+    UInt64 m_completedSerial; // the last submit serial the GPU is known to be done with
+    DynamicArray<GLSubmitFence> m_submitFences;
+    RenderStatistics m_statistics;
+    UniquePtr<GLMesh> m_warmUpMesh; // attribute-less mesh used to issue the warm up draws
+    UniquePtr<GLTransientAllocator> m_transientAllocator; // created on first use
+    // separable stages can't use per program binding points as they are shared between programs.
+    // Instead each uniform block/texture name maps to one device wide binding point/unit.
+    DynamicArray<String> m_separableBlockNames;
+    DynamicArray<String> m_separableTextureNames;
+    DynamicArray<String> m_separableStorageBlockNames;
+    DynamicArray<String> m_separableImageNames;
+    UInt32 m_maxUniformBufferBindings;
+    UInt32 m_maxTextureUnits;
+    UInt32 m_maxStorageBufferBindings;
+    UInt32 m_maxImageUnits;
+    // Features beyond the GL 4.1 core baseline, queried once on creation. Separate vertex formats
+    // (GL 4.3 or ARB_vertex_attrib_binding) let VAOs be shared between meshes with different
+    // buffers, multi bind (GL 4.4 or ARB_multi_bind) binds all of a mesh's buffers in one call.
+    // Compute shaders, storage blocks and images (GL 4.3 or ARB_compute_shader) are only
+    // available if m_bComputeShaders is set, otherwise their limits stay 0. Immutable and
+    // persistently mapped buffers need buffer storage (GL 4.4 or ARB_buffer_storage). Draws with a
+    // base instance other than 0 need GL 4.2 or ARB_base_instance.
+    bool m_bVertexAttribBinding;
+    bool m_bMultiBind;
+    bool m_bComputeShaders;
+    bool m_bBufferStorage;
+    bool m_bBaseInstance;
 };
 
-using GLCmd = stick::Variant<GLDrawCmd, GLExternalDrawCmd, GLViewportCmd, GLScissorCmd, GLClearCmd>;
+using GLCmd = stick::Variant<GLDrawCmd,
+                             GLDispatchCmd,
+                             GLMemoryBarrierCmd,
+                             GLExternalDrawCmd,
+                             GLViewportCmd,
+                             GLScissorCmd,
+                             GLClearCmd>;
 using GLCmdBuffer = stick::DynamicArray<GLCmd>;
 
 class STICK_API GLRenderPass : public RenderPass
@@ -436,6 +912,34 @@ class STICK_API GLRenderPass : public RenderPass
                   UInt32 _baseVertex,
                   VertexDrawMode _drawMode) override;
 
+    void drawMeshInstanced(const Mesh * _mesh,
+                           const Pipeline * _pipeline,
+                           UInt32 _vertexOffset,
+                           UInt32 _vertexCount,
+                           UInt32 _instanceCount,
+                           UInt32 _baseInstance,
+                           VertexDrawMode _drawMode) override;
+
+    void drawMeshInstanced(const Mesh * _mesh,
+                           const Pipeline * _pipeline,
+                           UInt32 _vertexOffset,
+                           UInt32 _vertexCount,
+                           UInt32 _baseVertex,
+                           UInt32 _instanceCount,
+                           UInt32 _baseInstance,
+                           VertexDrawMode _drawMode) override;
+
+    void drawMeshIndirect(const Mesh * _mesh,
+                          const Pipeline * _pipeline,
+                          const StorageBuffer * _indirectBuffer,
+                          Size _byteOffset,
+                          UInt32 _drawCount,
+                          UInt32 _stride,
+                          VertexDrawMode _drawMode) override;
+
+    void dispatch(const Pipeline * _pipeline, UInt32 _x, UInt32 _y, UInt32 _z) override;
+    void memoryBarrier(UInt32 _barriers) override;
+
     void drawCustom(ExternalDrawFunction _fn) override;
 
     void setViewport(Int32 _x, Int32 _y, UInt32 _w, UInt32 _h) override;
@@ -444,6 +948,17 @@ class STICK_API GLRenderPass : public RenderPass
     void reset();
     void prepareDrawing();
     UInt32 copyToUBO(Size _byteCount, const void * _data);
+    GLUBOBindingArray copyUniforms(const GLPipeline * _pipeline);
+    // appends the draw data of the pipeline and returns its element index
+    UInt32 appendDrawData(const GLPipeline * _pipeline);
+    // tries to fold a draw with draw data into the previous command by increasing its instance count
+    bool foldDraw(const GLDrawCmd & _cmd);
+    Result<TransientGeometry> allocateTransientGeometry(const VertexLayout & _layout,
+                                                       UInt32 _vertexCount,
+                                                       UInt32 _indexCount) override;
+
+    // creates a non-indirect, single instance draw command that still needs its range to be set
+    GLDrawCmd makeDrawCmd(const Mesh * _mesh, const Pipeline * _pipeline, VertexDrawMode _drawMode);
 
     GLRenderDevice * m_device;
     GLRenderBuffer * m_renderBuffer;
@@ -451,6 +966,63 @@ class STICK_API GLRenderPass : public RenderPass
     GLuint m_ubo; //buffers all the uniforms for the pass
     UInt8 * m_mappedUBO;
     UInt32 m_mappedUBOOffset;
+    UInt64 m_passID;
+    DynamicArray<char> m_drawData; // uploaded to m_drawDataBuffer once the pass is drawn
+    GLuint m_drawDataBuffer;
+};
+
+// a range of a GLTransientRing used by a pass that ended with submit serial (0 while recording)
+struct STICK_LOCAL GLTransientRange
+{
+    const GLRenderPass * pass;
+    UInt64 serial;
+    Size begin;
+    Size end;
+};
+
+// A persistently mapped buffer that is allocated from in ring order. The ranges are released once
+// the GPU finished the pass they were allocated for. Requires GLRenderDevice::m_bBufferStorage.
+class STICK_LOCAL GLTransientRing
+{
+  public:
+    GLTransientRing(GLRenderDevice * _device, GLuint _glBuffer, Size _byteCount);
+
+    Result<Size> allocate(const GLRenderPass * _pass, Size _byteCount, Size _alignment);
+    void submit(const GLRenderPass * _pass, UInt64 _serial);
+
+    GLRenderDevice * m_device;
+    UInt8 * m_mapped;
+    Size m_byteCount;
+    Size m_head;
+    DynamicArray<GLTransientRange> m_ranges; // oldest first
+};
+
+struct STICK_LOCAL GLTransientMesh
+{
+    VertexLayout layout;
+    bool bIndexed;
+    UniquePtr<GLMesh> mesh;
+};
+
+// Owns the rings and the per layout meshes of transient geometry. The meshes don't change between
+// draws, so transient geometry with the same layout is drawn without rebinding anything.
+class STICK_LOCAL GLTransientAllocator
+{
+  public:
+    GLTransientAllocator(GLRenderDevice * _device);
+
+    Result<TransientGeometry> allocate(const GLRenderPass * _pass,
+                                       const VertexLayout & _layout,
+                                       UInt32 _vertexCount,
+                                       UInt32 _indexCount);
+    void submit(const GLRenderPass * _pass, UInt64 _serial);
+
+    GLRenderDevice * m_device;
+    GLVertexBuffer m_vertexBuffer;
+    GLIndexBuffer m_indexBuffer;
+    GLTransientRing m_vertices;
+    GLTransientRing m_indices;
+    DynamicArray<GLTransientMesh> m_meshes;
 };
 
 } // namespace gl
@@ -0,0 +1,362 @@
+#include <Dab/StaticBatch.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace dab
+{
+using namespace stick;
+
+static const Float32 s_identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+StaticBatchSettings::StaticBatchSettings() :
+    mode(StaticBatchMode::BakeTransforms),
+    drawMode(VertexDrawMode::Triangles),
+    positionLocation(0),
+    normalLocation(-1),
+    instanceLocation(15),
+    maxVertexCount(1 << 20)
+{
+}
+
+StaticBatchBuilder::StaticBatchBuilder(Allocator & _alloc) :
+    m_alloc(&_alloc),
+    m_device(nullptr),
+    m_inputStride(0),
+    m_position(nullptr),
+    m_normal(nullptr),
+    m_batches(_alloc),
+    m_ranges(_alloc),
+    m_transforms(_alloc),
+    m_bBuilt(false)
+{
+}
+
+StaticBatchBuilder::~StaticBatchBuilder()
+{
+    deallocate();
+}
+
+static const VertexElement * findElement(const VertexLayout & _layout, UInt32 _location)
+{
+    for (const auto & el : _layout.elements)
+    {
+        if (el.location == _location)
+            return &el;
+    }
+    return nullptr;
+}
+
+static bool isTransformable(const VertexElement * _el)
+{
+    return _el && _el->dataType == DataType::Float32 && _el->elementCount >= 3 &&
+           !_el->bNormalized && !_el->bInteger;
+}
+
+Error StaticBatchBuilder::init(RenderDevice * _device,
+                               const VertexLayout & _layout,
+                               const StaticBatchSettings & _settings)
+{
+    deallocate();
+
+    if (_settings.drawMode != VertexDrawMode::Triangles &&
+        _settings.drawMode != VertexDrawMode::Lines && _settings.drawMode != VertexDrawMode::Points)
+        return Error(ec::InvalidOperation,
+                     "Static batches can only hold triangle, line or point lists",
+                     STICK_FILE,
+                     STICK_LINE);
+    bool bPerVertex = std::none_of(_layout.elements.begin(),
+                                   _layout.elements.end(),
+                                   [](const VertexElement & _el) { return _el.divisor != 0; });
+    if (!_layout.isInterleaved() || !bPerVertex)
+        return Error(ec::InvalidOperation,
+                     "Static batches require an interleaved, per vertex layout",
+                     STICK_FILE,
+                     STICK_LINE);
+
+    UInt32 stride = _layout.elements[0].stride;
+
+    m_settings = _settings;
+    m_inputStride = stride;
+    m_layout = _layout;
+
+    if (_settings.mode == StaticBatchMode::InstanceIndex)
+    {
+        if (findElement(_layout, _settings.instanceLocation))
+            return Error(ec::InvalidOperation,
+                         "The instance location is already used by the vertex layout",
+                         STICK_FILE,
+                         STICK_LINE);
+
+        // the instance index goes after the existing elements, aligned to four bytes
+        UInt32 offset = (stride + 3) / 4 * 4;
+        for (auto & el : m_layout.elements)
+            el.stride = offset + 4;
+        VertexElement instance = {
+            DataType::UInt32, 1, offset, offset + 4, _settings.instanceLocation, 0, false, true
+        };
+        m_layout.elements.append(instance);
+        m_layout.finish(VertexPacking::Explicit);
+        m_device = _device;
+        return Error();
+    }
+
+    m_position = findElement(m_layout, _settings.positionLocation);
+    if (!isTransformable(m_position))
+        return Error(ec::InvalidOperation,
+                     "Baking transforms requires a Float32 position with three or four components",
+                     STICK_FILE,
+                     STICK_LINE);
+    if (_settings.normalLocation >= 0)
+    {
+        m_normal = findElement(m_layout, (UInt32)_settings.normalLocation);
+        if (!isTransformable(m_normal))
+            return Error(ec::InvalidOperation,
+                         "Baking transforms requires a Float32 normal with three or four "
+                         "components",
+                         STICK_FILE,
+                         STICK_LINE);
+    }
+    m_device = _device;
+    return Error();
+}
+
+void StaticBatchBuilder::deallocate()
+{
+    if (!m_device)
+        return;
+
+    for (auto & batch : m_batches)
+    {
+        if (batch.mesh)
+            m_device->destroyMesh(batch.mesh);
+        if (batch.vertexBuffer)
+            m_device->destroyVertexBuffer(batch.vertexBuffer);
+        if (batch.indexBuffer)
+            m_device->destroyIndexBuffer(batch.indexBuffer);
+    }
+    m_batches.clear();
+    m_ranges.clear();
+    m_transforms.clear();
+    m_position = nullptr;
+    m_normal = nullptr;
+    m_bBuilt = false;
+    m_device = nullptr;
+}
+
+static void loadVector(const UInt8 * _src, UInt32 _count, Float32 * _out)
+{
+    std::memcpy(_out, _src, sizeof(Float32) * _count);
+}
+
+static void storeVector(UInt8 * _dst, UInt32 _count, const Float32 * _v)
+{
+    std::memcpy(_dst, _v, sizeof(Float32) * _count);
+}
+
+// the transform of the xyz components, _mat is column major
+static void transformPoint(const Float32 * _mat, Float32 * _v, Float32 _w)
+{
+    Float32 x = _v[0], y = _v[1], z = _v[2];
+    for (Size i = 0; i < 3; ++i)
+        _v[i] = _mat[i] * x + _mat[4 + i] * y + _mat[8 + i] * z + _mat[12 + i] * _w;
+}
+
+Result<UInt32> StaticBatchBuilder::addMesh(const void * _vertices,
+                                           UInt32 _vertexCount,
+                                           const UInt32 * _indices,
+                                           UInt32 _indexCount,
+                                           const Float32 * _transform)
+{
+    if (!m_device)
+        return Error(
+            ec::InvalidOperation, "The builder was not initialized", STICK_FILE, STICK_LINE);
+    if (m_bBuilt)
+        return Error(ec::InvalidOperation,
+                     "Meshes can't be added after the batches were built",
+                     STICK_FILE,
+                     STICK_LINE);
+
+    const Float32 * mat = _transform ? _transform : s_identity;
+
+    // normals are transformed by the cofactor matrix, which is the inverse transpose scaled by the
+    // determinant. That saves the inversion, the length is normalized afterwards anyway.
+    Float32 normalMat[16] = { 0 };
+    normalMat[0] = mat[5] * mat[10] - mat[9] * mat[6];
+    normalMat[1] = mat[8] * mat[6] - mat[4] * mat[10];
+    normalMat[2] = mat[4] * mat[9] - mat[8] * mat[5];
+    normalMat[4] = mat[9] * mat[2] - mat[1] * mat[10];
+    normalMat[5] = mat[0] * mat[10] - mat[8] * mat[2];
+    normalMat[6] = mat[8] * mat[1] - mat[0] * mat[9];
+    normalMat[8] = mat[1] * mat[6] - mat[5] * mat[2];
+    normalMat[9] = mat[4] * mat[2] - mat[0] * mat[6];
+    normalMat[10] = mat[0] * mat[5] - mat[4] * mat[1];
+    Float32 det = mat[0] * normalMat[0] + mat[4] * normalMat[4] + mat[8] * normalMat[8];
+
+    UInt32 indexCount = _indices ? _indexCount : _vertexCount;
+
+    if (!m_batches.count() ||
+        (m_batches.last().vertexCount &&
+         m_batches.last().vertexCount + _vertexCount > m_settings.maxVertexCount))
+        m_batches.append({ DynamicArray<UInt8>(*m_alloc),
+                           DynamicArray<UInt32>(*m_alloc),
+                           0,
+                           0,
+                           nullptr,
+                           nullptr,
+                           nullptr });
+
+    Batch & batch = m_batches.last();
+    UInt32 rangeIndex = (UInt32)m_ranges.count();
+    m_ranges.append({ (UInt32)(m_batches.count() - 1), batch.indexCount, indexCount });
+
+    // vertices
+    UInt32 stride = m_layout.elements[0].stride;
+    Size vertexOffset = batch.vertices.count();
+    batch.vertices.resize(vertexOffset + (Size)_vertexCount * stride);
+    UInt8 * dst = batch.vertices.ptr() + vertexOffset;
+    const UInt8 * src = static_cast<const UInt8 *>(_vertices);
+    if (m_settings.mode == StaticBatchMode::InstanceIndex)
+    {
+        UInt32 instanceOffset = m_layout.elements.last().offset;
+        for (UInt32 i = 0; i < _vertexCount; ++i)
+        {
+            UInt8 * vertex = dst + (Size)i * stride;
+            std::memset(vertex, 0, stride);
+            std::memcpy(vertex, src + (Size)i * m_inputStride, m_inputStride);
+            std::memcpy(vertex + instanceOffset, &rangeIndex, sizeof(UInt32));
+        }
+        m_transforms.append(mat, mat + 16);
+    }
+    else
+    {
+        std::memcpy(dst, src, (Size)_vertexCount * stride);
+
+        Float32 v[4];
+        for (UInt32 i = 0; i < _vertexCount; ++i)
+        {
+            UInt8 * vertex = dst + (Size)i * stride;
+            UInt32 count = std::min(m_position->elementCount, (UInt32)4);
+            loadVector(vertex + m_position->offset, count, v);
+            transformPoint(mat, v, count == 4 ? v[3] : 1.0f);
+            storeVector(vertex + m_position->offset, 3, v);
+
+            if (m_normal)
+            {
+                loadVector(vertex + m_normal->offset, 3, v);
+                transformPoint(normalMat, v, 0.0f);
+                // the cofactors of a mirroring transform point the normals inwards
+                Float32 len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+                if (det < 0.0f)
+                    len = -len;
+                if (len != 0.0f)
+                {
+                    for (Size j = 0; j < 3; ++j)
+                        v[j] /= len;
+                }
+                storeVector(vertex + m_normal->offset, 3, v);
+            }
+        }
+    }
+
+    // indices
+    Size indexOffset = batch.indices.count();
+    batch.indices.resize(indexOffset + indexCount);
+    UInt32 * dstIndices = batch.indices.ptr() + indexOffset;
+    for (UInt32 i = 0; i < indexCount; ++i)
+        dstIndices[i] = batch.vertexCount + (_indices ? _indices[i] : i);
+
+    // mirroring transforms turn the triangles inside out, restore their winding
+    if (m_settings.mode == StaticBatchMode::BakeTransforms &&
+        m_settings.drawMode == VertexDrawMode::Triangles && det < 0.0f)
+    {
+        for (UInt32 i = 0; i + 2 < indexCount; i += 3)
+            std::swap(dstIndices[i + 1], dstIndices[i + 2]);
+    }
+
+    batch.vertexCount += _vertexCount;
+    batch.indexCount += indexCount;
+    return rangeIndex;
+}
+
+Error StaticBatchBuilder::build(BufferUsageFlags _usage)
+{
+    if (!m_device)
+        return Error(
+            ec::InvalidOperation, "The builder was not initialized", STICK_FILE, STICK_LINE);
+    if (m_bBuilt)
+        return Error(
+            ec::InvalidOperation, "The batches were already built", STICK_FILE, STICK_LINE);
+
+    for (auto & batch : m_batches)
+    {
+        auto vres = m_device->createVertexBuffer(_usage);
+        if (!vres)
+            return vres.error();
+        batch.vertexBuffer = vres.get();
+        batch.vertexBuffer->loadDataRaw(batch.vertices.ptr(), batch.vertices.count());
+
+        auto ires = m_device->createIndexBuffer(_usage);
+        if (!ires)
+            return ires.error();
+        batch.indexBuffer = ires.get();
+        batch.indexBuffer->loadIndices(batch.indices.ptr(), batch.indices.count());
+
+        auto mres = m_device->createMesh(&batch.vertexBuffer, &m_layout, 1, batch.indexBuffer);
+        if (!mres)
+            return mres.error();
+        batch.mesh = mres.get();
+
+        batch.vertices = DynamicArray<UInt8>(*m_alloc);
+        batch.indices = DynamicArray<UInt32>(*m_alloc);
+    }
+    m_bBuilt = true;
+    return Error();
+}
+
+void StaticBatchBuilder::draw(RenderPass * _pass, const Pipeline * _pipeline) const
+{
+    for (const auto & batch : m_batches)
+    {
+        if (batch.mesh)
+            _pass->drawMesh(batch.mesh, _pipeline, 0, batch.indexCount, m_settings.drawMode);
+    }
+}
+
+const VertexLayout & StaticBatchBuilder::layout() const
+{
+    return m_layout;
+}
+
+UInt32 StaticBatchBuilder::batchCount() const
+{
+    return (UInt32)m_batches.count();
+}
+
+const Mesh * StaticBatchBuilder::batchMesh(UInt32 _batch) const
+{
+    return m_batches[_batch].mesh;
+}
+
+UInt32 StaticBatchBuilder::batchIndexCount(UInt32 _batch) const
+{
+    return m_batches[_batch].indexCount;
+}
+
+UInt32 StaticBatchBuilder::rangeCount() const
+{
+    return (UInt32)m_ranges.count();
+}
+
+const StaticBatchRange & StaticBatchBuilder::range(UInt32 _index) const
+{
+    return m_ranges[_index];
+}
+
+const Float32 * StaticBatchBuilder::transforms() const
+{
+    return m_transforms.ptr();
+}
+
+} // namespace dab
@@ -0,0 +1,114 @@
+#ifndef DAB_STATICBATCH_HPP
+#define DAB_STATICBATCH_HPP
+
+#include <Dab/Dab.hpp>
+
+namespace dab
+{
+
+// how StaticBatchBuilder places the meshes in world space
+enum class STICK_API StaticBatchMode
+{
+    // positions and normals are transformed on the CPU, the batches are drawn like any other mesh
+    BakeTransforms,
+    // Vertices stay in object space and get the index of their mesh as an additional UInt32
+    // attribute at StaticBatchSettings::instanceLocation. The shader looks the object to world
+    // matrix up itself, i.e. in a storage buffer loaded from StaticBatchBuilder::transforms.
+    InstanceIndex
+};
+
+struct STICK_API StaticBatchSettings
+{
+    StaticBatchSettings();
+
+    StaticBatchMode mode;
+    VertexDrawMode drawMode; // Triangles, Lines or Points, strips and fans can't be merged
+    UInt32 positionLocation; // Float32 element with three or four components
+    Int32 normalLocation;    // Float32 element with three or four components, -1 if there is none
+    UInt32 instanceLocation; // location of the instance index added in InstanceIndex mode
+    // once a batch has this many vertices, the next mesh starts a new one (unless a single mesh is
+    // bigger). Batches with up to 65535 vertices use 16 bit indices.
+    UInt32 maxVertexCount;
+};
+
+// where a mesh added to a StaticBatchBuilder ended up, i.e. to draw or cull it individually with
+// RenderPass::drawMesh or IndirectDrawBuilder
+struct STICK_API StaticBatchRange
+{
+    UInt32 batch;
+    UInt32 firstIndex;
+    UInt32 indexCount;
+};
+
+// Merges many static meshes that share an interleaved VertexLayout and are drawn with the same
+// pipeline into a few big vertex and index buffers, so that they can be drawn with one draw per
+// batch instead of one per object.
+class STICK_API StaticBatchBuilder
+{
+  public:
+    StaticBatchBuilder(stick::Allocator & _alloc = stick::defaultAllocator());
+    ~StaticBatchBuilder();
+
+    StaticBatchBuilder(const StaticBatchBuilder &) = delete;
+    StaticBatchBuilder & operator=(const StaticBatchBuilder &) = delete;
+
+    // _layout has to be interleaved (one stride, no instanced elements)
+    stick::Error init(RenderDevice * _device,
+                      const VertexLayout & _layout,
+                      const StaticBatchSettings & _settings = StaticBatchSettings());
+    void deallocate();
+
+    // Appends _vertexCount vertices in the layout passed to init with their indices (nullptr to
+    // use the vertices in order) and a column major object to world matrix (nullptr for identity).
+    // Returns the index of the mesh's range.
+    stick::Result<UInt32> addMesh(const void * _vertices,
+                                  UInt32 _vertexCount,
+                                  const UInt32 * _indices,
+                                  UInt32 _indexCount,
+                                  const Float32 * _transform = nullptr);
+
+    // Creates the vertex and index buffer and the mesh of every batch. The CPU copies of the
+    // vertices and indices are released afterwards, so no meshes can be added anymore.
+    stick::Error build(BufferUsageFlags _usage = BufferUsageStatic);
+
+    // draws all batches, one drawMesh each
+    void draw(RenderPass * _pass, const Pipeline * _pipeline) const;
+
+    // the layout of the batches, including the instance index in InstanceIndex mode
+    const VertexLayout & layout() const;
+    UInt32 batchCount() const;
+    const Mesh * batchMesh(UInt32 _batch) const;
+    UInt32 batchIndexCount(UInt32 _batch) const;
+    UInt32 rangeCount() const;
+    const StaticBatchRange & range(UInt32 _index) const;
+    // the 16 floats of the matrix of each added mesh, in InstanceIndex mode
+    const Float32 * transforms() const;
+
+  private:
+    struct Batch
+    {
+        stick::DynamicArray<UInt8> vertices;
+        stick::DynamicArray<UInt32> indices;
+        UInt32 vertexCount;
+        UInt32 indexCount;
+        VertexBuffer * vertexBuffer;
+        IndexBuffer * indexBuffer;
+        Mesh * mesh;
+    };
+
+    stick::Allocator * m_alloc;
+    RenderDevice * m_device;
+    StaticBatchSettings m_settings;
+    VertexLayout m_layout;
+    UInt32 m_inputStride;
+    const VertexElement * m_position; // in m_layout
+    const VertexElement * m_normal;
+    stick::DynamicArray<Batch> m_batches;
+    stick::DynamicArray<StaticBatchRange> m_ranges;
+    stick::DynamicArray<Float32> m_transforms;
+    bool m_bBuilt;
+};
+
+} // namespace dab
+
+#endif // DAB_STATICBATCH_HPP
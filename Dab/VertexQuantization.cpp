@@ -0,0 +1,293 @@
+#include <Dab/VertexQuantization.hpp>
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DAB_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace dab
+{
+using namespace stick;
+
+static UInt32 floatBits(Float32 _value)
+{
+    UInt32 ret;
+    std::memcpy(&ret, &_value, sizeof(ret));
+    return ret;
+}
+
+static Float32 bitsFloat(UInt32 _bits)
+{
+    Float32 ret;
+    std::memcpy(&ret, &_bits, sizeof(ret));
+    return ret;
+}
+
+static UInt16 toFloat16(Float32 _value)
+{
+    UInt32 f = floatBits(_value);
+    UInt32 sign = f & 0x80000000u;
+    f ^= sign;
+
+    UInt32 ret;
+    if (f >= (127u + 16u) << 23) // too big for a half, infinity or nan
+    {
+        // nans stay quiet and keep the top bits of their payload
+        ret = f > 255u << 23 ? 0x7e00 | ((f >> 13) & 0x3ff) : 0x7c00;
+    }
+    else if (f < 113u << 23) // subnormal half or zero, let the fpu do the rounding
+        ret = floatBits(bitsFloat(f) + bitsFloat(126u << 23)) - (126u << 23);
+    else
+    {
+        // rebias the exponent and round the mantissa to nearest even
+        UInt32 mantissaOdd = (f >> 13) & 1;
+        f += 0xfffu - (112u << 23) + mantissaOdd;
+        ret = f >> 13;
+    }
+    return (UInt16)(ret | (sign >> 16));
+}
+
+// clamps to [_min, 1] (nans become _min, like with _mm_max_ps) and scales
+static Float32 clampScale(Float32 _value, Float32 _min, Float32 _scale)
+{
+    Float32 v = _value > _min ? _value : _min;
+    return (v < 1.0f ? v : 1.0f) * _scale;
+}
+
+template <class T>
+static T toNorm(Float32 _value, Float32 _min, Float32 _scale)
+{
+    // nearbyint rounds like the SSE conversion, to nearest even in the default rounding mode
+    return (T)std::nearbyint(clampScale(_value, _min, _scale));
+}
+
+static UInt32 toSNorm2_10_10_10_Rev(const Float32 * _v)
+{
+    return ((UInt32)toNorm<Int32>(_v[0], -1.0f, 511.0f) & 0x3ff) |
+           (((UInt32)toNorm<Int32>(_v[1], -1.0f, 511.0f) & 0x3ff) << 10) |
+           (((UInt32)toNorm<Int32>(_v[2], -1.0f, 511.0f) & 0x3ff) << 20) |
+           ((UInt32)toNorm<Int32>(_v[3], -1.0f, 1.0f) << 30);
+}
+
+static UInt32 toUNorm2_10_10_10_Rev(const Float32 * _v)
+{
+    return (UInt32)toNorm<Int32>(_v[0], 0.0f, 1023.0f) |
+           ((UInt32)toNorm<Int32>(_v[1], 0.0f, 1023.0f) << 10) |
+           ((UInt32)toNorm<Int32>(_v[2], 0.0f, 1023.0f) << 20) |
+           ((UInt32)toNorm<Int32>(_v[3], 0.0f, 3.0f) << 30);
+}
+
+#ifdef DAB_SSE2
+
+// the vector version of toFloat16, the halfs end up in the low 16 bits of each lane
+static __m128i toFloat16(__m128 _values)
+{
+    __m128 sign = _mm_and_ps(_values, _mm_castsi128_ps(_mm_set1_epi32(0x80000000u)));
+    __m128 absValues = _mm_xor_ps(_values, sign);
+    __m128i absBits = _mm_castps_si128(absValues);
+
+    __m128i isNan = _mm_castps_si128(_mm_cmpunord_ps(absValues, absValues));
+    __m128i isRegular = _mm_cmpgt_epi32(_mm_set1_epi32((127 + 16) << 23), absBits);
+    __m128i nanBits =
+        _mm_or_si128(_mm_and_si128(_mm_srli_epi32(absBits, 13), _mm_set1_epi32(0x3ff)),
+                     _mm_set1_epi32(0x200));
+    __m128i special = _mm_or_si128(_mm_and_si128(isNan, nanBits), _mm_set1_epi32(0x7c00));
+
+    __m128i isSubnormal = _mm_cmpgt_epi32(_mm_set1_epi32(113 << 23), absBits);
+    __m128i subnormalMagic = _mm_set1_epi32(126 << 23);
+    __m128i subnormal = _mm_sub_epi32(
+        _mm_castps_si128(_mm_add_ps(absValues, _mm_castsi128_ps(subnormalMagic))),
+        subnormalMagic);
+
+    // -1 if the mantissa of the result is odd
+    __m128i mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(absBits, 31 - 13), 31);
+    __m128i normal = _mm_srli_epi32(
+        _mm_sub_epi32(_mm_add_epi32(absBits, _mm_set1_epi32(0xfff - (112 << 23))), mantissaOdd),
+        13);
+
+    __m128i ret = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal),
+                               _mm_andnot_si128(isSubnormal, normal));
+    ret = _mm_or_si128(_mm_and_si128(isRegular, ret), _mm_andnot_si128(isRegular, special));
+    return _mm_or_si128(ret, _mm_srli_epi32(_mm_castps_si128(sign), 16));
+}
+
+static __m128i toNorm(__m128 _values, __m128 _min, __m128 _scale)
+{
+    // max returns the second operand for nans
+    __m128 v = _mm_min_ps(_mm_max_ps(_values, _min), _mm_set1_ps(1.0f));
+    return _mm_cvtps_epi32(_mm_mul_ps(v, _scale));
+}
+
+// packs the low 16 bits of each lane without saturation
+static __m128i packLow16(__m128i _a, __m128i _b)
+{
+    return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(_a, 16), 16),
+                           _mm_srai_epi32(_mm_slli_epi32(_b, 16), 16));
+}
+
+#endif // DAB_SSE2
+
+void quantizeFloat16(const Float32 * _src, UInt16 * _dst, Size _count)
+{
+    Size i = 0;
+#ifdef DAB_SSE2
+    for (; i + 8 <= _count; i += 8)
+    {
+        __m128i a = toFloat16(_mm_loadu_ps(_src + i));
+        __m128i b = toFloat16(_mm_loadu_ps(_src + i + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(_dst + i), packLow16(a, b));
+    }
+#endif
+    for (; i < _count; ++i)
+        _dst[i] = toFloat16(_src[i]);
+}
+
+void quantizeUNorm8(const Float32 * _src, UInt8 * _dst, Size _count)
+{
+    Size i = 0;
+#ifdef DAB_SSE2
+    __m128 min = _mm_setzero_ps();
+    __m128 scale = _mm_set1_ps(255.0f);
+    for (; i + 16 <= _count; i += 16)
+    {
+        __m128i a = _mm_packs_epi32(toNorm(_mm_loadu_ps(_src + i), min, scale),
+                                    toNorm(_mm_loadu_ps(_src + i + 4), min, scale));
+        __m128i b = _mm_packs_epi32(toNorm(_mm_loadu_ps(_src + i + 8), min, scale),
+                                    toNorm(_mm_loadu_ps(_src + i + 12), min, scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(_dst + i), _mm_packus_epi16(a, b));
+    }
+#endif
+    for (; i < _count; ++i)
+        _dst[i] = toNorm<UInt8>(_src[i], 0.0f, 255.0f);
+}
+
+void quantizeSNorm8(const Float32 * _src, Int8 * _dst, Size _count)
+{
+    Size i = 0;
+#ifdef DAB_SSE2
+    __m128 min = _mm_set1_ps(-1.0f);
+    __m128 scale = _mm_set1_ps(127.0f);
+    for (; i + 16 <= _count; i += 16)
+    {
+        __m128i a = _mm_packs_epi32(toNorm(_mm_loadu_ps(_src + i), min, scale),
+                                    toNorm(_mm_loadu_ps(_src + i + 4), min, scale));
+        __m128i b = _mm_packs_epi32(toNorm(_mm_loadu_ps(_src + i + 8), min, scale),
+                                    toNorm(_mm_loadu_ps(_src + i + 12), min, scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(_dst + i), _mm_packs_epi16(a, b));
+    }
+#endif
+    for (; i < _count; ++i)
+        _dst[i] = toNorm<Int8>(_src[i], -1.0f, 127.0f);
+}
+
+void quantizeUNorm16(const Float32 * _src, UInt16 * _dst, Size _count)
+{
+    Size i = 0;
+#ifdef DAB_SSE2
+    __m128 min = _mm_setzero_ps();
+    __m128 scale = _mm_set1_ps(65535.0f);
+    for (; i + 8 <= _count; i += 8)
+    {
+        __m128i a = toNorm(_mm_loadu_ps(_src + i), min, scale);
+        __m128i b = toNorm(_mm_loadu_ps(_src + i + 4), min, scale);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(_dst + i), packLow16(a, b));
+    }
+#endif
+    for (; i < _count; ++i)
+        _dst[i] = toNorm<UInt16>(_src[i], 0.0f, 65535.0f);
+}
+
+void quantizeSNorm16(const Float32 * _src, Int16 * _dst, Size _count)
+{
+    Size i = 0;
+#ifdef DAB_SSE2
+    __m128 min = _mm_set1_ps(-1.0f);
+    __m128 scale = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= _count; i += 8)
+    {
+        __m128i a = toNorm(_mm_loadu_ps(_src + i), min, scale);
+        __m128i b = toNorm(_mm_loadu_ps(_src + i + 4), min, scale);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(_dst + i), _mm_packs_epi32(a, b));
+    }
+#endif
+    for (; i < _count; ++i)
+        _dst[i] = toNorm<Int16>(_src[i], -1.0f, 32767.0f);
+}
+
+#ifdef DAB_SSE2
+
+// converts four xyzw vectors at a time, transposed so that each component gets its own register
+template <class F>
+static void pack2_10_10_10_Rev(const Float32 * _src,
+                               UInt32 * _dst,
+                               Size _count,
+                               Float32 _min,
+                               Float32 _scale,
+                               Float32 _scaleW,
+                               F _scalar)
+{
+    __m128 min = _mm_set1_ps(_min);
+    __m128 scale = _mm_set1_ps(_scale);
+    __m128 scaleW = _mm_set1_ps(_scaleW);
+    __m128i mask = _mm_set1_epi32(0x3ff);
+    Size i = 0;
+    for (; i + 4 <= _count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(_src + i * 4);
+        __m128 y = _mm_loadu_ps(_src + i * 4 + 4);
+        __m128 z = _mm_loadu_ps(_src + i * 4 + 8);
+        __m128 w = _mm_loadu_ps(_src + i * 4 + 12);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+
+        __m128i ret = _mm_and_si128(toNorm(x, min, scale), mask);
+        ret = _mm_or_si128(ret, _mm_slli_epi32(_mm_and_si128(toNorm(y, min, scale), mask), 10));
+        ret = _mm_or_si128(ret, _mm_slli_epi32(_mm_and_si128(toNorm(z, min, scale), mask), 20));
+        ret = _mm_or_si128(ret, _mm_slli_epi32(toNorm(w, min, scaleW), 30));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(_dst + i), ret);
+    }
+    for (; i < _count; ++i)
+        _dst[i] = _scalar(_src + i * 4);
+}
+
+#endif // DAB_SSE2
+
+void quantizeSNorm2_10_10_10_Rev(const Float32 * _src, UInt32 * _dst, Size _count)
+{
+#ifdef DAB_SSE2
+    pack2_10_10_10_Rev(_src, _dst, _count, -1.0f, 511.0f, 1.0f, toSNorm2_10_10_10_Rev);
+#else
+    for (Size i = 0; i < _count; ++i)
+        _dst[i] = toSNorm2_10_10_10_Rev(_src + i * 4);
+#endif
+}
+
+void quantizeUNorm2_10_10_10_Rev(const Float32 * _src, UInt32 * _dst, Size _count)
+{
+#ifdef DAB_SSE2
+    pack2_10_10_10_Rev(_src, _dst, _count, 0.0f, 1023.0f, 3.0f, toUNorm2_10_10_10_Rev);
+#else
+    for (Size i = 0; i < _count; ++i)
+        _dst[i] = toUNorm2_10_10_10_Rev(_src + i * 4);
+#endif
+}
+
+Float32 float16ToFloat32(UInt16 _value)
+{
+    const UInt32 exponentMask = 0x7c00u << 13;
+    UInt32 bits = (UInt32)(_value & 0x7fff) << 13;
+    UInt32 exponent = bits & exponentMask;
+    bits += (127u - 15u) << 23;
+    Float32 ret;
+    if (exponent == exponentMask) // infinity or nan
+        ret = bitsFloat(bits + ((128u - 16u) << 23));
+    else if (exponent == 0) // zero or subnormal, renormalize through the fpu
+        ret = bitsFloat(bits + (1u << 23)) - bitsFloat(113u << 23);
+    else
+        ret = bitsFloat(bits);
+    return bitsFloat(floatBits(ret) | ((UInt32)(_value & 0x8000) << 16));
+}
+
+} // namespace dab
@@ -0,0 +1,32 @@
+#ifndef DAB_VERTEXQUANTIZATION_HPP
+#define DAB_VERTEXQUANTIZATION_HPP
+
+#include <Dab/Dab.hpp>
+
+namespace dab
+{
+
+// Converters from Float32 arrays to the compact vertex formats, vectorized with SSE2 where
+// available. The normalized conversions clamp to the representable range and round to nearest,
+// matching how the GPU maps the values back with VertexElement::bNormalized. _src and _dst must not
+// overlap.
+
+// IEEE half floats, rounded to nearest even. Values outside the half range become infinity.
+STICK_API void quantizeFloat16(const Float32 * _src, UInt16 * _dst, Size _count);
+
+// [0, 1] to DataType::UInt8/UInt16 and [-1, 1] to DataType::Int8/Int16
+STICK_API void quantizeUNorm8(const Float32 * _src, UInt8 * _dst, Size _count);
+STICK_API void quantizeSNorm8(const Float32 * _src, Int8 * _dst, Size _count);
+STICK_API void quantizeUNorm16(const Float32 * _src, UInt16 * _dst, Size _count);
+STICK_API void quantizeSNorm16(const Float32 * _src, Int16 * _dst, Size _count);
+
+// Packs _count xyzw vectors (4 * _count floats) into DataType::Int2_10_10_10_Rev ([-1, 1], i.e.
+// normals and tangents) or DataType::UInt2_10_10_10_Rev ([0, 1], i.e. colors).
+STICK_API void quantizeSNorm2_10_10_10_Rev(const Float32 * _src, UInt32 * _dst, Size _count);
+STICK_API void quantizeUNorm2_10_10_10_Rev(const Float32 * _src, UInt32 * _dst, Size _count);
+
+STICK_API Float32 float16ToFloat32(UInt16 _value);
+
+} // namespace dab
+
+#endif // DAB_VERTEXQUANTIZATION_HPP
@@ -0,0 +1,138 @@
+#include <Dab/MeshOptimizer.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+using namespace dab;
+using namespace stick;
+
+struct TestMesh
+{
+    const char * name;
+    DynamicArray<Float32> positions; // xyz per vertex
+    DynamicArray<UInt32> indices;
+};
+
+static TestMesh makeSphere(UInt32 _rings, UInt32 _segments)
+{
+    TestMesh ret;
+    ret.name = "sphere";
+    for (UInt32 r = 0; r <= _rings; ++r)
+    {
+        Float32 theta = (Float32)r / _rings * 3.14159265f;
+        for (UInt32 s = 0; s <= _segments; ++s)
+        {
+            Float32 phi = (Float32)s / _segments * 2.0f * 3.14159265f;
+            ret.positions.append(std::sin(theta) * std::cos(phi));
+            ret.positions.append(std::cos(theta));
+            ret.positions.append(std::sin(theta) * std::sin(phi));
+        }
+    }
+    for (UInt32 r = 0; r < _rings; ++r)
+    {
+        for (UInt32 s = 0; s < _segments; ++s)
+        {
+            UInt32 a = r * (_segments + 1) + s;
+            UInt32 b = a + _segments + 1;
+            UInt32 tris[6] = { a, b, a + 1, a + 1, b, b + 1 };
+            ret.indices.append(tris, tris + 6);
+        }
+    }
+    return ret;
+}
+
+// authoring tools often emit triangles in no particular order, simulate that
+static void shuffleTriangles(DynamicArray<UInt32> & _indices)
+{
+    std::mt19937 rng(1);
+    Size triangleCount = _indices.count() / 3;
+    for (Size i = triangleCount - 1; i > 0; --i)
+    {
+        Size j = std::uniform_int_distribution<Size>(0, i)(rng);
+        for (Size k = 0; k < 3; ++k)
+            std::swap(_indices[i * 3 + k], _indices[j * 3 + k]);
+    }
+}
+
+static void report(const char * _stage,
+                   const DynamicArray<UInt32> & _indices,
+                   Size _vertexCount,
+                   double _milliseconds)
+{
+    printf("  %-14s ACMR(16) %.3f  ACMR(32) %.3f  %8.2f ms\n",
+           _stage,
+           averageCacheMissRatio(_indices.ptr(), _indices.count(), _vertexCount, 16),
+           averageCacheMissRatio(_indices.ptr(), _indices.count(), _vertexCount, 32),
+           _milliseconds);
+}
+
+int main(int _argc, const char * _args[])
+{
+    using Clock = std::chrono::high_resolution_clock;
+    auto elapsed = [](Clock::time_point _start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - _start).count();
+    };
+
+    TestMesh mesh = makeSphere(256, 512);
+    Size vertexCount = mesh.positions.count() / 3;
+    printf("%s: %lu vertices, %lu triangles\n",
+           mesh.name,
+           (unsigned long)vertexCount,
+           (unsigned long)(mesh.indices.count() / 3));
+
+    shuffleTriangles(mesh.indices);
+    report("shuffled", mesh.indices, vertexCount, 0.0);
+
+    auto start = Clock::now();
+    optimizeVertexCache(mesh.indices.ptr(), mesh.indices.ptr(), mesh.indices.count(), vertexCount);
+    report("vertex cache", mesh.indices, vertexCount, elapsed(start));
+
+    DynamicArray<UInt32> sorted;
+    sorted.resize(mesh.indices.count());
+    start = Clock::now();
+    optimizeOverdraw(sorted.ptr(),
+                     mesh.indices.ptr(),
+                     mesh.indices.count(),
+                     mesh.positions.ptr(),
+                     vertexCount,
+                     sizeof(Float32) * 3);
+    report("overdraw", sorted, vertexCount, elapsed(start));
+
+    DynamicArray<Float32> positions;
+    positions.resize(mesh.positions.count());
+    start = Clock::now();
+    Size fetchedCount = optimizeVertexFetch(positions.ptr(),
+                                            sorted.ptr(),
+                                            sorted.count(),
+                                            mesh.positions.ptr(),
+                                            vertexCount,
+                                            sizeof(Float32) * 3);
+    report("vertex fetch", sorted, fetchedCount, elapsed(start));
+
+    DynamicArray<UInt32> lodIndices;
+    DynamicArray<MeshLOD> lods;
+    start = Clock::now();
+    buildLODChain(lodIndices,
+                  lods,
+                  sorted.ptr(),
+                  sorted.count(),
+                  positions.ptr(),
+                  fetchedCount,
+                  sizeof(Float32) * 3);
+    printf("  lod chain      %8.2f ms\n", elapsed(start));
+    for (Size i = 0; i < lods.count(); ++i)
+    {
+        const MeshLOD & lod = lods[i];
+        printf("    lod %lu: %8lu triangles  error %.5f  ACMR(16) %.3f\n",
+               (unsigned long)i,
+               (unsigned long)(lod.indexCount / 3),
+               lod.error,
+               averageCacheMissRatio(
+                   lodIndices.ptr() + lod.firstIndex, lod.indexCount, fetchedCount, 16));
+    }
+
+    return EXIT_SUCCESS;
+}